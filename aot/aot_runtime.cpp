@@ -0,0 +1,131 @@
+#include "aot_runtime.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "../cpu/op_code.h"
+
+namespace EM
+{
+namespace
+{
+// Runs one instruction whose opcode byte is at pc - 1, the same way as
+// run_with_callback()
+void run_handler(CPU &cpu, const OpCode &op)
+{
+    auto state = cpu.registers.pc;
+    cpu.set_status(cpu.registers.p);
+    try
+    {
+        (cpu.*op.handler)();
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << "Runtime error: " << e.what();
+        std::cerr << " Opcode: " << op.mnemonic << " 0x" << std::hex << static_cast<int>(op.code);
+        std::cerr << " PC: " << cpu.registers.pc;
+        std::cerr << std::endl;
+    }
+    cpu.registers.p = cpu.status();
+
+    cpu.bus->tick(op.cycles);
+
+    if (state == cpu.registers.pc)
+    {
+        cpu.registers.pc += static_cast<uint16_t>(op.len - 1);
+    }
+}
+
+void interpret(CPU &cpu)
+{
+    auto code = cpu.read(cpu.registers.pc);
+    ++cpu.registers.pc;
+    const OpCode &op = OPCODE_TABLE[code];
+    cpu.operand = cpu.fetch_operand(cpu.registers.pc, op.len);
+    run_handler(cpu, op);
+}
+} // namespace
+
+AotFrame::AotFrame(CPU &cpu) : cpu(cpu), bus(*cpu.bus), ram(bus.ram.data())
+{
+    // Same mapping as Bus::read_prg_rom(): nes_aot only takes boards with
+    // fixed PRG-ROM
+    const auto &prg_rom = bus.rom->prg_rom;
+    if (prg_rom.size() == 0x4000 || prg_rom.size() >= 0x8000)
+    {
+        prg = prg_rom.data();
+        prg_mask = prg_rom.size() == 0x4000 ? 0x3fff : 0x7fff;
+    }
+}
+
+bool AotFrame::fallback(uint16_t pc, uint16_t operand)
+{
+    const OpCode &op = OPCODE_TABLE[read(pc)];
+    cpu.registers.pc = static_cast<uint16_t>(pc + 1);
+    cpu.operand = operand;
+    run_handler(cpu, op);
+    return cpu.registers.pc != static_cast<uint16_t>(pc + op.len) || bus.nmi_pending();
+}
+
+void AotFrame::fault(const std::runtime_error &e, uint16_t pc)
+{
+    const OpCode &op = OPCODE_TABLE[read(pc)];
+    std::cerr << "Runtime error: " << e.what();
+    std::cerr << " Opcode: " << op.mnemonic << " 0x" << std::hex << static_cast<int>(op.code);
+    std::cerr << " PC: " << static_cast<uint16_t>(pc + 1);
+    std::cerr << std::endl;
+}
+
+// Runs the generated blocks for the loaded ROM. PCs without a block and RAM
+// code go through the interpreter.
+// Builds with NES_AOT_ENTRIES append PRG-ROM entry points that had no block
+// to that file, for the next nes_aot run.
+template <> void CPU::run_aot()
+{
+    const AotProgram &program = AOT_PROGRAM;
+    if (program.prg_size != bus->rom->prg_rom.size() || program.prg_checksum != prg_checksum(bus->rom->prg_rom))
+    {
+        throw std::runtime_error("AOT program was generated from a different ROM");
+    }
+
+    std::vector<AotBlockFunction> blocks(0x8000);
+    for (size_t i = 0; i < program.block_count; ++i)
+    {
+        blocks[program.blocks[i].pc - 0x8000] = program.blocks[i].run;
+    }
+#ifdef NES_AOT_ENTRIES
+    std::vector<bool> reported(0x8000);
+#endif
+
+    AotFrame frame(*this);
+    while (true)
+    {
+        // Boards that raise IRQs switch PRG banks and have no AOT program,
+        // so blocks only ever return for the NMI
+        if (bus->nmi_pending() || bus->irq_pending())
+        {
+            set_status(registers.p);
+            poll_interrupts();
+        }
+
+        if (registers.pc >= 0x8000)
+        {
+            auto index = static_cast<size_t>(registers.pc - 0x8000);
+            if (blocks[index] != nullptr)
+            {
+                blocks[index](frame);
+                continue;
+            }
+#ifdef NES_AOT_ENTRIES
+            if (!reported[index])
+            {
+                reported[index] = true;
+                std::ofstream(NES_AOT_ENTRIES, std::ios::app) << std::hex << registers.pc << std::endl;
+            }
+#endif
+        }
+        interpret(*this);
+    }
+}
+} // namespace EM
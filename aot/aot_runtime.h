@@ -0,0 +1,293 @@
+#ifndef MYNESEMULATOR__AOT_RUNTIME_H_
+#define MYNESEMULATOR__AOT_RUNTIME_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "../bus/bus.h"
+#include "../cpu/cpu.h"
+
+namespace EM
+{
+// Registers of the running block. Generated code keeps them in a local so
+// they stay in host registers between bus accesses.
+struct AotRegisters
+{
+    uint8_t a = 0;
+    uint8_t x = 0;
+    uint8_t y = 0;
+    uint8_t sp = 0;
+    uint8_t p = 0;
+
+    void flag(uint8_t f, bool v)
+    {
+        p = static_cast<uint8_t>(v ? p | f : p & ~f);
+    }
+
+    void nz(uint8_t result)
+    {
+        p = static_cast<uint8_t>((p & ~(N | Z)) | (result & N) | (result == 0 ? Z : 0));
+    }
+
+    void n(uint8_t result)
+    {
+        p = static_cast<uint8_t>((p & ~N) | (result & N));
+    }
+
+    // Same flags as CPU::add_to_register_a
+    void adc(uint8_t data)
+    {
+        auto sum = static_cast<uint16_t>(a + data + (p & C));
+        auto result = static_cast<uint8_t>(sum);
+        flag(C, sum > 0xff);
+        flag(V, ((data ^ result) & (a ^ result) & 0x80) != 0);
+        a = result;
+        nz(a);
+    }
+
+    // Same flags as CPU::SBC, including its carry and zero tests
+    void sbc(uint8_t data)
+    {
+        auto result = static_cast<uint16_t>(a - data - ((p & C) ? 0 : 1));
+        flag(N, result & 0x80);
+        flag(Z, result == 0);
+        flag(C, result < 0xff);
+        flag(V, ((a ^ result) & (a ^ data) & 0x80) != 0);
+        a = static_cast<uint8_t>(result);
+    }
+
+    void compare(uint8_t with, uint8_t data)
+    {
+        flag(C, data <= with);
+        nz(static_cast<uint8_t>(with - data));
+    }
+
+    // Same flags as CPU::BIT
+    void bit(uint8_t data)
+    {
+        flag(Z, (a & data) == 0);
+        flag(N, data & N);
+        flag(V, data & 0b0100'1000);
+    }
+
+    // Shifts only update C; callers set N/Z like the matching handler
+    uint8_t asl(uint8_t data)
+    {
+        flag(C, data & 0x80);
+        return static_cast<uint8_t>(data << 1);
+    }
+
+    uint8_t lsr(uint8_t data)
+    {
+        flag(C, data & 0x01);
+        return static_cast<uint8_t>(data >> 1);
+    }
+
+    uint8_t rol(uint8_t data)
+    {
+        auto carry = static_cast<uint8_t>(p & C);
+        flag(C, data & 0x80);
+        return static_cast<uint8_t>(data << 1 | carry);
+    }
+
+    uint8_t ror(uint8_t data)
+    {
+        auto carry = static_cast<uint8_t>((p & C) << 7);
+        flag(C, data & 0x01);
+        return static_cast<uint8_t>(data >> 1 | carry);
+    }
+};
+
+// Per-run state handed to every generated block. Memory accesses with a
+// known target are resolved by the generator; these cover the rest with the
+// same mapping as Bus::read and Bus::write.
+class AotFrame
+{
+  public:
+    explicit AotFrame(CPU &cpu);
+
+    CPU &cpu;
+    Bus &bus;
+    uint8_t *ram;
+
+    // Called first by every block
+    AotRegisters begin()
+    {
+        pending = false;
+        return load();
+    }
+
+    void leave(const AotRegisters &r, uint16_t pc)
+    {
+        store(r);
+        cpu.registers.pc = pc;
+    }
+
+    uint8_t read(uint16_t addr)
+    {
+        if (addr <= RAM_MIRRORS_END)
+        {
+            return ram[addr & 0x07ff];
+        }
+        if (addr >= 0x8000 && prg != nullptr)
+        {
+            return prg[addr & prg_mask];
+        }
+        return bus.read(addr);
+    }
+
+    void write(uint16_t addr, uint8_t data)
+    {
+        if (addr <= RAM_MIRRORS_END)
+        {
+            write_ram(static_cast<uint16_t>(addr & 0x07ff), data);
+        }
+        else
+        {
+            write_io(addr, data);
+        }
+    }
+
+    // Same dirty-page bookkeeping as Bus::write
+    void write_ram(uint16_t addr, uint8_t data)
+    {
+        ram[addr] = data;
+        auto page = static_cast<uint8_t>(1 << (addr >> 8));
+        if (bus.ram_code_pages & page)
+        {
+            bus.ram_code_dirty |= page;
+        }
+    }
+
+    // Writing PPUCTRL can raise the NMI outside of a tick
+    void write_io(uint16_t addr, uint8_t data)
+    {
+        bus.write(addr, data);
+        pending = pending || bus.nmi_pending();
+    }
+
+    uint16_t pointer(uint8_t zero_page) const
+    {
+        return static_cast<uint16_t>(ram[static_cast<uint8_t>(zero_page + 1)] << 8 | ram[zero_page]);
+    }
+
+    static uint16_t index(uint16_t base, uint8_t by)
+    {
+        return static_cast<uint16_t>(base + by);
+    }
+
+    static bool crosses(uint16_t base, uint8_t by)
+    {
+        return ((base & 0xff) + by) > 0xff;
+    }
+
+    void push(AotRegisters &r, uint8_t data)
+    {
+        write_ram(static_cast<uint16_t>(0x0100 + r.sp), data);
+        --r.sp;
+    }
+
+    uint8_t pop(AotRegisters &r)
+    {
+        ++r.sp;
+        return ram[0x0100 + r.sp];
+    }
+
+    // Advances the bus. Before the scheduler's next event only the cycle
+    // counter moves, the same as Bus::tick; reaching it hands the registers
+    // back, with the PC the interpreter would hold, before Bus::tick runs the
+    // PPU, the frame callback and any OAM DMA stall.
+    void tick(const AotRegisters &r, uint16_t pc, uint8_t cycles)
+    {
+        if (bus.cycles + cycles < bus.scheduler.next)
+        {
+            bus.cycles += cycles;
+            return;
+        }
+        leave(r, pc);
+        // Keeps CPU::status() right for the frame callback
+        cpu.set_status(r.p);
+        bus.tick(cycles);
+        pending = pending || bus.nmi_pending();
+    }
+
+    // Finishes an instruction; true when the block has to return so the run
+    // loop can take the NMI
+    bool end(const AotRegisters &r, uint16_t pc, uint8_t cycles)
+    {
+        tick(r, pc, cycles);
+        return pending;
+    }
+
+    // Runs the instruction at pc through its interpreter handler. True when
+    // the block has to return; registers.pc is set either way.
+    bool execute(AotRegisters &r, uint16_t pc, uint16_t operand)
+    {
+        store(r);
+        bool leave = fallback(pc, operand);
+        r = load();
+        return leave;
+    }
+
+    // Reports a Bus error the same way as run_with_callback(); the rest of
+    // the instruction at pc is skipped but it still ticks
+    void fault(const std::runtime_error &e, uint16_t pc);
+
+  private:
+    const uint8_t *prg = nullptr;
+    uint16_t prg_mask = 0;
+    bool pending = false;
+
+    AotRegisters load() const
+    {
+        const auto &r = cpu.registers;
+        return {r.a, r.x, r.y, r.sp, r.p};
+    }
+
+    void store(const AotRegisters &r)
+    {
+        auto &registers = cpu.registers;
+        registers.a = r.a;
+        registers.x = r.x;
+        registers.y = r.y;
+        registers.sp = r.sp;
+        registers.p = r.p;
+    }
+
+    bool fallback(uint16_t pc, uint16_t operand);
+};
+
+using AotBlockFunction = void (*)(AotFrame &);
+
+struct AotBlock
+{
+    uint16_t pc;
+    AotBlockFunction run;
+};
+
+// What nes_aot generates for one ROM
+struct AotProgram
+{
+    uint32_t prg_checksum;
+    size_t prg_size;
+    const AotBlock *blocks;
+    size_t block_count;
+};
+
+// Defined by the generated translation unit linked into emulator_aot
+extern const AotProgram AOT_PROGRAM;
+
+// FNV-1a over PRG-ROM, so a program is never run against another ROM
+inline uint32_t prg_checksum(RomSpan prg_rom)
+{
+    uint32_t hash = 2166136261u;
+    for (auto byte : prg_rom)
+    {
+        hash = (hash ^ byte) * 16777619u;
+    }
+    return hash;
+}
+} // namespace EM
+#endif
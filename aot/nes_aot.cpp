@@ -0,0 +1,46 @@
+// Static recompiler front end:
+//
+//     nes_aot <rom.nes> <out.cpp> [entries.txt]
+//
+// entries.txt lists extra PRG-ROM entry points in hex, one per line, as
+// written by an emulator_aot build when it meets code it has no block for.
+#include "../cartridge/cartridge.h"
+#include "static_recompiler.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: nes_aot <rom.nes> <out.cpp> [entries.txt]" << std::endl;
+        return 1;
+    }
+
+    EM::Rom rom = EM::Rom::load(argv[1]);
+    EM::StaticRecompiler recompiler(rom);
+
+    if (argc > 3)
+    {
+        std::ifstream entries(argv[3]);
+        unsigned int pc = 0;
+        while (entries >> std::hex >> pc)
+        {
+            recompiler.add_entry(static_cast<uint16_t>(pc));
+        }
+    }
+    recompiler.analyse();
+
+    std::ofstream out(argv[2]);
+    recompiler.generate(out, argv[1]);
+    if (!out)
+    {
+        std::cerr << "nes_aot: unable to write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "nes_aot: " << recompiler.block_count() << " blocks" << std::endl;
+    return 0;
+}
@@ -0,0 +1,681 @@
+#include "static_recompiler.h"
+
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+#include "../cpu/cpu.h"
+#include "../emulator/trace.h"
+#include "aot_runtime.h"
+
+namespace EM
+{
+namespace
+{
+constexpr uint32_t PRG_ROM_START = 0x8000;
+
+std::string literal(uint16_t value)
+{
+    char text[8];
+    std::snprintf(text, sizeof(text), "0x%04x", value);
+    return text;
+}
+
+std::string literal(uint8_t value)
+{
+    char text[8];
+    std::snprintf(text, sizeof(text), "0x%02x", value);
+    return text;
+}
+
+uint16_t branch_target(const DecodedInstruction &instruction)
+{
+    auto next = static_cast<uint16_t>(instruction.pc + instruction.len);
+    return static_cast<uint16_t>(next + static_cast<uint16_t>(static_cast<int8_t>(instruction.operand)));
+}
+
+// Where a transfer to `target` leaves PC, including the run loop's
+// adjustment when the target is the byte after the opcode
+uint16_t final_pc(const DecodedInstruction &instruction, uint16_t target)
+{
+    auto after_opcode = static_cast<uint16_t>(instruction.pc + 1);
+    return target == after_opcode ? static_cast<uint16_t>(target + instruction.len - 1) : target;
+}
+
+std::string disassemble(const DecodedInstruction &instruction)
+{
+    const OpCode &op = OPCODE_TABLE[instruction.code];
+    std::string text = "$" + to_hex(instruction.pc) + "  " + op.mnemonic;
+    auto zero_page = static_cast<uint8_t>(instruction.operand);
+    switch (op.mode)
+    {
+    case Immediate:
+        return text + " #$" + to_hex(zero_page);
+    case ZeroPage:
+        return text + " $" + to_hex(zero_page);
+    case ZeroPage_X:
+        return text + " $" + to_hex(zero_page) + ",X";
+    case ZeroPage_Y:
+        return text + " $" + to_hex(zero_page) + ",Y";
+    case Absolute:
+        return text + " $" + to_hex(instruction.operand);
+    case Absolute_X:
+        return text + " $" + to_hex(instruction.operand) + ",X";
+    case Absolute_Y:
+        return text + " $" + to_hex(instruction.operand) + ",Y";
+    case Indirect_X:
+        return text + " ($" + to_hex(zero_page) + ",X)";
+    case Indirect_Y:
+        return text + " ($" + to_hex(zero_page) + "),Y";
+    default:
+        break;
+    }
+    if (instruction.code == 0x6c)
+    {
+        return text + " ($" + to_hex(instruction.operand) + ")";
+    }
+    if (instruction.len == 2)
+    {
+        return text + " $" + to_hex(branch_target(instruction));
+    }
+    if (instruction.len == 3)
+    {
+        return text + " $" + to_hex(instruction.operand);
+    }
+    return text;
+}
+
+// Opcodes whose handler ticks once more when the indexed access crosses a page
+bool ticks_on_page_cross(uint8_t code)
+{
+    switch (code)
+    {
+    case 0xbd: case 0xb9: case 0xb1: // LDA
+    case 0xbe:                       // LDX
+    case 0xbc:                       // LDY
+    case 0x3d: case 0x39: case 0x31: // AND
+    case 0x1d: case 0x19: case 0x11: // ORA
+    case 0x5d: case 0x59: case 0x51: // EOR
+    case 0x7d: case 0x79: case 0x71: // ADC
+    case 0xfd: case 0xf9: case 0xf1: // SBC
+    case 0xdd: case 0xd9: case 0xd1: // CMP
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether the operand access can reach Bus, which may throw
+bool may_fault(const DecodedInstruction &instruction)
+{
+    switch (OPCODE_TABLE[instruction.code].mode)
+    {
+    case NoneAddressing:
+    case Immediate:
+    case ZeroPage:
+    case ZeroPage_X:
+    case ZeroPage_Y:
+        return false;
+    case Absolute:
+        return instruction.operand > RAM_MIRRORS_END;
+    default:
+        return true;
+    }
+}
+
+const char *branch_condition(uint8_t code)
+{
+    switch (code)
+    {
+    case 0x10:
+        return "!(r.p & N)";
+    case 0x30:
+        return "r.p & N";
+    case 0x50:
+        return "!(r.p & V)";
+    case 0x70:
+        return "r.p & V";
+    case 0x90:
+        return "!(r.p & C)";
+    case 0xb0:
+        return "r.p & C";
+    case 0xd0:
+        return "!(r.p & Z)";
+    case 0xf0:
+        return "r.p & Z";
+    default:
+        return nullptr;
+    }
+}
+} // namespace
+
+StaticRecompiler::StaticRecompiler(const Rom &rom) : rom(rom), bus(&this->rom, [](NesPPU &, Joypad &) {})
+{
+    // Generated blocks read their code and data from the power-on banks
+    if (!bus.mapper->fixed_prg())
+    {
+        throw std::runtime_error("AOT: mapper " + std::to_string(rom.mapper) + " switches PRG-ROM banks");
+    }
+    // Vectors are read the same way CPU::reset and CPU::interrupt do
+    for (uint16_t vector : {uint16_t{0xfffc}, uint16_t{0xfffa}, uint16_t{0xfffe}})
+    {
+        auto lo = static_cast<uint16_t>(bus.read(vector));
+        auto hi = static_cast<uint16_t>(bus.read(static_cast<uint16_t>(vector + 1)));
+        add_entry(static_cast<uint16_t>(hi << 8 | lo));
+    }
+}
+
+void StaticRecompiler::add_entry(uint16_t pc)
+{
+    // RAM code can change at any time and is left to the interpreter
+    if (pc >= PRG_ROM_START)
+    {
+        entries.insert(pc);
+    }
+}
+
+void StaticRecompiler::analyse()
+{
+    std::vector<uint16_t> pending(entries.begin(), entries.end());
+    while (!pending.empty())
+    {
+        auto pc = pending.back();
+        pending.pop_back();
+        if (blocks.count(pc))
+        {
+            continue;
+        }
+
+        auto block = decode_block(pc);
+        if (block.instructions.empty())
+        {
+            continue;
+        }
+        for (auto target : successors(block))
+        {
+            if (target >= PRG_ROM_START && !blocks.count(target))
+            {
+                pending.push_back(target);
+            }
+        }
+        blocks.emplace(pc, std::move(block));
+    }
+}
+
+bool StaticRecompiler::ends_block(uint8_t code)
+{
+    // BRK is not a control transfer in this core, see CPU::BRK
+    return code != 0x00 && BlockCache::ends_block(code);
+}
+
+StaticRecompiler::Block StaticRecompiler::decode_block(uint16_t pc)
+{
+    Block block;
+    block.start = pc;
+
+    uint32_t addr = pc;
+    while (block.instructions.size() < MAX_BLOCK_LENGTH)
+    {
+        auto instruction = BlockCache::decode(bus, static_cast<uint16_t>(addr));
+        // Operands wrapping around to RAM are not constant
+        if (addr + instruction.len > 0x10000)
+        {
+            break;
+        }
+        block.instructions.push_back(instruction);
+        addr += instruction.len;
+        if (ends_block(instruction.code) || addr > 0xffff)
+        {
+            break;
+        }
+    }
+    block.next = static_cast<uint16_t>(addr);
+    return block;
+}
+
+std::vector<uint16_t> StaticRecompiler::successors(const Block &block)
+{
+    if (block.instructions.empty())
+    {
+        return {};
+    }
+
+    const auto &last = block.instructions.back();
+    auto next = static_cast<uint16_t>(last.pc + last.len);
+    if (branch_condition(last.code) != nullptr)
+    {
+        return {final_pc(last, branch_target(last)), next};
+    }
+    switch (last.code)
+    {
+    case 0x4c: // JMP
+        return {final_pc(last, last.operand)};
+    case 0x20: // JSR, and where its RTS returns to
+        return {final_pc(last, last.operand), next};
+    case 0x6c: // JMP indirect
+    case 0x60: // RTS
+    case 0x40: // RTI
+        return {};
+    default:
+        return {block.next};
+    }
+}
+
+void StaticRecompiler::generate(std::ostream &out, const std::string &rom_name) const
+{
+    out << "// Generated by nes_aot from " << rom_name << ". Do not edit.\n";
+    out << "#include \"aot/aot_runtime.h\"\n\n";
+    out << "namespace EM\n{\nnamespace\n{\n";
+    for (const auto &[pc, block] : blocks)
+    {
+        emit_block(out, block);
+    }
+
+    out << "const AotBlock BLOCKS[] = {\n";
+    for (const auto &[pc, block] : blocks)
+    {
+        out << "    {" << literal(pc) << ", &block_" << to_hex(pc) << "},\n";
+    }
+    out << "};\n} // namespace\n\n";
+
+    out << "const AotProgram AOT_PROGRAM = {" << prg_checksum(rom.prg_rom) << "u, " << rom.prg_rom.size()
+        << ", BLOCKS, " << blocks.size() << "};\n";
+    out << "} // namespace EM\n";
+}
+
+void StaticRecompiler::emit_block(std::ostream &out, const Block &block) const
+{
+    std::ostringstream body;
+    bool loops = false;
+    for (size_t i = 0; i < block.instructions.size(); ++i)
+    {
+        emit_instruction(body, block, i, loops);
+    }
+
+    out << "void block_" << to_hex(block.start) << "(AotFrame &f)\n{\n";
+    out << "    AotRegisters r = f.begin();\n";
+    if (loops)
+    {
+        out << "start:\n";
+    }
+    out << body.str() << "}\n\n";
+}
+
+std::string StaticRecompiler::address(const DecodedInstruction &instruction) const
+{
+    auto zero_page = literal(static_cast<uint8_t>(instruction.operand));
+    switch (OPCODE_TABLE[instruction.code].mode)
+    {
+    case ZeroPage:
+        return literal(static_cast<uint16_t>(instruction.operand & 0xff));
+    case Absolute:
+        return literal(instruction.operand);
+    case ZeroPage_X:
+        return "static_cast<uint8_t>(" + zero_page + " + r.x)";
+    case ZeroPage_Y:
+        return "static_cast<uint8_t>(" + zero_page + " + r.y)";
+    case Absolute_X:
+        return "f.index(" + literal(instruction.operand) + ", r.x)";
+    case Absolute_Y:
+        return "f.index(" + literal(instruction.operand) + ", r.y)";
+    case Indirect_X:
+        return "f.pointer(static_cast<uint8_t>(" + zero_page + " + r.x))";
+    case Indirect_Y:
+        return "f.index(f.pointer(" + zero_page + "), r.y)";
+    default:
+        throw std::runtime_error("nes_aot: instruction has no operand address");
+    }
+}
+
+// Operand reads resolved as far as the addressing mode allows: RAM and
+// zero-page indexing index RAM directly, and PRG-ROM bytes are constants
+std::string StaticRecompiler::read(const DecodedInstruction &instruction) const
+{
+    auto mode = OPCODE_TABLE[instruction.code].mode;
+    switch (mode)
+    {
+    case Immediate:
+        return literal(static_cast<uint8_t>(instruction.operand));
+    case ZeroPage:
+    case Absolute: {
+        auto addr = mode == ZeroPage ? static_cast<uint16_t>(instruction.operand & 0xff) : instruction.operand;
+        if (addr <= RAM_MIRRORS_END)
+        {
+            return "f.ram[" + literal(static_cast<uint16_t>(addr & 0x07ff)) + "]";
+        }
+        if (addr >= PRG_ROM_START)
+        {
+            return literal(bus.read_prg_rom(addr));
+        }
+        return "f.bus.read(" + literal(addr) + ")";
+    }
+    case ZeroPage_X:
+    case ZeroPage_Y:
+        return "f.ram[" + address(instruction) + "]";
+    default:
+        return "f.read(" + address(instruction) + ")";
+    }
+}
+
+std::string StaticRecompiler::write(const DecodedInstruction &instruction, const std::string &value) const
+{
+    auto mode = OPCODE_TABLE[instruction.code].mode;
+    switch (mode)
+    {
+    case ZeroPage:
+    case Absolute: {
+        auto addr = mode == ZeroPage ? static_cast<uint16_t>(instruction.operand & 0xff) : instruction.operand;
+        if (addr <= RAM_MIRRORS_END)
+        {
+            return "f.write_ram(" + literal(static_cast<uint16_t>(addr & 0x07ff)) + ", " + value + ");";
+        }
+        return "f.write_io(" + literal(addr) + ", " + value + ");";
+    }
+    case ZeroPage_X:
+    case ZeroPage_Y:
+        return "f.write_ram(" + address(instruction) + ", " + value + ");";
+    default:
+        return "f.write(" + address(instruction) + ", " + value + ");";
+    }
+}
+
+void StaticRecompiler::emit_instruction(std::ostream &out, const Block &block, size_t index, bool &loops) const
+{
+    const auto &instruction = block.instructions[index];
+    const OpCode &op = OPCODE_TABLE[instruction.code];
+    const bool last = index + 1 == block.instructions.size();
+    const auto next = static_cast<uint16_t>(instruction.pc + instruction.len);
+    const auto cycles = std::to_string(op.cycles);
+    // What registers.pc holds while the interpreter's handler runs
+    const auto during = literal(static_cast<uint16_t>(instruction.pc + 1));
+
+    // Ends a transfer to `target`; a block jumping to its own start loops
+    // without going back through the run loop
+    auto transfer = [&](uint16_t target, const char *indent) {
+        auto pc = final_pc(instruction, target);
+        if (pc == block.start)
+        {
+            loops = true;
+            out << indent << "if (!f.end(r, " << literal(target) << ", " << cycles << ")) goto start;\n";
+        }
+        else
+        {
+            out << indent << "f.end(r, " << literal(target) << ", " << cycles << ");\n";
+        }
+        out << indent << "return f.leave(r, " << literal(pc) << ");\n";
+    };
+
+    out << "    // " << disassemble(instruction) << "\n";
+
+    // Handler body of memory instructions, which a faulting Bus access cuts
+    // short the same way as in run_with_callback()
+    std::ostringstream body;
+
+    // Read-modify-write: the address is evaluated once
+    auto modify = [&](const std::function<std::string(const std::string &)> &operation, const char *flags) {
+        auto mode = op.mode;
+        std::string addr = address(instruction);
+        bool ram = mode == ZeroPage || mode == ZeroPage_X ||
+                   (mode == Absolute && instruction.operand <= RAM_MIRRORS_END);
+        if (mode == Absolute && ram)
+        {
+            addr = literal(static_cast<uint16_t>(instruction.operand & 0x07ff));
+        }
+        body << "    {\n";
+        body << "        uint16_t addr = " << addr << ";\n";
+        if (ram)
+        {
+            body << "        auto data = " << operation("f.ram[addr]") << ";\n";
+            body << "        f.write_ram(addr, data);\n";
+        }
+        else
+        {
+            body << "        auto data = " << operation("f.read(addr)") << ";\n";
+            body << "        f.write(addr, data);\n";
+        }
+        body << "        r." << flags << "(data);\n";
+        body << "    }\n";
+    };
+
+    if (const char *condition = branch_condition(instruction.code))
+    {
+        auto target = branch_target(instruction);
+        out << "    if (" << condition << ")\n    {\n";
+        out << "        f.tick(r, " << during << ", 1);\n";
+        if ((next & 0xff00) != (target & 0xff00))
+        {
+            out << "        f.tick(r, " << during << ", 1);\n";
+        }
+        transfer(target, "        ");
+        out << "    }\n";
+        out << "    f.end(r, " << during << ", " << cycles << ");\n";
+        out << "    return f.leave(r, " << literal(next) << ");\n";
+        return;
+    }
+
+    switch (instruction.code)
+    {
+    /* Loads and stores */
+    case 0xa9: case 0xa5: case 0xb5: case 0xad: case 0xbd: case 0xb9: case 0xa1: case 0xb1:
+        body << "    r.a = " << read(instruction) << ";\n    r.nz(r.a);\n";
+        break;
+    case 0xa2: case 0xa6: case 0xb6: case 0xae: case 0xbe:
+        body << "    r.x = " << read(instruction) << ";\n    r.nz(r.x);\n";
+        break;
+    case 0xa0: case 0xa4: case 0xb4: case 0xac: case 0xbc:
+        body << "    r.y = " << read(instruction) << ";\n    r.nz(r.y);\n";
+        break;
+    case 0x85: case 0x95: case 0x8d: case 0x9d: case 0x99: case 0x81: case 0x91:
+        body << "    " << write(instruction, "r.a") << "\n";
+        break;
+    case 0x86: case 0x96: case 0x8e:
+        body << "    " << write(instruction, "r.x") << "\n";
+        break;
+    case 0x84: case 0x94: case 0x8c:
+        body << "    " << write(instruction, "r.y") << "\n";
+        break;
+
+    /* Arithmetic and logic */
+    case 0x29: case 0x25: case 0x35: case 0x2d: case 0x3d: case 0x39: case 0x21: case 0x31:
+        body << "    r.a &= " << read(instruction) << ";\n    r.nz(r.a);\n";
+        break;
+    case 0x09: case 0x05: case 0x15: case 0x0d: case 0x1d: case 0x19: case 0x01: case 0x11:
+        body << "    r.a |= " << read(instruction) << ";\n    r.nz(r.a);\n";
+        break;
+    case 0x49: case 0x45: case 0x55: case 0x4d: case 0x5d: case 0x59: case 0x41: case 0x51:
+        body << "    r.a ^= " << read(instruction) << ";\n    r.nz(r.a);\n";
+        break;
+    case 0x69: case 0x65: case 0x75: case 0x6d: case 0x7d: case 0x79: case 0x61: case 0x71:
+        body << "    r.adc(" << read(instruction) << ");\n";
+        break;
+    case 0xe9: case 0xe5: case 0xf5: case 0xed: case 0xfd: case 0xf9: case 0xe1: case 0xf1:
+        body << "    r.sbc(" << read(instruction) << ");\n";
+        break;
+    case 0xc9: case 0xc5: case 0xd5: case 0xcd: case 0xdd: case 0xd9: case 0xc1: case 0xd1:
+        body << "    r.compare(r.a, " << read(instruction) << ");\n";
+        break;
+    case 0xe0: case 0xe4: case 0xec:
+        body << "    r.compare(r.x, " << read(instruction) << ");\n";
+        break;
+    case 0xc0: case 0xc4: case 0xcc:
+        body << "    r.compare(r.y, " << read(instruction) << ");\n";
+        break;
+    case 0x24: case 0x2c:
+        body << "    r.bit(" << read(instruction) << ");\n";
+        break;
+
+    /* Read-modify-write; ROL and ROR on memory only update N */
+    case 0xe6: case 0xf6: case 0xee: case 0xfe:
+        modify([](const std::string &data) { return "static_cast<uint8_t>(" + data + " + 1)"; }, "nz");
+        break;
+    case 0xc6: case 0xd6: case 0xce: case 0xde:
+        modify([](const std::string &data) { return "static_cast<uint8_t>(" + data + " - 1)"; }, "nz");
+        break;
+    case 0x06: case 0x16: case 0x0e: case 0x1e:
+        modify([](const std::string &data) { return "r.asl(" + data + ")"; }, "nz");
+        break;
+    case 0x46: case 0x56: case 0x4e: case 0x5e:
+        modify([](const std::string &data) { return "r.lsr(" + data + ")"; }, "nz");
+        break;
+    case 0x26: case 0x36: case 0x2e: case 0x3e:
+        modify([](const std::string &data) { return "r.rol(" + data + ")"; }, "n");
+        break;
+    case 0x66: case 0x76: case 0x6e: case 0x7e:
+        modify([](const std::string &data) { return "r.ror(" + data + ")"; }, "n");
+        break;
+    case 0x0a:
+        body << "    r.a = r.asl(r.a);\n    r.nz(r.a);\n";
+        break;
+    case 0x4a:
+        body << "    r.a = r.lsr(r.a);\n    r.nz(r.a);\n";
+        break;
+    case 0x2a:
+        body << "    r.a = r.rol(r.a);\n    r.nz(r.a);\n";
+        break;
+    case 0x6a:
+        body << "    r.a = r.ror(r.a);\n    r.nz(r.a);\n";
+        break;
+
+    /* Register transfers, increments, stack and flags */
+    case 0xaa:
+        out << "    r.x = r.a;\n    r.nz(r.x);\n";
+        break;
+    case 0xa8:
+        out << "    r.y = r.a;\n    r.nz(r.y);\n";
+        break;
+    case 0x8a:
+        out << "    r.a = r.x;\n    r.nz(r.a);\n";
+        break;
+    case 0x98:
+        out << "    r.a = r.y;\n    r.nz(r.a);\n";
+        break;
+    case 0xba:
+        out << "    r.x = r.sp;\n    r.nz(r.x);\n";
+        break;
+    case 0x9a:
+        out << "    r.sp = r.x;\n";
+        break;
+    case 0xe8:
+        out << "    ++r.x;\n    r.nz(r.x);\n";
+        break;
+    case 0xc8:
+        out << "    ++r.y;\n    r.nz(r.y);\n";
+        break;
+    case 0xca:
+        out << "    --r.x;\n    r.nz(r.x);\n";
+        break;
+    case 0x88:
+        out << "    --r.y;\n    r.nz(r.y);\n";
+        break;
+    case 0x48:
+        out << "    f.push(r, r.a);\n";
+        break;
+    case 0x68:
+        out << "    r.a = f.pop(r);\n    r.nz(r.a);\n";
+        break;
+    case 0x08:
+        out << "    f.push(r, static_cast<uint8_t>(r.p | B | U));\n";
+        break;
+    case 0x28:
+        out << "    r.p = static_cast<uint8_t>((f.pop(r) & ~B) | U);\n";
+        break;
+    case 0x18:
+        out << "    r.flag(C, false);\n";
+        break;
+    case 0x38:
+        out << "    r.flag(C, true);\n";
+        break;
+    case 0x58:
+        out << "    r.flag(I, false);\n";
+        break;
+    case 0x78:
+        out << "    r.flag(I, true);\n";
+        break;
+    case 0xb8:
+        out << "    r.flag(V, false);\n";
+        break;
+    case 0xd8:
+    case 0x00: // BRK behaves like CLD, see CPU::BRK
+        out << "    r.flag(D, false);\n";
+        break;
+    case 0xf8:
+        out << "    r.flag(D, true);\n";
+        break;
+    case 0xea:
+        break;
+
+    /* Control transfers */
+    case 0x4c:
+        transfer(instruction.operand, "    ");
+        return;
+    case 0x20: {
+        auto return_addr = static_cast<uint16_t>(instruction.pc + 2);
+        out << "    f.push(r, " << literal(static_cast<uint8_t>(return_addr >> 8)) << ");\n";
+        out << "    f.push(r, " << literal(static_cast<uint8_t>(return_addr)) << ");\n";
+        transfer(instruction.operand, "    ");
+        return;
+    }
+    case 0x60:
+        out << "    {\n";
+        out << "        auto lo = f.pop(r);\n";
+        out << "        auto hi = f.pop(r);\n";
+        out << "        auto pc = static_cast<uint16_t>((hi << 8 | lo) + 1);\n";
+        out << "        f.end(r, pc, " << cycles << ");\n";
+        out << "        return f.leave(r, pc);\n";
+        out << "    }\n";
+        return;
+
+    default:
+        // Everything else runs through its interpreter handler, which also
+        // ticks the bus and moves PC
+        if (last)
+        {
+            out << "    f.execute(r, " << literal(instruction.pc) << ", " << literal(instruction.operand) << ");\n";
+            out << "    return;\n";
+        }
+        else
+        {
+            out << "    if (f.execute(r, " << literal(instruction.pc) << ", " << literal(instruction.operand)
+                << ")) return;\n";
+        }
+        return;
+    }
+
+    if (ticks_on_page_cross(instruction.code))
+    {
+        std::string base = op.mode == Indirect_Y ? "f.pointer(" + literal(static_cast<uint8_t>(instruction.operand)) + ")"
+                                                 : literal(instruction.operand);
+        const char *by = op.mode == Absolute_X ? "r.x" : "r.y";
+        body << "    if (f.crosses(" << base << ", " << by << ")) f.tick(r, " << during << ", 1);\n";
+    }
+
+    if (may_fault(instruction))
+    {
+        out << "    try\n    {\n";
+        std::istringstream lines(body.str());
+        for (std::string line; std::getline(lines, line);)
+        {
+            out << "    " << line << "\n";
+        }
+        out << "    }\n";
+        out << "    catch (const std::runtime_error &e)\n    {\n";
+        out << "        f.fault(e, " << literal(instruction.pc) << ");\n";
+        out << "    }\n";
+    }
+    else
+    {
+        out << body.str();
+    }
+
+    if (last)
+    {
+        out << "    f.end(r, " << during << ", " << cycles << ");\n";
+        out << "    f.leave(r, " << literal(next) << ");\n";
+    }
+    else
+    {
+        out << "    if (f.end(r, " << during << ", " << cycles << ")) return f.leave(r, " << literal(next) << ");\n";
+    }
+}
+} // namespace EM
@@ -0,0 +1,68 @@
+#ifndef MYNESEMULATOR__STATIC_RECOMPILER_H_
+#define MYNESEMULATOR__STATIC_RECOMPILER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../bus/bus.h"
+#include "../cartridge/cartridge.h"
+#include "../cpu/block_cache.h"
+
+namespace EM
+{
+// Translates the PRG-ROM code of one ROM into C++ ahead of time. Code is
+// found by recursive descent from the reset/NMI/IRQ vectors and any extra
+// entry points, such as those recorded by an NES_AOT_ENTRIES build. Each
+// basic block becomes a function over AotFrame (aot/aot_runtime.h), keyed by
+// its start PC in the generated AOT_PROGRAM.
+class StaticRecompiler
+{
+  public:
+    explicit StaticRecompiler(const Rom &rom);
+
+    void add_entry(uint16_t pc);
+    // Decodes every block reachable from the vectors and added entries
+    void analyse();
+    // Writes the translation unit defining AOT_PROGRAM
+    void generate(std::ostream &out, const std::string &rom_name) const;
+
+    size_t block_count() const
+    {
+        return blocks.size();
+    }
+
+  private:
+    static constexpr size_t MAX_BLOCK_LENGTH = 64;
+
+    struct Block
+    {
+        uint16_t start = 0;
+        std::vector<DecodedInstruction> instructions;
+        // PC to continue at when the block runs off its last instruction
+        uint16_t next = 0;
+    };
+
+    Rom rom;
+    Bus bus;
+    std::set<uint16_t> entries;
+    std::map<uint16_t, Block> blocks;
+
+    Block decode_block(uint16_t pc);
+    static bool ends_block(uint8_t code);
+    static std::vector<uint16_t> successors(const Block &block);
+
+    void emit_block(std::ostream &out, const Block &block) const;
+    void emit_instruction(std::ostream &out, const Block &block, size_t index, bool &loops) const;
+
+    // C++ expressions for operand accesses
+    std::string address(const DecodedInstruction &instruction) const;
+    std::string read(const DecodedInstruction &instruction) const;
+    std::string write(const DecodedInstruction &instruction, const std::string &value) const;
+};
+} // namespace EM
+#endif
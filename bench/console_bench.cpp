@@ -0,0 +1,160 @@
+// Frames per second and data cache misses per emulated frame with the
+// Console layout, against the same components allocated one by one.
+//
+// usage: console_bench rom.nes [frames]
+//
+// Cache misses come from perf_event_open and are only reported on Linux;
+// elsewhere only the frame rate is printed.
+#include "../bus/bus.h"
+#include "../cartridge/cartridge.h"
+#include "../console/console.h"
+#include "../cpu/cpu.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+// A hardware cache event counted in user space only, or nothing where the
+// kernel does not allow it
+class CacheCounter
+{
+  public:
+    CacheCounter(uint32_t type, uint64_t config)
+    {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)type;
+        (void)config;
+#endif
+    }
+
+    ~CacheCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+#endif
+    }
+
+    bool available() const
+    {
+        return fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+            {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+  private:
+    int fd = -1;
+};
+
+#ifdef __linux__
+constexpr uint64_t L1D_READ_MISS =
+    PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+constexpr uint64_t LL_READ_MISS =
+    PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+#endif
+
+void measure(const char *layout, EM::CPU &cpu, size_t frames)
+{
+#ifdef __linux__
+    CacheCounter l1d(PERF_TYPE_HW_CACHE, L1D_READ_MISS);
+    CacheCounter ll(PERF_TYPE_HW_CACHE, LL_READ_MISS);
+#else
+    CacheCounter l1d(0, 0);
+    CacheCounter ll(0, 0);
+#endif
+
+    cpu.reset();
+    auto start = std::chrono::steady_clock::now();
+    l1d.start();
+    ll.start();
+    for (size_t frame = 0; frame < frames; ++frame)
+    {
+        cpu.run_frame();
+    }
+    auto l1d_misses = l1d.stop();
+    auto ll_misses = ll.stop();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::printf("%-10s %8.1f frames/s", layout, static_cast<double>(frames) / elapsed.count());
+    if (l1d.available() && ll.available())
+    {
+        auto per_frame = [&](uint64_t count) { return static_cast<double>(count) / static_cast<double>(frames); };
+        std::printf("  L1D misses/frame %10.1f  LL misses/frame %8.2f", per_frame(l1d_misses), per_frame(ll_misses));
+    }
+    std::printf("\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s rom.nes [frames]\n", argv[0]);
+        return 1;
+    }
+    EM::Rom rom = EM::Rom::load(argv[1]);
+    size_t frames = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 600;
+
+    auto no_frame_callback = [](EM::NesPPU &, EM::Joypad &) {};
+
+    // Separate heap blocks for the ROM, the bus and the CPU
+    {
+        auto rom_copy = std::make_unique<EM::Rom>(rom);
+        auto bus = std::make_unique<EM::Bus>(rom_copy.get(), no_frame_callback);
+        auto cpu = std::make_unique<EM::CPU>(bus.get());
+        measure("separate", *cpu, frames);
+    }
+
+    {
+        auto console = std::make_unique<EM::Console>(rom, no_frame_callback);
+        measure("console", console->cpu, frames);
+    }
+    return 0;
+}
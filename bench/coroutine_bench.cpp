@@ -0,0 +1,80 @@
+// Frames per second with the PPU caught up by the bus against the CPU and
+// PPU interleaved as C++20 coroutines, and whether both end in the same
+// machine state.
+//
+// usage: coroutine_bench rom.nes [frames]
+//
+// Both run the portable interpreter through run_cycles/run_frame, so only
+// the way the PPU is synchronized differs.
+#include "../cartridge/cartridge.h"
+#include "../console/console.h"
+#include "../coroutine/interleaver.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+namespace
+{
+uint32_t state_hash(const EM::Console &console)
+{
+    uint32_t hash = 0;
+    auto mix = [&](uint8_t byte) { hash = hash * 131 + byte; };
+    for (auto byte : console.bus.ram)
+    {
+        mix(byte);
+    }
+    for (auto byte : console.bus.ppu.vram)
+    {
+        mix(byte);
+    }
+    for (auto byte : console.bus.ppu.oam_data)
+    {
+        mix(byte);
+    }
+    return hash;
+}
+
+template <typename Run> void measure(const char *mode, EM::Console &console, size_t frames, Run run)
+{
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("%-10s %8.1f frames/s  cycles %zu  state %08x\n", mode,
+                static_cast<double>(frames) / elapsed.count(), console.bus.cycles, state_hash(console));
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s rom.nes [frames]\n", argv[0]);
+        return 1;
+    }
+    EM::Rom rom = EM::Rom::load(argv[1]);
+    size_t frames = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 600;
+
+    auto no_frame_callback = [](EM::NesPPU &, EM::Joypad &) {};
+
+    {
+        auto console = std::make_unique<EM::Console>(rom, no_frame_callback);
+        console->cpu.reset();
+        measure("catch-up", *console, frames, [&] {
+            for (size_t frame = 0; frame < frames; ++frame)
+            {
+                console->cpu.run_frame();
+            }
+        });
+    }
+
+    {
+        auto console = std::make_unique<EM::Console>(rom, no_frame_callback);
+        console->cpu.reset();
+        EM::Interleaver interleaver(*console);
+        measure("coroutine", *console, frames, [&] { interleaver.run_frames(frames); });
+    }
+    return 0;
+}
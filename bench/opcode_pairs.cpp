@@ -0,0 +1,82 @@
+// Dynamic opcode-pair histogram over one or more ROMs, used to choose the
+// superinstructions in cpu/superinstructions.h.
+//
+// usage: opcode_pairs frames rom.nes...
+//
+// Each ROM runs for frames * 29781 CPU cycles with START tapped every two
+// seconds, so games get past their title screens. Prints the most frequent
+// pairs that can be fused, i.e. whose first instruction does not end a
+// basic block, summed over all ROMs.
+#include "../bus/bus.h"
+#include "../cartridge/cartridge.h"
+#include "../console/console.h"
+#include "../cpu/block_cache.h"
+#include "../cpu/cpu.h"
+#include "../cpu/hooks.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::fprintf(stderr, "usage: %s frames rom.nes...\n", argv[0]);
+        return 1;
+    }
+    constexpr size_t CYCLES_PER_FRAME = 29781;
+    size_t cycles = std::strtoul(argv[1], nullptr, 10) * CYCLES_PER_FRAME;
+
+    std::vector<uint64_t> totals(0x10000);
+    uint64_t instructions = 0;
+    for (int i = 2; i < argc; ++i)
+    {
+        size_t frame = 0;
+        auto tap_start = [&frame](EM::NesPPU &, EM::Joypad &joypad) {
+            ++frame;
+            joypad.set_button_pressed_status(EM::JoypadButton::START, frame % 120 < 10);
+        };
+        auto console = std::make_unique<EM::Console>(EM::Rom::load(argv[i]), tap_start);
+        EM::CPU &cpu = console->cpu;
+
+        // One instruction per bounded run, so the hook sees every one
+        EM::OpcodePairHook hook;
+        cpu.reset();
+        while (console->bus.cycles < cycles)
+        {
+            hook(cpu);
+            cpu.run_instructions(1);
+        }
+
+        for (size_t pair = 0; pair < totals.size(); ++pair)
+        {
+            totals[pair] += hook.pair_counts[pair];
+            instructions += hook.pair_counts[pair];
+        }
+    }
+
+    std::vector<size_t> order;
+    for (size_t pair = 0; pair < totals.size(); ++pair)
+    {
+        if (totals[pair] > 0 && !EM::BlockCache::ends_block(static_cast<uint8_t>(pair >> 8)))
+        {
+            order.push_back(pair);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return totals[a] > totals[b]; });
+
+    std::printf("%-20s %12s %7s\n", "pair", "count", "share");
+    for (size_t i = 0; i < order.size() && i < 40; ++i)
+    {
+        auto first = EM::OPCODE_TABLE[order[i] >> 8];
+        auto second = EM::OPCODE_TABLE[order[i] & 0xff];
+        std::printf("%02x %-5s %02x %-5s   %12llu %6.2f%%\n", first.code, first.mnemonic, second.code, second.mnemonic,
+                    static_cast<unsigned long long>(totals[order[i]]),
+                    100.0 * static_cast<double>(totals[order[i]]) / static_cast<double>(instructions));
+    }
+    return 0;
+}
@@ -3,34 +3,52 @@
 //
 
 #include "bus.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <memory>
-#include <sstream>
+#include <utility>
 
 namespace EM
 {
-using std::ostringstream;
-
 Bus::~Bus() = default;
 
-// write data to RAM
-void Bus::write(uint16_t addr, uint8_t data)
+// write data to the PPU, APU and joypad registers, and to memory pages
+// trapped for predecoded code or watchpoints
+void Bus::write_io(uint16_t addr, uint8_t data)
 {
-    // ensure the address range not out of bound
-    if (addr >= RAM && addr <= RAM_MIRRORS_END)
+    if (addr >= PPU_REGISTERS && addr <= PPU_REGISTERS_MIRRORS_END)
     {
-        uint16_t mirror_down_addr = addr & 0b00000111'11111111;
-        ram[mirror_down_addr] = data;
+        // $2008-$3FFF mirror the eight PPU registers
+        addr &= 0b00100000'00000111;
+        sync_ppu();
     }
-    else if (addr == 0x2000)
+
+    if (addr <= RAM_MIRRORS_END)
     {
-        ppu->write_to_ctrl(data);
+        uint16_t mirror_down_addr = addr & 0b00000111'11111111;
+        ram[mirror_down_addr] = data;
+        // Predecoded code on the page is stale now
+        ram_code_dirty |= static_cast<uint8_t>(ram_code_pages & (1 << (mirror_down_addr >> 8)));
     }
-    else if (addr == 0x2001)
+    else if (addr == 0x2000 || addr == 0x2001)
     {
-        ppu->write_to_mask(data);
+        // Pattern tables and rendering decide when the PPU raises A12, which
+        // boards like the MMC3 count
+        auto rise_cycle = ppu.a12_rise_cycle();
+        if (addr == 0x2000)
+        {
+            ppu.write_to_ctrl(data);
+        }
+        else
+        {
+            ppu.write_to_mask(data);
+        }
+        if (ppu.a12_rise_cycle() != rise_cycle)
+        {
+            mapper->a12_changed(*this, rise_cycle);
+        }
     }
     else if (addr == 0x2002)
     {
@@ -38,23 +56,31 @@ void Bus::write(uint16_t addr, uint8_t data)
     }
     else if (addr == 0x2003)
     {
-        ppu->write_to_oam_addr(data);
+        ppu.write_to_oam_addr(data);
     }
     else if (addr == 0x2004)
     {
-        ppu->write_to_oam_data(data);
+        if (watchpoints.watches(WatchSpace::Oam))
+        {
+            watchpoints.check(WatchSpace::Oam, WatchWrite, ppu.oam_addr, data, cycles);
+        }
+        ppu.write_to_oam_data(data);
     }
     else if (addr == 0x2005)
     {
-        ppu->write_to_scroll(data);
+        ppu.write_to_scroll(data);
     }
     else if (addr == 0x2006)
     {
-        ppu->write_to_ppu_addr(data);
+        ppu.write_to_ppu_addr(data);
     }
     else if (addr == 0x2007)
     {
-        ppu->write_to_data(data);
+        if (watchpoints.watches(WatchSpace::Vram))
+        {
+            watchpoints.check(WatchSpace::Vram, WatchWrite, ppu.address_register.get(), data, cycles);
+        }
+        ppu.write_to_data(data);
     }
     else if ((addr >= 0x4000 && addr <= 0x4013) || addr == 0x4015)
     {
@@ -71,57 +97,113 @@ void Bus::write(uint16_t addr, uint8_t data)
     }
     else if (addr == 0x4014)
     {
-        std::array<uint8_t, 256> buffer = {0};
-        auto hi = static_cast<uint16_t>(static_cast<uint16_t>(data) << 8);
-        for (uint16_t i = 0; i < 256; ++i)
+        sync_ppu();
+        // OAM DMA copies page `data` straight out of RAM or ROM; only an
+        // I/O page is read byte by byte
+        if (const uint8_t *page = read_pages[data])
         {
-            buffer[i] = read(hi + i);
+            ppu.write_oam_dma(page);
         }
-
-        ppu->write_oam_dma(buffer);
+        else
+        {
+            std::array<uint8_t, 256> buffer{};
+            auto hi = static_cast<uint16_t>(data << 8);
+            for (uint16_t i = 0; i < 256; ++i)
+            {
+                buffer[i] = read_io(static_cast<uint16_t>(hi + i));
+            }
+            ppu.write_oam_dma(buffer.data());
+        }
+        if (watchpoints.watches(WatchSpace::Oam))
+        {
+            for (uint16_t i = 0; i < 256; ++i)
+            {
+                auto oam_addr = static_cast<uint16_t>((ppu.oam_addr + i) & 0xff);
+                watchpoints.check(WatchSpace::Oam, WatchWrite, oam_addr, ppu.oam_data[oam_addr], cycles);
+            }
+        }
+        // The CPU halts once the writing instruction is done
+        scheduler.schedule(Event::OamDma, cycles);
     }
-    else if (addr >= 0x2008 && addr <= PPU_REGISTERS_MIRRORS_END)
+    else if (uint8_t *page = mapped_write_pages[addr >> 8])
     {
-        uint16_t mirror_down_addr = addr & 0b00100000'00000111;
-        write(mirror_down_addr, data);
+        // Watched memory outside RAM
+        page[addr & 0xff] = data;
     }
     else if (addr >= 0x8000 && addr <= 0xFFFF)
     {
-        ostringstream oss;
-        oss << "Attempt to write to cartridge ROM space 0x" << std::hex << addr;
-        // throw std::runtime_error(oss.str());
+        // Bank switches repoint the page tables; nothing is copied
+        mapper->write(*this, addr, data);
     }
     else
     {
         std::cerr << "Ignoring mem write-access at 0x" << std::hex << addr << std::endl;
     }
+
+    if (watchpoints.page_traps(static_cast<uint8_t>(addr >> 8)) & WatchWrite)
+    {
+        watchpoints.check(WatchSpace::Cpu, WatchWrite, addr, data, cycles);
+    }
 }
 
-// read data from RAM
-uint8_t Bus::read(uint16_t addr)
+uint8_t Bus::read_io(uint16_t addr)
 {
-    // ensure the address range not out of bound
-    if (addr >= RAM && addr <= RAM_MIRRORS_END)
+    auto data = read_unwatched(addr);
+    if (watchpoints.page_traps(static_cast<uint8_t>(addr >> 8)) & WatchRead)
     {
-        uint16_t mirror_down_addr = addr & 0b00000111'11111111;
-        return ram[mirror_down_addr];
+        watchpoints.check(WatchSpace::Cpu, WatchRead, addr, data, cycles);
     }
-    else if (addr == 0x2000 || addr == 0x2001 || addr == 0x2003 || addr == 0x2005 || addr == 0x2006 || addr == 0x4014)
+    return data;
+}
+
+uint8_t Bus::fetch_io(uint16_t addr)
+{
+    auto data = read_unwatched(addr);
+    if (watchpoints.page_traps(static_cast<uint8_t>(addr >> 8)) & WatchExecute)
+    {
+        watchpoints.check(WatchSpace::Cpu, WatchExecute, addr, data, cycles);
+    }
+    return data;
+}
+
+// read data from the PPU, APU and joypad registers, and from watched memory
+// pages
+uint8_t Bus::read_unwatched(uint16_t addr)
+{
+    if (addr >= PPU_REGISTERS && addr <= PPU_REGISTERS_MIRRORS_END)
+    {
+        // $2008-$3FFF mirror the eight PPU registers
+        addr &= 0b00100000'00000111;
+        sync_ppu();
+    }
+
+    if (addr == 0x2000 || addr == 0x2001 || addr == 0x2003 || addr == 0x2005 || addr == 0x2006 || addr == 0x4014)
     {
         // throw std::runtime_error("Attempt to read from write-only PPU address 0x" + std::to_string(addr));
         return 0;
     }
     else if (addr == 0x2002)
     {
-        return ppu->read_status();
+        return ppu.read_status();
     }
     else if (addr == 0x2004)
     {
-        return ppu->read_oam_data();
+        auto data = ppu.read_oam_data();
+        if (watchpoints.watches(WatchSpace::Oam))
+        {
+            watchpoints.check(WatchSpace::Oam, WatchRead, ppu.oam_addr, data, cycles);
+        }
+        return data;
     }
     else if (addr == 0x2007)
     {
-        return ppu->read_data();
+        auto vram_addr = ppu.address_register.get();
+        auto data = ppu.read_data();
+        if (watchpoints.watches(WatchSpace::Vram))
+        {
+            watchpoints.check(WatchSpace::Vram, WatchRead, vram_addr, data, cycles);
+        }
+        return data;
     }
     else if (addr >= 0x4000 && addr <= 0x4015)
     {
@@ -137,15 +219,9 @@ uint8_t Bus::read(uint16_t addr)
         // ignore joypad 2
         return 0;
     }
-
-    else if (addr >= 0x2008 && addr <= PPU_REGISTERS_MIRRORS_END)
-    {
-        uint16_t mirror_down_addr = addr & 0b00100000'00000111;
-        return read(mirror_down_addr);
-    }
-    else if (addr >= 0x8000 && addr <= 0xFFFF)
+    else if (const uint8_t *page = readable_page(addr >> 8))
     {
-        return read_prg_rom(addr);
+        return page[addr & 0xff];
     }
     else
     {
@@ -154,33 +230,194 @@ uint8_t Bus::read(uint16_t addr)
     }
 }
 
-// read prg rom
-uint8_t Bus::read_prg_rom(uint16_t addr) const
+void Bus::map_memory(uint8_t first_page, size_t count, const uint8_t *read, uint8_t *write)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        mapped_read_pages[first_page + i] = read + i * 0x100;
+        mapped_write_pages[first_page + i] = write ? write + i * 0x100 : nullptr;
+        update_page(first_page + i);
+    }
+}
+
+void Bus::map_io(uint8_t first_page, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        mapped_read_pages[first_page + i] = nullptr;
+        mapped_write_pages[first_page + i] = nullptr;
+        update_page(first_page + i);
+    }
+}
+
+void Bus::set_ram_code_pages(uint8_t pages)
+{
+    ram_code_pages = pages;
+    for (size_t page = 0x00; page < 0x20; ++page)
+    {
+        update_page(page);
+    }
+}
+
+size_t Bus::add_watchpoint(Watchpoint watchpoint)
 {
-    addr -= 0x8000;
-    if (rom->prg_rom.size() == 0x4000 && addr >= 0x4000)
+    auto id = watchpoints.add(std::move(watchpoint));
+    for (size_t page = 0; page < 0x100; ++page)
     {
-        addr = addr % 0x4000;
+        update_page(page);
     }
-    return rom->prg_rom[addr];
+    return id;
 }
 
-void Bus::tick(uint8_t cycle)
+void Bus::remove_watchpoint(size_t id)
 {
-    cycles += static_cast<size_t>(cycle);
+    watchpoints.remove(id);
+    for (size_t page = 0; page < 0x100; ++page)
+    {
+        update_page(page);
+    }
+}
 
-    auto nmi_before = ppu->nmi_interrupt.has_value();
-    ppu->tick(cycle * 3);
-    auto nmi_after = ppu->nmi_interrupt.has_value();
+void Bus::add_read_patch(const BytePatch &patch)
+{
+    read_overlays.add(patch);
+    update_page(patch.addr >> 8);
+}
 
-    if (!nmi_before && nmi_after)
+void Bus::add_frame_patch(const BytePatch &patch)
+{
+    frame_patches.push_back(patch);
+}
+
+void Bus::clear_patches()
+{
+    read_overlays.clear();
+    frame_patches.clear();
+    for (size_t page = 0; page < 0x100; ++page)
     {
-        gameloop_callback(*ppu, joypad1);
+        update_page(page);
     }
 }
 
-std::optional<uint8_t> Bus::poll_nmi_status() const
+const uint8_t *Bus::readable_page(size_t page)
 {
-    return ppu->nmi_interrupt;
+    if (mapped_write_pages[page])
+    {
+        return mapped_read_pages[page];
+    }
+    return read_overlays.apply(page, mapped_read_pages[page]);
+}
+
+void Bus::update_page(size_t page)
+{
+    auto traps = watchpoints.page_traps(static_cast<uint8_t>(page));
+    bool code = page < 0x20 && (ram_code_pages & (1 << (page & 0x07)));
+    auto readable = readable_page(page);
+    const uint8_t *read = traps & WatchRead ? nullptr : readable;
+    if (read_pages[page] != read)
+    {
+        read_pages[page] = read;
+        ++map_generation;
+    }
+    const uint8_t *fetch = traps & WatchExecute ? nullptr : readable;
+    if (fetch_pages[page] != fetch)
+    {
+        fetch_pages[page] = fetch;
+        ++map_generation;
+    }
+    write_pages[page] = (traps & WatchWrite) || code ? nullptr : mapped_write_pages[page];
+}
+
+void Bus::sync_ppu()
+{
+    if (ppu_runner)
+    {
+        ppu_runner(cycles);
+        return;
+    }
+
+    ppu.cycles += (cycles - ppu.timestamp) * 3;
+    ppu.timestamp = cycles;
+
+    // Scanline ends one at a time, as tick() used to take them. Syncing at
+    // the NMI event makes vblank start the last one taken here.
+    while (ppu.cycles >= 341)
+    {
+        auto nmi_before = ppu.nmi_interrupt.has_value();
+        ppu.end_scanline();
+        if (!nmi_before && ppu.nmi_interrupt.has_value())
+        {
+            end_frame();
+        }
+    }
+    scheduler.schedule(Event::PpuNmi, cycles + (ppu.cycles_to_nmi_event() + 2) / 3);
+}
+
+void Bus::end_frame()
+{
+    ++frames;
+    for (const auto &patch : frame_patches)
+    {
+        uint8_t *page = mapped_write_pages[patch.addr >> 8];
+        if (page && patch.applies_to(page[patch.addr & 0xff]))
+        {
+            page[patch.addr & 0xff] = patch.value;
+            if (patch.addr <= RAM_MIRRORS_END)
+            {
+                ram_code_dirty |= static_cast<uint8_t>(ram_code_pages & (1 << ((patch.addr >> 8) & 0x07)));
+            }
+        }
+    }
+    if (gameloop_callback)
+    {
+        gameloop_callback(ppu, joypad1);
+    }
+}
+
+void Bus::run_events()
+{
+    while (auto event = scheduler.take_due(cycles))
+    {
+        switch (*event)
+        {
+        case Event::PpuNmi:
+            sync_ppu();
+            break;
+        case Event::MapperIrq:
+            sync_ppu();
+            mapper->run_irq_event(*this);
+            break;
+        case Event::OamDma:
+            // 513 cycles, one more to get back in step when the DMA starts on an odd cycle
+            tick_many(513 + (cycles & 1));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+size_t Bus::ppu_cycles_to_next_event() const
+{
+    auto horizon = ppu.cycles_to_next_event();
+    auto irq = scheduler.at(Event::MapperIrq);
+    if (irq != Scheduler::NEVER)
+    {
+        horizon = std::min(horizon, (std::max(irq, cycles + 1) - cycles) * 3);
+    }
+    return horizon;
+}
+
+void Bus::tick_many(size_t cycles)
+{
+    // The frame callback runs at the end of the step that reaches vblank, so
+    // steps stay as short as when the PPU took one scanline end per tick
+    constexpr size_t MAX_TICK = 85;
+    while (cycles > 0)
+    {
+        auto step = std::min(cycles, MAX_TICK);
+        tick(static_cast<uint8_t>(step));
+        cycles -= step;
+    }
 }
 } // namespace EM
@@ -11,11 +11,16 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include "../cartridge/cartridge.h"
 
 #include "../joypad/joypad.h"
+#include "../mapper/mapper.h"
 #include "../ppu/ppu.h"
+#include "overlays.h"
+#include "scheduler.h"
+#include "watchpoints.h"
 
 namespace EM
 {
@@ -24,6 +29,13 @@ const uint16_t RAM_MIRRORS_END = 0x1FFF;
 const uint16_t PPU_REGISTERS = 0x2000;
 const uint16_t PPU_REGISTERS_MIRRORS_END = 0x3FFF;
 
+// Devices wired to the CPU's IRQ line, one bit each. The line is level
+// triggered: it stays asserted while any device holds it.
+enum IrqSource : uint8_t
+{
+    IrqMapper = 1 << 0,
+};
+
 class Bus
 {
   public:
@@ -31,34 +43,208 @@ class Bus
     // Bus(Rom *rom);
     ~Bus();
 
-    Joypad joypad1;
-
+    // Members touched on every instruction come first, so they share the
+    // first cache lines with the PPU's timing state
     size_t cycles;
+    // Timestamped PPU and DMA events. The PPU only runs at its scheduled NMI
+    // event or when something looks at it.
+    Scheduler scheduler;
+    // One bit per 256-byte RAM page: pages holding predecoded code, and
+    // those of them written since the block cache last looked
+    uint8_t ram_code_pages = 0;
+    uint8_t ram_code_dirty = 0;
+    // IrqSource bits of the devices asserting IRQ
+    uint8_t irq_lines = 0;
+    // Bumped whenever a read_pages or fetch_pages entry changes, as on a bank
+    // switch
+    uint32_t map_generation = 0;
+
+    // The CPU address space by 256-byte page, for reads; write_pages and
+    // fetch_pages below are its store and opcode-fetch counterparts. An entry
+    // points at the host memory behind the page; a null entry sends the
+    // access to read_io, write_io or fetch_io. Mappers switch banks through
+    // map_memory(), which leaves pages trapped for code or watchpoints null.
+    std::array<const uint8_t *, 256> read_pages{};
+
+    NesPPU ppu;
     std::array<uint8_t, 2048> ram{};
-    Rom *rom = nullptr;
+    Joypad joypad1;
 
-    std::unique_ptr<NesPPU> ppu;
+    // Behind the PPU and RAM: each instruction touches at most a line or two
+    // of these, and the threaded core never reads fetch_pages
+    std::array<uint8_t *, 256> write_pages{};
+    // Opcode fetches by the interpreter: read_pages, less the pages with an
+    // execute watchpoint
+    std::array<const uint8_t *, 256> fetch_pages{};
 
+    // Vblank NMIs raised so far, one per rendered frame
+    size_t frames = 0;
+    Rom *rom = nullptr;
+    // The cartridge board, called on writes to $8000-$FFFF
+    std::unique_ptr<Mapper> mapper;
     std::function<void(NesPPU &, Joypad &)> gameloop_callback;
+    // When set, sync_ppu() hands the PPU to it, to be run up to the given
+    // cycle, and schedules no PPU event itself (see coroutine/interleaver.h)
+    std::function<void(size_t)> ppu_runner;
+    // Debugger watchpoints and their hit handler
+    Watchpoints watchpoints;
     template <typename F> Bus(Rom *rom, F gameloop_callback);
 
-    // Read & write from & to the bus
-    void write(uint16_t addr, uint8_t data);
-    uint8_t read(uint16_t addr);
-    uint8_t read_prg_rom(uint16_t addr) const;
+    // Read & write from & to the bus: one page table load, then either the
+    // memory access or a call to read_io/write_io. Both compile into the
+    // CPU's instruction handlers.
+    uint8_t read(uint16_t addr)
+    {
+        if (const uint8_t *page = read_pages[addr >> 8])
+        {
+            return page[addr & 0xff];
+        }
+        return read_io(addr);
+    }
+
+    void write(uint16_t addr, uint8_t data)
+    {
+        if (uint8_t *page = write_pages[addr >> 8])
+        {
+            page[addr & 0xff] = data;
+            return;
+        }
+        write_io(addr, data);
+    }
 
-    void tick(uint8_t cycle);
-    std::optional<uint8_t> poll_nmi_status() const;
+    uint8_t fetch(uint16_t addr)
+    {
+        if (const uint8_t *page = fetch_pages[addr >> 8])
+        {
+            return page[addr & 0xff];
+        }
+        return fetch_io(addr);
+    }
+
+    uint8_t read_prg_rom(uint16_t addr) const
+    {
+        return mapped_read_pages[addr >> 8][addr & 0xff];
+    }
+
+    // The byte read() returns from RAM or cartridge memory, without side
+    // effects or watchpoints; 0 for I/O. For looking at code without running it.
+    uint8_t peek(uint16_t addr)
+    {
+        const uint8_t *page = readable_page(addr >> 8);
+        return page ? page[addr & 0xff] : 0;
+    }
+
+    // Points count pages from first_page at consecutive 256-byte pages of
+    // memory. Without write memory, as for ROM, writes go to write_io.
+    void map_memory(uint8_t first_page, size_t count, const uint8_t *read, uint8_t *write);
+    // Sends count pages from first_page to read_io and write_io
+    void map_io(uint8_t first_page, size_t count);
+    // Sets ram_code_pages. Writes to those pages, in every RAM mirror, go
+    // through write_io, which marks them in ram_code_dirty.
+    void set_ram_code_pages(uint8_t pages);
+
+    // Arms a watchpoint and traps the CPU pages it covers; returns its id
+    size_t add_watchpoint(Watchpoint watchpoint);
+    void remove_watchpoint(size_t id);
+
+    // Byte patches for cheats (cheats/cheats.h). A read patch is read through
+    // a patched copy of its page, so it only applies to read-only memory; a
+    // frame patch is written at every frame boundary.
+    void add_read_patch(const BytePatch &patch);
+    void add_frame_patch(const BytePatch &patch);
+    void clear_patches();
+    bool has_read_patches() const
+    {
+        return !read_overlays.empty();
+    }
+    // Whether addr is mapped to writable memory
+    bool is_writable(uint16_t addr) const
+    {
+        return mapped_write_pages[addr >> 8] != nullptr;
+    }
+
+    // PPU, APU and joypad registers, the unmapped $4018-$5FFF, RAM pages
+    // holding code, and watched pages
+    uint8_t read_io(uint16_t addr);
+    void write_io(uint16_t addr, uint8_t data);
+    uint8_t fetch_io(uint16_t addr);
+
+    // Counts CPU cycles and runs whatever the scheduler has due
+    void tick(uint8_t cycle)
+    {
+        cycles += cycle;
+        if (cycles >= scheduler.next)
+        {
+            run_events();
+        }
+    }
+    // Runs every event due by cycles. Cores that count cycles inline call
+    // tick() once they reach scheduler.next.
+    void run_events();
+    // Runs the PPU up to cycles, calling the frame callback when it raises
+    // NMI, and schedules its next NMI event. Anything reading PPU state other
+    // than through the PPU registers calls it first.
+    void sync_ppu();
+    // Ticks cycles CPU cycles in as few tick() calls as the PPU allows
+    void tick_many(size_t cycles);
+    // Called when the PPU raises its vblank NMI: counts the frame, writes
+    // the frame patches, then calls the frame callback
+    void end_frame();
+    // Up to date at every instruction boundary: the PPU only raises or
+    // clears NMI at its scheduled event or on a PPUCTRL write
+    bool nmi_pending() const
+    {
+        return ppu.nmi_interrupt.has_value();
+    }
+    // NMI is edge triggered: the CPU takes it once, then it waits for the
+    // PPU to raise it again
+    void acknowledge_nmi()
+    {
+        ppu.nmi_interrupt.reset();
+    }
+    bool irq_pending() const
+    {
+        return irq_lines != 0;
+    }
+    void set_irq(IrqSource source, bool asserted)
+    {
+        irq_lines = static_cast<uint8_t>(asserted ? irq_lines | source : irq_lines & ~source);
+    }
+    // PPU cycles, with the PPU synced, before a spinning CPU could see
+    // anything change: PPUSTATUS, NMI or the board's next IRQ
+    size_t ppu_cycles_to_next_event() const;
+
+  private:
+    // Every page as map_memory() and map_io() left it, trapped or not
+    std::array<const uint8_t *, 256> mapped_read_pages{};
+    std::array<uint8_t *, 256> mapped_write_pages{};
+    ReadOverlays read_overlays;
+    std::vector<BytePatch> frame_patches;
+
+    // Rebuilds a page's fast table entries from its mapping and traps
+    void update_page(size_t page);
+    // The memory reads of a page see: the mapped memory, or its patched copy
+    const uint8_t *readable_page(size_t page);
+    // read_io without reporting a watchpoint
+    uint8_t read_unwatched(uint16_t addr);
 };
 // Template constructor implementation
-template <typename F> Bus::Bus(Rom *rom, F gameloop_callback) : gameloop_callback(gameloop_callback)
+template <typename F>
+Bus::Bus(Rom *rom, F gameloop_callback)
+    : ppu(rom->screen_mirroring), rom(rom), mapper(make_mapper(*rom)), gameloop_callback(gameloop_callback)
 {
-    this->rom = rom;
     cycles = 0;
+    scheduler.schedule(Event::PpuNmi, (ppu.cycles_to_nmi_event() + 2) / 3);
     // Initialize RAM to zero
     std::fill(ram.begin(), ram.end(), 0x00);
-    // Initialize PPU with ROM data
-    ppu = std::make_unique<NesPPU>(rom->chr_rom, rom->screen_mirroring);
+
+    // 2 KiB of RAM mirrored up to $1FFF
+    for (uint8_t mirror = 0x00; mirror < 0x20; mirror += 0x08)
+    {
+        map_memory(mirror, 0x08, ram.data(), ram.data());
+    }
+    // PRG-RAM, PRG-ROM and CHR as the board powers on
+    mapper->reset(*this);
 }
 } // namespace EM
 #endif // MYNESEMULATOR__BUS_H_
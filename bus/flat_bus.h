@@ -0,0 +1,59 @@
+#ifndef MYNESEMULATOR__FLAT_BUS_H_
+#define MYNESEMULATOR__FLAT_BUS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace EM
+{
+// 64 KiB of RAM and nothing else, for CPU unit tests and microbenchmarks
+// that need no PPU. Ticks only count cycles, and NMI and IRQ are never raised.
+class FlatBus
+{
+  public:
+    size_t cycles = 0;
+    size_t frames = 0;
+    std::array<uint8_t, 0x10000> ram{};
+
+    uint8_t read(uint16_t addr)
+    {
+        return ram[addr];
+    }
+
+    void write(uint16_t addr, uint8_t data)
+    {
+        ram[addr] = data;
+    }
+
+    uint8_t fetch(uint16_t addr)
+    {
+        return ram[addr];
+    }
+
+    uint8_t peek(uint16_t addr) const
+    {
+        return ram[addr];
+    }
+
+    void tick(uint8_t cycle)
+    {
+        cycles += cycle;
+    }
+
+    bool nmi_pending() const
+    {
+        return false;
+    }
+
+    void acknowledge_nmi()
+    {
+    }
+
+    bool irq_pending() const
+    {
+        return false;
+    }
+};
+} // namespace EM
+#endif // MYNESEMULATOR__FLAT_BUS_H_
@@ -0,0 +1,86 @@
+#ifndef MYNESEMULATOR__OVERLAYS_H_
+#define MYNESEMULATOR__OVERLAYS_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace EM
+{
+// One byte replaced: at addr, value, but only where the byte was compare
+struct BytePatch
+{
+    uint16_t addr = 0;
+    uint8_t value = 0;
+    std::optional<uint8_t> compare;
+
+    bool applies_to(uint8_t original) const
+    {
+        return !compare || *compare == original;
+    }
+};
+
+// Patched copies of read-only CPU pages, read in place of the memory mapped
+// there. A copy is made once per page and remade only when different memory
+// is mapped under it, so a patched page costs nothing per access.
+class ReadOverlays
+{
+  public:
+    bool empty() const
+    {
+        return patches.empty();
+    }
+
+    void add(const BytePatch &patch)
+    {
+        patches.push_back(patch);
+        sources[patch.addr >> 8] = nullptr;
+        if (!copies[patch.addr >> 8])
+        {
+            copies[patch.addr >> 8] = std::make_unique<std::array<uint8_t, 0x100>>();
+        }
+    }
+
+    void clear()
+    {
+        patches.clear();
+        sources.fill(nullptr);
+        std::fill(copies.begin(), copies.end(), nullptr);
+    }
+
+    // What to read page through with memory mapped there: memory itself
+    // when no patch touches the page, else its patched copy
+    const uint8_t *apply(size_t page, const uint8_t *memory)
+    {
+        if (!memory || !copies[page])
+        {
+            return memory;
+        }
+        if (sources[page] != memory)
+        {
+            auto &copy = *copies[page];
+            std::copy(memory, memory + copy.size(), copy.begin());
+            for (const auto &patch : patches)
+            {
+                if ((patch.addr >> 8) == page && patch.applies_to(memory[patch.addr & 0xff]))
+                {
+                    copy[patch.addr & 0xff] = patch.value;
+                }
+            }
+            sources[page] = memory;
+        }
+        return copies[page]->data();
+    }
+
+  private:
+    std::vector<BytePatch> patches;
+    // The memory each copy was made from
+    std::array<const uint8_t *, 256> sources{};
+    std::array<std::unique_ptr<std::array<uint8_t, 0x100>>, 256> copies;
+};
+} // namespace EM
+#endif
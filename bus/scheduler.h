@@ -0,0 +1,106 @@
+#ifndef MYNESEMULATOR__SCHEDULER_H_
+#define MYNESEMULATOR__SCHEDULER_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+
+namespace EM
+{
+// Work the bus owes at a CPU cycle. Events due by the same tick run in this
+// order.
+enum class Event : uint8_t
+{
+    // The PPU's next scanline end that raises or clears NMI
+    PpuNmi,
+    // The cartridge board's next IRQ, as the board predicted it
+    MapperIrq,
+    // The CPU halt of an OAM DMA, due once the $4014 write's instruction is done
+    OamDma,
+    Count,
+};
+
+// At most one pending cycle per event kind, kept in a small array with the
+// earliest of them cached in `next`, so the bus checks for work with a
+// single comparison per tick.
+class Scheduler
+{
+  public:
+    static constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+
+    // The earliest cycle any event is due at, or NEVER
+    size_t next = NEVER;
+
+    // Moves the event if it is pending already
+    void schedule(Event event, size_t cycle)
+    {
+        auto before = std::exchange(cycles[index(event)], cycle);
+        if (cycle > before && before == next)
+        {
+            update_next();
+        }
+        else
+        {
+            next = std::min(next, cycle);
+        }
+    }
+
+    void cancel(Event event)
+    {
+        cycles[index(event)] = NEVER;
+        update_next();
+    }
+
+    size_t at(Event event) const
+    {
+        return cycles[index(event)];
+    }
+
+    // Unschedules and returns the first event, in Event order, due by `now`
+    std::optional<Event> take_due(size_t now)
+    {
+        for (size_t i = 0; i < cycles.size(); ++i)
+        {
+            if (cycles[i] <= now)
+            {
+                cycles[i] = NEVER;
+                update_next();
+                return static_cast<Event>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+  private:
+    std::array<size_t, static_cast<size_t>(Event::Count)> cycles = filled();
+
+    static constexpr size_t index(Event event)
+    {
+        return static_cast<size_t>(event);
+    }
+
+    static constexpr std::array<size_t, static_cast<size_t>(Event::Count)> filled()
+    {
+        std::array<size_t, static_cast<size_t>(Event::Count)> all{};
+        for (auto &cycle : all)
+        {
+            cycle = NEVER;
+        }
+        return all;
+    }
+
+    void update_next()
+    {
+        next = NEVER;
+        for (auto cycle : cycles)
+        {
+            next = std::min(next, cycle);
+        }
+    }
+};
+} // namespace EM
+#endif
@@ -0,0 +1,183 @@
+#ifndef MYNESEMULATOR__WATCHPOINTS_H_
+#define MYNESEMULATOR__WATCHPOINTS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace EM
+{
+// Address spaces a watchpoint can cover. VRAM and OAM are watched as the CPU
+// reaches them, through PPUDATA, OAMDATA and OAM DMA; rendering is not.
+enum class WatchSpace : uint8_t
+{
+    Cpu,  // $0000-$FFFF, RAM and PPU registers by their first mirror
+    Vram, // $0000-$3FFF as set through PPUADDR
+    Oam,  // $00-$FF
+};
+
+// Accesses a watchpoint reports, combined as a bit set
+enum WatchAccess : uint8_t
+{
+    WatchRead = (1 << 0),
+    WatchWrite = (1 << 1),
+    WatchExecute = (1 << 2), // opcode fetches, CPU space only
+};
+
+struct WatchHit
+{
+    size_t id = 0; // as returned by Bus::add_watchpoint()
+    WatchSpace space = WatchSpace::Cpu;
+    WatchAccess access = WatchRead;
+    uint16_t addr = 0;
+    // The byte read, written or fetched. A PPUDATA read reports the buffered
+    // byte the CPU got back.
+    uint8_t value = 0;
+    // registers.pc at the access: the opcode's address for its fetch, one
+    // past it for the instruction's operand and data accesses
+    uint16_t pc = 0;
+    size_t cycle = 0;
+};
+
+struct Watchpoint
+{
+    WatchSpace space = WatchSpace::Cpu;
+    uint8_t access = WatchRead | WatchWrite;
+    // Inclusive range; mirrored addresses match by their first mirror
+    uint16_t first = 0;
+    uint16_t last = 0;
+    // Hits are reported only when it returns true; always when empty
+    std::function<bool(const WatchHit &)> condition;
+};
+
+// The watchpoints armed on a bus. Bus keeps every CPU page one of them
+// covers out of its fast page tables, so only accesses to those pages reach
+// check(); with none armed the bus runs exactly as without them. They are
+// taken by the interpreter cores (run_with_callback, run_cycles and friends)
+// and the threaded core, which leaves instructions on pages with read or
+// execute watchpoints to the interpreter; the JIT and AOT cores reach RAM and
+// ROM directly.
+class Watchpoints
+{
+  public:
+    // Called for every hit that passes its watchpoint's condition
+    std::function<void(const WatchHit &)> on_hit;
+    // Where hits read the PC from; Console points it at its CPU's registers
+    const uint16_t *pc = nullptr;
+
+    // Use Bus::add_watchpoint() and Bus::remove_watchpoint(), which also
+    // retrap the bus pages
+    size_t add(Watchpoint watchpoint)
+    {
+        watchpoint.first = canonical(watchpoint.space, watchpoint.first);
+        watchpoint.last = canonical(watchpoint.space, watchpoint.last);
+        watchpoints.emplace_back(std::move(watchpoint));
+        update_traps();
+        return watchpoints.size() - 1;
+    }
+
+    void remove(size_t id)
+    {
+        watchpoints.at(id).reset();
+        update_traps();
+    }
+
+    // WatchAccess bits armed on a CPU page
+    uint8_t page_traps(uint8_t page) const
+    {
+        return cpu_pages[page];
+    }
+
+    // Whether any watchpoint covers the space, for the PPU register paths
+    bool watches(WatchSpace space) const
+    {
+        return spaces & (1 << static_cast<uint8_t>(space));
+    }
+
+    void check(WatchSpace space, WatchAccess access, uint16_t addr, uint8_t value, size_t cycle) const
+    {
+        addr = canonical(space, addr);
+        for (size_t id = 0; id < watchpoints.size(); ++id)
+        {
+            const auto &watchpoint = watchpoints[id];
+            if (!watchpoint || watchpoint->space != space || !(watchpoint->access & access) ||
+                addr < watchpoint->first || addr > watchpoint->last)
+            {
+                continue;
+            }
+            WatchHit hit{id, space, access, addr, value, pc ? *pc : uint16_t{0}, cycle};
+            if ((!watchpoint->condition || watchpoint->condition(hit)) && on_hit)
+            {
+                on_hit(hit);
+            }
+        }
+    }
+
+  private:
+    std::vector<std::optional<Watchpoint>> watchpoints;
+    std::array<uint8_t, 256> cpu_pages{};
+    uint8_t spaces = 0;
+
+    static uint16_t canonical(WatchSpace space, uint16_t addr)
+    {
+        switch (space)
+        {
+        case WatchSpace::Cpu:
+            if (addr <= 0x1fff)
+            {
+                return static_cast<uint16_t>(addr & 0x07ff);
+            }
+            return addr <= 0x3fff ? static_cast<uint16_t>(addr & 0x2007) : addr;
+        case WatchSpace::Vram:
+            return static_cast<uint16_t>(addr & 0x3fff);
+        default:
+            return static_cast<uint16_t>(addr & 0x00ff);
+        }
+    }
+
+    void update_traps()
+    {
+        cpu_pages.fill(0);
+        spaces = 0;
+        for (const auto &watchpoint : watchpoints)
+        {
+            if (!watchpoint)
+            {
+                continue;
+            }
+            spaces |= static_cast<uint8_t>(1 << static_cast<uint8_t>(watchpoint->space));
+            if (watchpoint->space != WatchSpace::Cpu)
+            {
+                continue;
+            }
+            for (size_t page = watchpoint->first >> 8; page <= (watchpoint->last >> 8); ++page)
+            {
+                // RAM in all four mirrors, the PPU registers in all of theirs
+                if (page < 0x08)
+                {
+                    for (size_t mirror = page; mirror < 0x20; mirror += 0x08)
+                    {
+                        cpu_pages[mirror] |= watchpoint->access;
+                    }
+                }
+                else if (page == 0x20)
+                {
+                    for (size_t mirror = 0x20; mirror < 0x40; ++mirror)
+                    {
+                        cpu_pages[mirror] |= watchpoint->access;
+                    }
+                }
+                else
+                {
+                    cpu_pages[page] |= watchpoint->access;
+                }
+            }
+        }
+    }
+};
+} // namespace EM
+#endif
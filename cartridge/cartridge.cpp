@@ -1,29 +1,190 @@
 #include "cartridge.h"
+#include "rom_db.h"
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <mutex>
 #include <ostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
 namespace EM
 {
+namespace
+{
+uint32_t update_crc32(uint32_t crc, RomSpan bytes)
+{
+    for (auto byte : bytes)
+    {
+        crc ^= byte;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+        }
+    }
+    return crc;
+}
+
+// NES 2.0 ROM sizes: a 12-bit count of units, or with the top nibble at
+// 0xF, 2^E * (2M + 1) bytes where lsb is EEEEEEMM
+size_t nes2_rom_size(uint8_t lsb, int msb, size_t unit)
+{
+    if (msb != 0x0f)
+    {
+        return (static_cast<size_t>(msb) << 8 | lsb) * unit;
+    }
+    int exponent = lsb >> 2;
+    if (exponent > 30)
+    {
+        throw std::invalid_argument("ROM size in NES 2.0 header is out of range");
+    }
+    return (size_t{1} << exponent) * static_cast<size_t>((lsb & 0b11) * 2 + 1);
+}
+
+// NES 2.0 RAM sizes are 64 << shift bytes, or none for a shift of 0
+size_t nes2_ram_size(int shift)
+{
+    return shift == 0 ? 0 : size_t{64} << shift;
+}
+
+uint64_t fnv1a64(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001b3u;
+    }
+    return hash;
+}
+} // namespace
+
+std::shared_ptr<const RomImage> RomImage::map_file(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+
+    std::shared_ptr<RomImage> image(new RomImage);
+    auto size = static_cast<size_t>(st.st_size);
+    void *data = size == 0 ? nullptr : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map " + path);
+    }
+    image->mapped = data != nullptr;
+    image->set_bytes(static_cast<const uint8_t *>(data), size);
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::copy_of(const std::vector<uint8_t> &bytes)
+{
+    std::shared_ptr<RomImage> image(new RomImage);
+    image->copy = bytes;
+    image->set_bytes(image->copy.data(), image->copy.size());
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::share(std::shared_ptr<const RomImage> image)
+{
+    static std::mutex mutex;
+    static std::unordered_multimap<uint64_t, std::weak_ptr<const RomImage>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = cache.begin(); it != cache.end();)
+    {
+        it = it->second.expired() ? cache.erase(it) : std::next(it);
+    }
+
+    auto range = cache.equal_range(image->hash());
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        // Another thread can drop the last owner since the sweep above
+        if (auto cached = it->second.lock();
+            cached && cached->count == image->count && std::memcmp(cached->first, image->first, image->count) == 0)
+        {
+            return cached;
+        }
+    }
+    cache.emplace(image->hash(), image);
+    return image;
+}
+
+RomImage::~RomImage()
+{
+    if (mapped)
+    {
+        munmap(const_cast<uint8_t *>(first), count);
+    }
+}
+
+void RomImage::set_bytes(const uint8_t *data, size_t size)
+{
+    first = data;
+    count = size;
+    content_hash = fnv1a64(data, size);
+}
+
 Rom::Rom()
 {
-    prg_rom.clear();
-    chr_rom.clear();
     mapper = 0;
     screen_mirroring = Mirroring::HORIZONTAL;
 }
 
-Rom::Rom(const std::vector<uint8_t> &raw)
+Rom::Rom(const std::vector<uint8_t> &raw) : Rom(RomImage::share(RomImage::copy_of(raw)))
+{
+}
+
+Rom Rom::load(const std::string &path)
+{
+    return Rom(RomImage::share(RomImage::map_file(path)));
+}
+
+Rom::Rom(std::shared_ptr<const RomImage> rom_image) : image(std::move(rom_image))
 {
-    if (raw.size() < 16 || std::memcmp(&raw[0], "NES\x1A", 4) != 0)
+    auto raw = image->bytes();
+    if (raw.size() < 16 || std::memcmp(raw.data(), "NES\x1A", 4) != 0)
     {
-        throw std::invalid_argument("File is not in iNES file format");
+        throw std::invalid_argument("File is not in iNES or NES 2.0 format");
     }
 
-    mapper = (raw[7] & 0b1111'0000) | (raw[6] >> 4);
+    // Byte 7 bits 2-3 are 2 in NES 2.0 headers. In iNES ones, bytes 12-15
+    // holding anything but 0 means an old tool wrote text ("DiskDude!") over
+    // bytes 7-15, and only byte 6 can be trusted.
+    bool nes2 = (raw[7] & 0b1100) == 0b1000;
+    bool dirty = !nes2 && (raw[12] | raw[13] | raw[14] | raw[15]) != 0;
+    mapper = static_cast<uint16_t>(raw[6] >> 4);
+    if (!dirty)
+    {
+        mapper = static_cast<uint16_t>(mapper | (raw[7] & 0b1111'0000));
+    }
+    battery = raw[6] & 0b10;
 
-    uint8_t ines_ver = (raw[7] >> 2) & 0b11;
-    if (ines_ver != 0)
+    size_t prg_rom_size = raw[4] * PRG_ROM_PAGE_SIZE;
+    size_t chr_rom_size = raw[5] * CHR_ROM_PAGE_SIZE;
+    if (nes2)
     {
-        throw std::invalid_argument("NES2.0 format is not supported");
+        mapper = static_cast<uint16_t>(mapper | (raw[8] & 0x0f) << 8);
+        submapper = static_cast<uint8_t>(raw[8] >> 4);
+        prg_rom_size = nes2_rom_size(raw[4], raw[9] & 0x0f, PRG_ROM_PAGE_SIZE);
+        chr_rom_size = nes2_rom_size(raw[5], raw[9] >> 4, CHR_ROM_PAGE_SIZE);
+        prg_ram_size = nes2_ram_size(raw[10] & 0x0f) + nes2_ram_size(raw[10] >> 4);
+        chr_ram_size = nes2_ram_size(raw[11] & 0x0f) + nes2_ram_size(raw[11] >> 4);
+        region = static_cast<Region>(raw[12] & 0b11);
+    }
+    else if (chr_rom_size == 0)
+    {
+        chr_ram_size = 0x2000;
     }
 
     bool four_screen = raw[6] & 0b1000;
@@ -41,9 +202,6 @@ Rom::Rom(const std::vector<uint8_t> &raw)
         screen_mirroring = Mirroring::HORIZONTAL;
     }
 
-    size_t prg_rom_size = raw[4] * PRG_ROM_PAGE_SIZE;
-    size_t chr_rom_size = raw[5] * CHR_ROM_PAGE_SIZE;
-
     bool skip_trainer = raw[6] & 0b100;
 
     size_t prg_rom_start = 16 + (skip_trainer ? 512 : 0);
@@ -54,12 +212,18 @@ Rom::Rom(const std::vector<uint8_t> &raw)
         throw std::invalid_argument("File is too small for specified PRG and CHR ROM sizes");
     }
 
-    prg_rom.assign(raw.begin() + static_cast<std::vector<char>::difference_type>(prg_rom_start),
-                   raw.begin() + static_cast<std::vector<char>::difference_type>(prg_rom_start) +
-                       static_cast<std::vector<char>::difference_type>(prg_rom_size));
-    chr_rom.assign(raw.begin() + static_cast<std::vector<char>::difference_type>(chr_rom_start),
-                   raw.begin() + static_cast<std::vector<char>::difference_type>(chr_rom_start) +
-                       static_cast<std::vector<char>::difference_type>(chr_rom_size));
+    prg_rom = RomSpan(raw.data() + prg_rom_start, prg_rom_size);
+    chr_rom = RomSpan(raw.data() + chr_rom_start, chr_rom_size);
+    crc32 = ~update_crc32(update_crc32(0xffffffffu, prg_rom), chr_rom);
+
+    info = find_rom_info(crc32);
+    if (info != nullptr)
+    {
+        mapper = info->mapper;
+        submapper = info->submapper;
+        screen_mirroring = info->mirroring;
+        region = info->region;
+    }
     std::cout << "PRG size: " << prg_rom_size << std::endl;
 }
 
@@ -3,28 +3,151 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 namespace EM
 {
+// Read-only bytes owned by a RomImage; C++17 has no std::span
+class RomSpan
+{
+  public:
+    RomSpan() = default;
+    RomSpan(const uint8_t *data, size_t size) : first(data), count(size)
+    {
+    }
+
+    const uint8_t *data() const
+    {
+        return first;
+    }
+    size_t size() const
+    {
+        return count;
+    }
+    bool empty() const
+    {
+        return count == 0;
+    }
+    const uint8_t *begin() const
+    {
+        return first;
+    }
+    const uint8_t *end() const
+    {
+        return first + count;
+    }
+    uint8_t operator[](size_t i) const
+    {
+        return first[i];
+    }
+
+  private:
+    const uint8_t *first = nullptr;
+    size_t count = 0;
+};
+
+// The bytes of a .nes file. Loaded from disk it is a read-only mapping of
+// the file, whose pages the kernel shares between every process mapping
+// it; Roms point into it rather than copy it. The file must not be
+// truncated while mapped.
+class RomImage
+{
+  public:
+    // Maps the file at path. Throws std::runtime_error if it cannot be
+    // opened or mapped.
+    static std::shared_ptr<const RomImage> map_file(const std::string &path);
+    // Copies a file read some other way
+    static std::shared_ptr<const RomImage> copy_of(const std::vector<uint8_t> &bytes);
+    // The process-wide ROM cache: the image already in use with the same
+    // content as image, or image itself, which is cached from then on. So
+    // every console running a game, however it was loaded, reads one copy.
+    // Images leave the cache with their last user.
+    static std::shared_ptr<const RomImage> share(std::shared_ptr<const RomImage> image);
+
+    ~RomImage();
+    RomImage(const RomImage &) = delete;
+    RomImage &operator=(const RomImage &) = delete;
+
+    RomSpan bytes() const
+    {
+        return {first, count};
+    }
+    // 64-bit FNV-1a of the bytes, the cache key
+    uint64_t hash() const
+    {
+        return content_hash;
+    }
+
+  private:
+    RomImage() = default;
+
+    const uint8_t *first = nullptr;
+    size_t count = 0;
+    bool mapped = false;
+    std::vector<uint8_t> copy;
+    uint64_t content_hash = 0;
+
+    void set_bytes(const uint8_t *data, size_t size);
+};
 
 enum class Mirroring
 {
     VERTICAL,
     HORIZONTAL,
-    FOUR_SCREEN
+    FOUR_SCREEN,
+    // Every nametable is the first or the second 1 KiB of VRAM, as boards
+    // like AxROM and MMC1 select
+    ONE_SCREEN_LOWER,
+    ONE_SCREEN_UPPER
 };
 
+// CPU/PPU timing, in the order of NES 2.0 header byte 12. Only NTSC is
+// emulated.
+enum class Region
+{
+    NTSC,
+    PAL,
+    // Runs on either
+    MULTIPLE,
+    DENDY
+};
+
+struct RomInfo;
+
 class Rom
 {
   public:
-    std::vector<uint8_t> prg_rom;
-    std::vector<uint8_t> chr_rom;
-    uint8_t mapper;
+    // Views into image; copies of a Rom share it
+    std::shared_ptr<const RomImage> image;
+    RomSpan prg_rom;
+    RomSpan chr_rom;
+    uint16_t mapper;
+    uint8_t submapper = 0;
     Mirroring screen_mirroring;
+    Region region = Region::NTSC;
+    bool battery = false;
+    // Bytes of PRG-RAM (volatile and battery-backed) and of CHR-RAM. Only
+    // NES 2.0 headers give them; iNES ones get 8 KiB of PRG-RAM, and 8 KiB of
+    // CHR-RAM without CHR-ROM.
+    size_t prg_ram_size = 0x2000;
+    size_t chr_ram_size = 0;
+    // CRC-32 of PRG-ROM followed by CHR-ROM, header excluded; the key of
+    // per-ROM tables
+    uint32_t crc32 = 0;
+    // This game's entry in the ROM database, whose mapper, mirroring and
+    // region replace the header's; null if it has none
+    const RomInfo *info = nullptr;
 
     Rom();
 
+    // Parses an iNES or NES 2.0 image. Throws std::invalid_argument if it is
+    // neither.
+    explicit Rom(std::shared_ptr<const RomImage> image);
+    // A copy of raw, shared through RomImage::share()
     Rom(const std::vector<uint8_t> &raw);
+    // Maps the file at path and shares it through RomImage::share()
+    static Rom load(const std::string &path);
 
   private:
     static constexpr size_t PRG_ROM_PAGE_SIZE = 16384;
@@ -0,0 +1,44 @@
+#include "rom_db.h"
+
+#include <algorithm>
+
+namespace EM
+{
+namespace
+{
+constexpr auto H = Mirroring::HORIZONTAL;
+constexpr auto V = Mirroring::VERTICAL;
+
+// Sorted by CRC-32
+constexpr RomInfo ROM_DB[] = {
+    {0x158b0388, 0, 0, H, Region::NTSC, {}}, // nestest
+    {0x408b54ee, 0, 0, H, Region::NTSC, {}}, // Kung Fu
+    {0x7e053e64, 0, 0, H, Region::NTSC, {}}, // Battle City
+    {0x9e4e9cc2, 0, 0, H, Region::NTSC, {}}, // Pac-Man
+    {0xd31dc910, 2, 0, V, Region::NTSC, {}}, // Rockman
+    {0xd445f698, 0, 0, V, Region::NTSC, {}}, // Super Mario Bros.
+    {0xf6035030, 2, 0, V, Region::NTSC, {}}, // Contra
+    {0xfb98d46e, 0, 0, H, Region::NTSC, {}}, // Ice Climber
+};
+
+constexpr bool sorted()
+{
+    for (size_t i = 1; i < std::size(ROM_DB); ++i)
+    {
+        if (ROM_DB[i - 1].crc32 >= ROM_DB[i].crc32)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(sorted(), "ROM_DB must be sorted by CRC-32 without duplicates");
+} // namespace
+
+const RomInfo *find_rom_info(uint32_t crc32)
+{
+    auto it = std::lower_bound(std::begin(ROM_DB), std::end(ROM_DB), crc32,
+                               [](const RomInfo &info, uint32_t key) { return info.crc32 < key; });
+    return it != std::end(ROM_DB) && it->crc32 == crc32 ? it : nullptr;
+}
+} // namespace EM
@@ -0,0 +1,32 @@
+#ifndef MYNESEMULATOR__ROM_DB_H_
+#define MYNESEMULATOR__ROM_DB_H_
+
+#include <array>
+#include <cstdint>
+
+#include "cartridge.h"
+
+namespace EM
+{
+// What is known about one game beyond its header, keyed by Rom::crc32.
+// Headers in circulation are often wrong about the board and mirroring, so
+// a Rom with an entry takes those from here.
+struct RomInfo
+{
+    uint32_t crc32;
+    uint16_t mapper;
+    uint8_t submapper;
+    Mirroring mirroring;
+    Region region;
+    // Spin loops the idle-loop heuristic rejects (see IdleLoopSkipper), by
+    // loop start address; unused slots are 0. An entry only bypasses
+    // is_spin_loop(): the loop still has to repeat its register state before
+    // anything is skipped.
+    std::array<uint16_t, 2> idle_loops;
+};
+
+// The entry for crc32, or null. The table is built and sorted at compile
+// time, so this is a binary search over read-only data with nothing to load.
+const RomInfo *find_rom_info(uint32_t crc32);
+} // namespace EM
+#endif
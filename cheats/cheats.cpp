@@ -0,0 +1,110 @@
+#include "cheats.h"
+
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace EM
+{
+namespace
+{
+// Game Genie letters by the nibble they stand for
+constexpr std::array<char, 16> GAME_GENIE_LETTERS{'A', 'P', 'Z', 'L', 'G', 'I', 'T', 'Y',
+                                                  'E', 'O', 'X', 'U', 'K', 'S', 'V', 'N'};
+
+uint8_t game_genie_nibble(char letter)
+{
+    auto upper = static_cast<char>(std::toupper(static_cast<unsigned char>(letter)));
+    for (size_t i = 0; i < GAME_GENIE_LETTERS.size(); ++i)
+    {
+        if (GAME_GENIE_LETTERS[i] == upper)
+        {
+            return static_cast<uint8_t>(i);
+        }
+    }
+    throw std::runtime_error(std::string("Invalid Game Genie letter '") + letter + "'");
+}
+
+// Hex digits only, no sign, prefix or spaces, at most max_digits of them
+unsigned long parse_hex(const std::string &digits, size_t max_digits, const std::string &code)
+{
+    if (digits.empty() || digits.size() > max_digits)
+    {
+        throw std::runtime_error("Invalid cheat code " + code);
+    }
+    for (char digit : digits)
+    {
+        if (!std::isxdigit(static_cast<unsigned char>(digit)))
+        {
+            throw std::runtime_error("Invalid cheat code " + code);
+        }
+    }
+    return std::stoul(digits, nullptr, 16);
+}
+} // namespace
+
+BytePatch decode_game_genie(const std::string &code)
+{
+    if (code.size() != 6 && code.size() != 8)
+    {
+        throw std::runtime_error("Game Genie codes have 6 or 8 letters: " + code);
+    }
+    std::array<uint8_t, 8> n{};
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        n[i] = game_genie_nibble(code[i]);
+    }
+
+    BytePatch patch;
+    patch.addr = static_cast<uint16_t>(0x8000 | ((n[3] & 7) << 12) | ((n[5] & 7) << 8) | ((n[4] & 8) << 8) |
+                                       ((n[2] & 7) << 4) | ((n[1] & 8) << 4) | (n[4] & 7) | (n[3] & 8));
+    if (code.size() == 6)
+    {
+        patch.value = static_cast<uint8_t>(((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[5] & 8));
+    }
+    else
+    {
+        patch.value = static_cast<uint8_t>(((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[7] & 8));
+        patch.compare = static_cast<uint8_t>(((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8));
+    }
+    return patch;
+}
+
+BytePatch decode_cheat(const std::string &code)
+{
+    auto colon = code.find(':');
+    if (colon == std::string::npos)
+    {
+        return decode_game_genie(code);
+    }
+
+    BytePatch patch;
+    auto second = code.find(':', colon + 1);
+    patch.addr = static_cast<uint16_t>(parse_hex(code.substr(0, colon), 4, code));
+    patch.value = static_cast<uint8_t>(parse_hex(code.substr(colon + 1, second - colon - 1), 2, code));
+    if (second != std::string::npos)
+    {
+        patch.compare = static_cast<uint8_t>(parse_hex(code.substr(second + 1), 2, code));
+    }
+    return patch;
+}
+
+void add_cheat(Bus &bus, const BytePatch &cheat)
+{
+    if (bus.is_writable(cheat.addr))
+    {
+        bus.add_frame_patch(cheat);
+    }
+    else
+    {
+        bus.add_read_patch(cheat);
+    }
+}
+
+void add_cheat(Bus &bus, const std::string &code)
+{
+    add_cheat(bus, decode_cheat(code));
+}
+} // namespace EM
@@ -0,0 +1,26 @@
+#ifndef MYNESEMULATOR__CHEATS_H_
+#define MYNESEMULATOR__CHEATS_H_
+
+#include <string>
+
+#include "../bus/bus.h"
+
+namespace EM
+{
+// Decodes a 6- or 8-letter Game Genie code, or a raw "addr:value" or
+// "addr:value:compare" code in hex. Throws std::runtime_error on anything
+// else.
+BytePatch decode_cheat(const std::string &code);
+BytePatch decode_game_genie(const std::string &code);
+
+// Activates a cheat on the bus. A code on read-only memory, as every Game
+// Genie code is, patches a copy of its page, so only that page is read
+// differently and no access pays for it. A code on RAM freezes the byte: it
+// is written back at every frame boundary. The threaded core and the JIT
+// decode code on a newly patched page again, but data reads the JIT already
+// translated keep the unpatched bytes; add cheats before running. The AOT
+// core reads PRG-ROM as it was when translated and does not see them.
+void add_cheat(Bus &bus, const BytePatch &cheat);
+void add_cheat(Bus &bus, const std::string &code);
+} // namespace EM
+#endif
@@ -0,0 +1,46 @@
+#ifndef MYNESEMULATOR__CONSOLE_H_
+#define MYNESEMULATOR__CONSOLE_H_
+
+#include <utility>
+
+#include "../bus/bus.h"
+#include "../cartridge/cartridge.h"
+#include "../cpu/cpu.h"
+#include "../cpu/timing.h"
+
+namespace EM
+{
+// The whole machine in one allocation, every component held by value.
+//
+// The Rom comes first only because Bus reads it when constructed; nothing
+// hot shares its cache lines. The CPU starts on a fresh line and the bus
+// follows it, so the registers, the bus timing state and the read page table
+// come first, then the PPU's timing state, ahead of RAM, VRAM and OAM. The
+// CPU's block cache, the write and fetch page tables and the cold bus and PPU
+// data (CHR banks, the mapper, the frame callback) are kept behind those.
+// The CPU and bus point at their siblings, so a console is neither copied
+// nor moved; keep it behind a std::unique_ptr.
+template <typename Timing> class BasicConsole
+{
+  private:
+    Rom rom;
+
+  public:
+    template <typename F>
+    BasicConsole(Rom rom, F gameloop_callback)
+        : rom(std::move(rom)), cpu(&bus), bus(&this->rom, gameloop_callback)
+    {
+        bus.watchpoints.pc = &cpu.registers.pc;
+    }
+
+    BasicConsole(const BasicConsole &) = delete;
+    BasicConsole &operator=(const BasicConsole &) = delete;
+
+    alignas(64) BasicCPU<Timing> cpu;
+    Bus bus;
+};
+
+using Console = BasicConsole<InstructionStep>;
+using CycleConsole = BasicConsole<CycleStep>;
+} // namespace EM
+#endif
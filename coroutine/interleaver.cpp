@@ -0,0 +1,86 @@
+#include "interleaver.h"
+
+namespace EM
+{
+Interleaver::Interleaver(Console &console) : console(console), ppu_task(run_ppu()), cpu_task(run_cpu())
+{
+    Bus &bus = console.bus;
+    bus.sync_ppu();
+    bus.ppu_runner = [this](size_t cycle) { run_ppu_to(cycle); };
+    bus.scheduler.cancel(Event::PpuNmi);
+    ppu_task.resume();
+}
+
+Interleaver::~Interleaver()
+{
+    Bus &bus = console.bus;
+    bus.ppu_runner = nullptr;
+    bus.sync_ppu();
+}
+
+void Interleaver::run_frames(size_t frames)
+{
+    Bus &bus = console.bus;
+    auto target = bus.frames + frames;
+    while (bus.frames < target)
+    {
+        // The PPU goes first when it is due, so the CPU never runs on past a
+        // scanline end the PPU has not taken
+        if (ppu_task.wake() <= bus.cycles)
+        {
+            ppu_task.resume();
+        }
+        else
+        {
+            cpu_task.resume();
+        }
+    }
+}
+
+// One scanline end per wake-up, the same as NesPPU::tick
+ComponentTask Interleaver::run_ppu()
+{
+    Bus &bus = console.bus;
+    NesPPU &ppu = bus.ppu;
+    while (true)
+    {
+        if (ppu.cycles < 341)
+        {
+            co_await WakeAt{ppu.timestamp + (341 - ppu.cycles + 2) / 3};
+            ppu.cycles += (bus.cycles - ppu.timestamp) * 3;
+            ppu.timestamp = bus.cycles;
+        }
+
+        auto nmi_before = ppu.nmi_interrupt.has_value();
+        ppu.end_scanline();
+        if (!nmi_before && ppu.nmi_interrupt.has_value())
+        {
+            bus.end_frame();
+        }
+    }
+}
+
+ComponentTask Interleaver::run_cpu()
+{
+    Bus &bus = console.bus;
+    while (true)
+    {
+        // Whole instructions, so the last one may run past the PPU's wake-up
+        console.cpu.run_cycles(ppu_task.wake() - bus.cycles);
+        co_await WakeAt{bus.cycles};
+    }
+}
+
+// A PPU register access in the middle of the CPU's run: scanline ends due by
+// now, then the rest of the way into the current line
+void Interleaver::run_ppu_to(size_t cycle)
+{
+    NesPPU &ppu = console.bus.ppu;
+    while (ppu_task.wake() <= cycle)
+    {
+        ppu_task.resume();
+    }
+    ppu.cycles += (cycle - ppu.timestamp) * 3;
+    ppu.timestamp = cycle;
+}
+} // namespace EM
@@ -0,0 +1,132 @@
+#ifndef MYNESEMULATOR__INTERLEAVER_H_
+#define MYNESEMULATOR__INTERLEAVER_H_
+
+#include <coroutine>
+#include <cstddef>
+#include <utility>
+
+#include "../console/console.h"
+
+namespace EM
+{
+// Experimental, C++20: the CPU and PPU of a Console run as coroutines that
+// a scheduler switches between where they have to meet, in place of the bus
+// catching the PPU up. Only coroutine_bench is built with it.
+
+// A component's body. It starts suspended; resume() runs it up to its next
+// co_await WakeAt, which records the CPU cycle it wants to run again at.
+class ComponentTask
+{
+  public:
+    struct promise_type
+    {
+        size_t wake = 0;
+
+        ComponentTask get_return_object()
+        {
+            return ComponentTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        // An exception from the frame callback leaves through resume()
+        void unhandled_exception()
+        {
+            throw;
+        }
+    };
+
+    explicit ComponentTask(std::coroutine_handle<promise_type> handle) : handle(handle)
+    {
+    }
+
+    ComponentTask(ComponentTask &&other) noexcept : handle(std::exchange(other.handle, nullptr))
+    {
+    }
+
+    ComponentTask(const ComponentTask &) = delete;
+    ComponentTask &operator=(const ComponentTask &) = delete;
+    ComponentTask &operator=(ComponentTask &&) = delete;
+
+    ~ComponentTask()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    size_t wake() const
+    {
+        return handle.promise().wake;
+    }
+
+    void resume()
+    {
+        handle.resume();
+    }
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Suspends the component until the CPU cycle count reaches `cycle`
+struct WakeAt
+{
+    size_t cycle;
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<ComponentTask::promise_type> handle) const noexcept
+    {
+        handle.promise().wake = cycle;
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+};
+
+// Runs a Console's CPU and PPU as two ComponentTasks. The PPU waits for the
+// end of each scanline; the CPU runs whole instructions up to the cycle the
+// PPU waits for and then yields. A PPU register access in between resumes
+// the PPU from inside the instruction through Bus::ppu_runner. The Console
+// goes back to catch-up when the Interleaver is destroyed.
+class Interleaver
+{
+  public:
+    explicit Interleaver(Console &console);
+    ~Interleaver();
+
+    Interleaver(const Interleaver &) = delete;
+    Interleaver &operator=(const Interleaver &) = delete;
+
+    // Runs until `frames` more vblank NMIs have been raised
+    void run_frames(size_t frames);
+
+  private:
+    Console &console;
+    ComponentTask ppu_task;
+    ComponentTask cpu_task;
+
+    ComponentTask run_ppu();
+    ComponentTask run_cpu();
+    void run_ppu_to(size_t cycle);
+};
+} // namespace EM
+#endif
@@ -0,0 +1,188 @@
+#include "block_cache.h"
+
+#include "idle_loop.h"
+#include "loop_idiom.h"
+#include "superinstructions.h"
+
+namespace EM
+{
+BlockCache::BlockCache() : blocks(SLOT_COUNT)
+{
+}
+
+std::ptrdiff_t BlockCache::slot(uint16_t pc)
+{
+    // Mirrors of RAM are left uncached so the decoded PCs stay exact
+    if (pc < RAM_SIZE)
+    {
+        return pc;
+    }
+    if (pc >= PRG_ROM_START)
+    {
+        return static_cast<std::ptrdiff_t>(RAM_SIZE + (pc - PRG_ROM_START));
+    }
+    return -1;
+}
+
+bool BlockCache::ends_block(uint8_t code)
+{
+    switch (code)
+    {
+    case 0x10: // BPL
+    case 0x30: // BMI
+    case 0x50: // BVC
+    case 0x70: // BVS
+    case 0x90: // BCC
+    case 0xb0: // BCS
+    case 0xd0: // BNE
+    case 0xf0: // BEQ
+    case 0x4c: // JMP
+    case 0x6c: // JMP indirect
+    case 0x20: // JSR
+    case 0x60: // RTS
+    case 0x40: // RTI
+    case 0x00: // BRK
+        return true;
+    default:
+        return false;
+    }
+}
+
+DecodedInstruction BlockCache::decode(Bus &bus, uint16_t pc)
+{
+    DecodedInstruction instruction;
+    instruction.pc = pc;
+    instruction.code = bus.peek(pc);
+
+    const OpCode &op = OPCODE_TABLE[instruction.code];
+    instruction.len = op.len;
+    instruction.cycles = op.cycles;
+    instruction.handler = op.handler;
+
+    auto operand_addr = static_cast<uint16_t>(pc + 1);
+    if (op.len == 2)
+    {
+        instruction.operand = bus.peek(operand_addr);
+    }
+    else if (op.len == 3)
+    {
+        auto lo = static_cast<uint16_t>(bus.peek(operand_addr));
+        auto hi = static_cast<uint16_t>(bus.peek(static_cast<uint16_t>(operand_addr + 1)));
+        instruction.operand = static_cast<uint16_t>(hi << 8 | lo);
+    }
+    return instruction;
+}
+
+bool BlockCache::watched(const Bus &bus, uint16_t first_byte, uint16_t last_byte)
+{
+    for (auto page : {first_byte >> 8, last_byte >> 8})
+    {
+        if (!bus.read_pages[page] || !bus.fetch_pages[page])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+const BasicBlock *BlockCache::lookup(Bus &bus, uint16_t pc)
+{
+    auto index = slot(pc);
+    if (index < 0)
+    {
+        return nullptr;
+    }
+
+    auto &cached = blocks[static_cast<size_t>(index)];
+    if (cached && cached->banks.current(bus))
+    {
+        return cached.get();
+    }
+
+    auto block = std::make_unique<BasicBlock>();
+    block->start = pc;
+
+    bool in_ram = pc < RAM_SIZE;
+    uint16_t addr = pc;
+
+    while (block->instructions.size() < MAX_BLOCK_LENGTH)
+    {
+        auto instruction = decode(bus, addr);
+        auto next = static_cast<uint32_t>(addr) + instruction.len;
+        // Watched instructions are left to the interpreter
+        if (watched(bus, addr, static_cast<uint16_t>(next - 1)))
+        {
+            break;
+        }
+        block->instructions.push_back(instruction);
+
+        if (in_ram)
+        {
+            for (uint32_t byte = addr; byte < next; ++byte)
+            {
+                block->ram_pages |= static_cast<uint8_t>(1 << (byte >> 8));
+            }
+        }
+
+        // Stop at control transfers and where the code leaves RAM or PRG-ROM
+        if (ends_block(instruction.code) || next > 0xffff || (in_ram && next >= RAM_SIZE))
+        {
+            break;
+        }
+        addr = static_cast<uint16_t>(next);
+    }
+
+    if (block->instructions.empty())
+    {
+        return nullptr;
+    }
+
+    if (superinstructions)
+    {
+        auto &instructions = block->instructions;
+        for (size_t i = 0; i + 1 < instructions.size(); ++i)
+        {
+            instructions[i].fused = superinstruction(instructions[i].code, instructions[i + 1].code);
+            // A fused pair is never the second half of another
+            i += instructions[i].fused != 0;
+        }
+    }
+
+    const auto &last = block->instructions.back();
+    block->banks = BankStamp(bus, pc, static_cast<uint16_t>(last.pc + last.len - 1));
+    block->loops_to_start = IdleLoopSkipper::loops_to_start(*block);
+    block->spin_loop = IdleLoopSkipper::is_spin_loop(*block);
+    block->loop_idiom = LoopIdiom::matches(*block);
+    if (block->ram_pages & ~bus.ram_code_pages)
+    {
+        bus.set_ram_code_pages(bus.ram_code_pages | block->ram_pages);
+    }
+
+    cached = std::move(block);
+    return cached.get();
+}
+
+void BlockCache::invalidate_dirty_pages(Bus &bus)
+{
+    auto dirty = bus.ram_code_dirty;
+    for (size_t i = 0; i < RAM_SIZE; ++i)
+    {
+        if (blocks[i] && (blocks[i]->ram_pages & dirty))
+        {
+            blocks[i].reset();
+        }
+    }
+    bus.set_ram_code_pages(static_cast<uint8_t>(bus.ram_code_pages & ~dirty));
+    bus.ram_code_dirty = 0;
+}
+
+void BlockCache::clear(Bus &bus)
+{
+    for (auto &block : blocks)
+    {
+        block.reset();
+    }
+    bus.set_ram_code_pages(0);
+    bus.ram_code_dirty = 0;
+}
+} // namespace EM
@@ -0,0 +1,123 @@
+#ifndef MYNESEMULATOR__BLOCK_CACHE_H_
+#define MYNESEMULATOR__BLOCK_CACHE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../bus/bus.h"
+#include "op_code.h"
+
+namespace EM
+{
+// One instruction decoded ahead of execution
+struct DecodedInstruction
+{
+    uint16_t pc = 0;      // address of the opcode byte
+    uint16_t operand = 0; // operand bytes, little endian
+    uint8_t code = 0;
+    uint8_t len = 1;
+    uint8_t cycles = 0;
+    // Non-zero when this and the next instruction run as one superinstruction
+    // (cpu/superinstructions.h): its number, counting from 1
+    uint8_t fused = 0;
+    OpHandler handler = nullptr;
+};
+
+// The memory Bus::read_pages had at the first and last page of a block when
+// it was decoded. A mapper switching either bank in or out repoints them; a
+// watchpoint on either page traps it.
+struct BankStamp
+{
+    uint8_t first_page = 0;
+    uint8_t last_page = 0;
+    const uint8_t *first = nullptr;
+    const uint8_t *last = nullptr;
+    // Bus::map_generation when the pages were last found unchanged
+    uint32_t generation = 0;
+
+    BankStamp() = default;
+    BankStamp(const Bus &bus, uint16_t first_byte, uint16_t last_byte)
+        : first_page(static_cast<uint8_t>(first_byte >> 8)), last_page(static_cast<uint8_t>(last_byte >> 8)),
+          first(bus.read_pages[first_page]), last(bus.read_pages[last_page]), generation(bus.map_generation)
+    {
+    }
+
+    // Only looks at the pages when something was remapped since last time
+    bool current(const Bus &bus)
+    {
+        if (generation == bus.map_generation)
+        {
+            return true;
+        }
+        if (bus.read_pages[first_page] != first || bus.read_pages[last_page] != last || !bus.fetch_pages[first_page] ||
+            !bus.fetch_pages[last_page])
+        {
+            return false;
+        }
+        generation = bus.map_generation;
+        return true;
+    }
+};
+
+// Straight-line run of instructions ending at the first control transfer
+struct BasicBlock
+{
+    uint16_t start = 0;
+    uint8_t ram_pages = 0; // RAM pages the block was decoded from
+    BankStamp banks;
+    // Ends with a branch or JMP back to start; spin_loop and loop_idiom also
+    // when the block passes IdleLoopSkipper::is_spin_loop or LoopIdiom::matches
+    bool loops_to_start = false;
+    bool spin_loop = false;
+    bool loop_idiom = false;
+    std::vector<DecodedInstruction> instructions;
+};
+
+// Decoded-instruction cache keyed by PC. PRG-ROM blocks are decoded again
+// when a bank switch has mapped other memory under them; RAM blocks
+// ($0000-$07FF) are dropped when Bus::write touches a page they were decoded
+// from.
+class BlockCache
+{
+  public:
+    BlockCache();
+
+    // Returns the block starting at pc, decoding it on a miss.
+    // Returns nullptr when pc is outside $0000-$07FF and PRG-ROM, or its
+    // instruction is on a page with a read or execute watchpoint; blocks
+    // stop before such instructions.
+    const BasicBlock *lookup(Bus &bus, uint16_t pc);
+
+    // Drop RAM blocks on the pages Bus::write has marked as modified
+    void invalidate_dirty_pages(Bus &bus);
+    void clear(Bus &bus);
+
+    static DecodedInstruction decode(Bus &bus, uint16_t pc);
+
+    // Mark fused pairs in blocks decoded from now on. Off, every instruction
+    // is dispatched on its own; the results are the same either way.
+    bool superinstructions = true;
+
+    static constexpr size_t RAM_SIZE = 0x0800;
+    static constexpr size_t PRG_ROM_START = 0x8000;
+    static constexpr size_t SLOT_COUNT = RAM_SIZE + 0x8000;
+
+    // Index of the block starting at pc, or -1 when pc is not cached
+    static std::ptrdiff_t slot(uint16_t pc);
+    // Control transfers, which end a basic block
+    static bool ends_block(uint8_t code);
+
+  private:
+    static constexpr size_t MAX_BLOCK_LENGTH = 64;
+
+    // Whether a watchpoint traps reads or fetches on either byte's page
+    static bool watched(const Bus &bus, uint16_t first_byte, uint16_t last_byte);
+
+    // RAM slots first, then PRG-ROM slots
+    std::vector<std::unique_ptr<BasicBlock>> blocks;
+};
+} // namespace EM
+#endif
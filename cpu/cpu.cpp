@@ -3,14 +3,15 @@
 //
 #include "cpu.h"
 
-#include <arm_neon.h>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "../bus/bus.h"
+#include "idle_loop.h"
+#include "loop_idiom.h"
 #include "op_code.h"
-#include <_types/_uint16_t.h>
-#include <_types/_uint8_t.h>
+#include "superinstructions.h"
 #include <iostream>
 #include <pthread.h>
 #include <stdexcept>
@@ -19,7 +20,7 @@
 namespace EM
 {
 
-bool CPU::page_cross(uint16_t addr1, uint16_t addr2)
+template <typename Timing, typename BusT> bool BasicCPU<Timing, BusT>::page_cross(uint16_t addr1, uint16_t addr2)
 {
     if (static_cast<uint16_t>(addr1 & 0xff00) != static_cast<uint16_t>(addr2 & 0xff00))
     {
@@ -33,9 +34,8 @@ bool CPU::page_cross(uint16_t addr1, uint16_t addr2)
 
 ///////////////////////////////////////////////////////////////////////////////
 // Constructor
-CPU::CPU()
+template <typename Timing, typename BusT> BasicCPU<Timing, BusT>::BasicCPU()
 {
-    const EM::OpCodeSingleton &instance{EM::OpCodeSingleton::get_instance()};
     registers.a = 0;
     registers.x = 0;
     registers.y = 0;
@@ -44,9 +44,8 @@ CPU::CPU()
     registers.pc = 0;       // program counter
 };
 
-CPU::CPU(Bus *bus)
+template <typename Timing, typename BusT> BasicCPU<Timing, BusT>::BasicCPU(BusT *bus)
 {
-    const EM::OpCodeSingleton &instance{EM::OpCodeSingleton::get_instance()};
     registers.a = 0;
     registers.x = 0;
     registers.y = 0;
@@ -56,21 +55,43 @@ CPU::CPU(Bus *bus)
     this->bus = bus;
 };
 
-CPU::~CPU(){};
+template <typename Timing, typename BusT> BasicCPU<Timing, BusT>::~BasicCPU(){};
 
 //////////////////////////////////////////////////////////////////////////////
 // Bus linkage
-uint8_t CPU::read(uint16_t addr) const
+template <typename Timing, typename BusT> uint8_t BasicCPU<Timing, BusT>::read(uint16_t addr)
 {
-    return bus->read(addr);
+    auto data = bus->read(addr);
+    if constexpr (Timing::PER_CYCLE)
+    {
+        bus->tick(1);
+        ++bus_cycles;
+    }
+    return data;
+}
+
+template <typename Timing, typename BusT> uint8_t BasicCPU<Timing, BusT>::fetch(uint16_t addr)
+{
+    auto data = bus->fetch(addr);
+    if constexpr (Timing::PER_CYCLE)
+    {
+        bus->tick(1);
+        ++bus_cycles;
+    }
+    return data;
 }
 
-void CPU::write(uint16_t addr, uint8_t data)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::write(uint16_t addr, uint8_t data)
 {
     bus->write(addr, data);
+    if constexpr (Timing::PER_CYCLE)
+    {
+        bus->tick(1);
+        ++bus_cycles;
+    }
 }
 
-uint16_t CPU::read_u16(uint16_t addr) const
+template <typename Timing, typename BusT> uint16_t BasicCPU<Timing, BusT>::read_u16(uint16_t addr)
 {
     auto lo = static_cast<uint16_t>(read(addr));
     auto hi = static_cast<uint16_t>(read(addr + 1));
@@ -78,7 +99,7 @@ uint16_t CPU::read_u16(uint16_t addr) const
     return data;
 }
 
-void CPU::write_u16(uint16_t addr, uint16_t data)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::write_u16(uint16_t addr, uint16_t data)
 {
     uint8_t hi = (data >> 8);
     uint8_t lo = (data & 0xff);
@@ -86,36 +107,101 @@ void CPU::write_u16(uint16_t addr, uint16_t data)
     bus->write(addr + 1, hi);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Timing policy
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::dummy_read(uint16_t addr)
+{
+    if constexpr (Timing::PER_CYCLE)
+    {
+        read(addr);
+    }
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::dummy_write(uint16_t addr, uint8_t data)
+{
+    if constexpr (Timing::PER_CYCLE)
+    {
+        write(addr, data);
+    }
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::extra_cycle(uint16_t addr)
+{
+    if constexpr (Timing::PER_CYCLE)
+    {
+        read(addr);
+    }
+    else
+    {
+        bus->tick(1);
+    }
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::page_cross_cycle()
+{
+    if constexpr (!Timing::PER_CYCLE)
+    {
+        bus->tick(1);
+    }
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::finish_cycles(uint8_t cycles)
+{
+    if constexpr (Timing::PER_CYCLE)
+    {
+        if (cycles > bus_cycles)
+        {
+            bus->tick(static_cast<uint8_t>(cycles - bus_cycles));
+        }
+        bus_cycles = 0;
+    }
+    else
+    {
+        bus->tick(cycles);
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Reset and load
-void CPU::reset()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::reset()
 {
     registers.a = 0;
     registers.x = 0;
     registers.y = 0;
     registers.sp = STACK_RESET;
-    registers.p = 0b100100; // status
-    registers.pc = read_u16(0xFFFC);
+    set_status(0b100100);
+    // Straight from the bus: no timing policy ticks the reset sequence
+    auto lo = static_cast<uint16_t>(bus->read(0xFFFC));
+    auto hi = static_cast<uint16_t>(bus->read(0xFFFD));
+    registers.pc = static_cast<uint16_t>(hi << 8 | lo);
 }
 
-void CPU::load(std::vector<uint8_t> program)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::load(std::vector<uint8_t> program)
 {
     std::memcpy((bus->ram).data() + 0x0600, program.data(), program.size());
+    if constexpr (std::is_same_v<BusT, Bus>)
+    {
+        block_cache.clear(*bus);
+    }
     // write_u16(0xFFFC, 0x0600);
 }
 
-void CPU::load_and_run(std::vector<uint8_t> program)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::load_and_run(std::vector<uint8_t> program)
 {
     load(program);
     reset();
     run();
 }
 
-void CPU::interrupt(Interrupt i)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::interrupt(Interrupt i)
 {
+    if (i.itype == InterruptType::NMI)
+    {
+        bus->acknowledge_nmi();
+    }
     stack_push_u16(registers.pc);
 
-    auto flag = registers.p;
+    auto flag = status();
     bool v = (i.b_flag_mask & 0b010000) != 0;
     if (v)
         flag |= B; // set status to true
@@ -132,81 +218,146 @@ void CPU::interrupt(Interrupt i)
 
     set_flag(I, true);
 
-    bus->tick(i.cpu_cycles);
+    finish_cycles(i.cpu_cycles);
     registers.pc = read_u16(i.vector_addr);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Get and update flags
-bool CPU::get_flag(CpuFlags f)
+template <typename Timing, typename BusT> uint8_t BasicCPU<Timing, BusT>::status() const
 {
-    return (registers.p & f);
+    auto p = static_cast<uint8_t>(registers.p & ~(N | Z | C | V));
+    p |= flags.n & N;
+    if (flags.z == 0)
+        p |= Z;
+    if (flags.c)
+        p |= C;
+    if (flags.v)
+        p |= V;
+    return p;
 }
 
-void CPU::set_flag(CpuFlags f, bool v)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::set_status(uint8_t p)
 {
-    if (v)
-        registers.p |= f; // set status to true
-    else
-        registers.p &= ~f; // clear status
+    registers.p = p;
+    flags.n = p;
+    flags.z = (p & Z) ? 0 : 1;
+    flags.c = (p & C) != 0;
+    flags.v = (p & V) != 0;
 }
 
-void CPU::update_zero_and_negative_flags(const uint8_t result)
+template <typename Timing, typename BusT> bool BasicCPU<Timing, BusT>::get_flag(CpuFlags f)
 {
-    set_flag(Z, result == 0);      // update zero flag
-    set_flag(N, result >> 7 == 1); // update negative flag
+    switch (f)
+    {
+    case N:
+        return (flags.n & N);
+    case Z:
+        return flags.z == 0;
+    case C:
+        return flags.c;
+    case V:
+        return flags.v;
+    default:
+        return (registers.p & f);
+    }
 }
 
-void CPU::update_negative_flags(const uint8_t result)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::set_flag(CpuFlags f, bool v)
 {
-    set_flag(N, result & 0x80);
+    switch (f)
+    {
+    case N:
+        flags.n = v ? N : 0;
+        break;
+    case Z:
+        flags.z = v ? 0 : 1;
+        break;
+    case C:
+        flags.c = v;
+        break;
+    case V:
+        flags.v = v;
+        break;
+    default:
+        if (v)
+            registers.p |= f; // set status to true
+        else
+            registers.p &= ~f; // clear status
+    }
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::update_zero_and_negative_flags(const uint8_t result)
+{
+    flags.n = result;
+    flags.z = result;
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::update_negative_flags(const uint8_t result)
+{
+    flags.n = result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Get operand address in different addressing mode
-std::pair<uint16_t, bool> CPU::get_absolute_address(const AddressingMode &mode, uint16_t addr)
+template <typename Timing, typename BusT>
+std::pair<uint16_t, bool> BasicCPU<Timing, BusT>::get_absolute_address(const AddressingMode &mode, uint16_t addr)
+{
+    switch (mode)
+    {
+    case Absolute:
+    case Absolute_X:
+    case Absolute_Y:
+        return resolve_operand_address(mode, read_u16(addr));
+    default:
+        return resolve_operand_address(mode, static_cast<uint16_t>(read(addr)));
+    }
+}
+
+template <typename Timing, typename BusT>
+std::pair<uint16_t, bool> BasicCPU<Timing, BusT>::resolve_operand_address(const AddressingMode &mode, uint16_t value)
 {
     switch (mode)
     {
     case ZeroPage:
-        return {static_cast<uint16_t>(read(addr)), false};
+        return {static_cast<uint16_t>(value & 0xff), false};
 
     case Absolute:
-        return {read_u16(addr), false};
+        return {value, false};
 
     case ZeroPage_X: {
-        auto pos = read(addr);
+        auto pos = static_cast<uint8_t>(value);
         // wrapping add
         auto addr_new = static_cast<uint16_t>(static_cast<uint8_t>(pos + registers.x));
         return {addr_new, false};
     }
     case ZeroPage_Y: {
-        auto pos = static_cast<uint16_t>(read(addr));
+        auto pos = static_cast<uint8_t>(value);
         // wrapping add
         auto addr_new = static_cast<uint16_t>(static_cast<uint8_t>(pos + registers.y));
         return {addr_new, false};
     }
 
     case Absolute_X: {
-        auto base = read_u16(addr);
+        auto base = value;
         auto addr_new = static_cast<uint16_t>(base + static_cast<uint16_t>(registers.x));
         return {addr_new, page_cross(base, addr_new)};
     }
     case Absolute_Y: {
-        auto base = read_u16(addr);
+        auto base = value;
         auto addr_new = static_cast<uint16_t>(base + static_cast<uint16_t>(registers.y));
         return {addr_new, page_cross(base, addr_new)};
     }
 
     case Indirect_X: {
-        auto base = read(addr);
+        auto base = static_cast<uint8_t>(value);
         uint8_t ptr = static_cast<uint8_t>(base + registers.x);
         auto lo = read(static_cast<uint16_t>(ptr));
         auto hi = read(static_cast<uint16_t>((static_cast<uint8_t>(ptr + 1))));
         return {static_cast<uint16_t>((static_cast<uint16_t>(hi) << 8 | (static_cast<uint16_t>(lo)))), false};
     }
     case Indirect_Y: {
-        auto base = read(addr);
+        auto base = static_cast<uint8_t>(value);
         auto lo = read(static_cast<uint16_t>(base));
         auto hi = read(static_cast<uint16_t>((static_cast<uint8_t>(base + 1))));
         auto deref_base = static_cast<uint16_t>(static_cast<uint16_t>(hi) << 8 | (static_cast<uint16_t>(lo)));
@@ -220,27 +371,68 @@ std::pair<uint16_t, bool> CPU::get_absolute_address(const AddressingMode &mode,
     }
 }
 
-std::pair<uint16_t, bool> CPU::get_operand_address(const AddressingMode &mode)
+// Operands come from `operand`, which the run loop fills from memory or from
+// the predecoded block cache before calling the handler
+template <typename Timing, typename BusT> template <AddressingMode M> std::pair<uint16_t, bool> BasicCPU<Timing, BusT>::get_indexed_address()
 {
-    switch (mode)
+    if constexpr (M == ZeroPage_X || M == ZeroPage_Y || M == Indirect_X)
+    {
+        // The 6502 reads the unindexed zero page address while adding
+        dummy_read(static_cast<uint8_t>(operand));
+    }
+    return resolve_operand_address(M, operand);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> std::pair<uint16_t, bool> BasicCPU<Timing, BusT>::get_operand_address()
+{
+    auto [addr, page_cross] = get_indexed_address<M>();
+    if constexpr (M == Absolute_X || M == Absolute_Y || M == Indirect_Y)
+    {
+        dummy_read(static_cast<uint16_t>(page_cross ? addr - 0x100 : addr));
+    }
+    return {addr, page_cross};
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> std::pair<uint8_t, bool> BasicCPU<Timing, BusT>::read_operand()
+{
+    if constexpr (M == Immediate)
     {
-    case Immediate:
-        return {registers.pc, false};
+        return {static_cast<uint8_t>(operand), false};
+    }
+    else
+    {
+        auto [addr, page_cross] = get_indexed_address<M>();
+        if (page_cross)
+        {
+            dummy_read(static_cast<uint16_t>(addr - 0x100));
+        }
+        return {read(addr), page_cross};
+    }
+}
+
+template <typename Timing, typename BusT> uint16_t BasicCPU<Timing, BusT>::fetch_operand(uint16_t addr, uint8_t len)
+{
+    switch (len)
+    {
+    case 2:
+        return static_cast<uint16_t>(read(addr));
+    case 3:
+        return read_u16(addr);
     default:
-        return get_absolute_address(mode, registers.pc);
+        return 0;
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Instructions
 
-void CPU::set_register_a(const uint8_t value)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::set_register_a(const uint8_t value)
 {
     registers.a = value;
     update_zero_and_negative_flags(registers.a);
 }
 
-void CPU::add_to_register_a(uint8_t data)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::add_to_register_a(uint8_t data)
 {
     // Calculate the sum including the carry flag
     uint16_t sum = static_cast<uint16_t>(registers.a) + static_cast<uint16_t>(data) + (get_flag(C) ? 1 : 0);
@@ -256,7 +448,7 @@ void CPU::add_to_register_a(uint8_t data)
     // Update the register A
     set_register_a(result);
 }
-void CPU::sub_from_register_a(uint8_t data)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::sub_from_register_a(uint8_t data)
 {
     // not sure
     //	auto negated_data = static_cast<int8_t>(-static_cast<int8_t>(data));
@@ -268,23 +460,23 @@ void CPU::sub_from_register_a(uint8_t data)
     add_to_register_a(negated_data);
 }
 
-uint8_t CPU::stack_pop()
+template <typename Timing, typename BusT> uint8_t BasicCPU<Timing, BusT>::stack_pop()
 {
     ++registers.sp;
     return read(static_cast<uint16_t>(static_cast<uint16_t>(STACK) + static_cast<uint16_t>(registers.sp)));
 }
-void CPU::stack_push(uint8_t data)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::stack_push(uint8_t data)
 {
     write(static_cast<uint16_t>(static_cast<uint16_t>(STACK) + static_cast<uint16_t>(registers.sp)), data);
     --registers.sp;
 }
-uint16_t CPU::stack_pop_u16()
+template <typename Timing, typename BusT> uint16_t BasicCPU<Timing, BusT>::stack_pop_u16()
 {
     uint16_t lo = stack_pop();
     uint16_t hi = stack_pop();
     return static_cast<uint16_t>(hi << 8 | lo);
 }
-void CPU::stack_push_u16(uint16_t data)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::stack_push_u16(uint16_t data)
 {
     auto hi = static_cast<uint8_t>(data >> 8);
     auto lo = static_cast<uint8_t>(data & 0xff);
@@ -292,100 +484,93 @@ void CPU::stack_push_u16(uint16_t data)
     stack_push(lo);
 }
 
-void CPU::LDY(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LDY()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     registers.y = data;
     update_zero_and_negative_flags(registers.y);
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
-void CPU::LDX(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LDX()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     registers.x = data;
     update_zero_and_negative_flags(registers.x);
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
 
-void CPU::LDA(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LDA()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    uint8_t value = read(addr);
+    auto [value, page_cross] = read_operand<M>();
     set_register_a(value);
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
 
-void CPU::STA(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::STA()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     write(addr, registers.a);
 }
 
-void CPU::AND(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::AND()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     set_register_a((static_cast<uint8_t>(data & registers.a)));
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
-void CPU::EOR(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::EOR()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     set_register_a((data ^ registers.a));
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
-void CPU::ORA(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ORA()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     set_register_a((data | registers.a));
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
 
-void CPU::TAX()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TAX()
 {
     registers.x = registers.a;
     update_zero_and_negative_flags(registers.x);
 }
 
-void CPU::INX()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::INX()
 {
     // actually it is wrapping add
     registers.x = registers.x + 1;
     update_zero_and_negative_flags(registers.x);
 }
-void CPU::INY()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::INY()
 {
     registers.y = registers.y + 1;
     update_zero_and_negative_flags(registers.y);
 }
 
-void CPU::SBC(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::SBC()
 {
     // A - M - C̅ -> A
-    auto [addr, page_cross] = get_operand_address(mode);
-    uint8_t data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     auto value = static_cast<uint16_t>(data);
     uint16_t carry_in = get_flag(C) ? 0 : 1;
     uint16_t result = static_cast<uint16_t>(registers.a) - value - carry_in;
@@ -396,22 +581,21 @@ void CPU::SBC(const AddressingMode &mode)
     registers.a = static_cast<uint8_t>(result & 0xFF);
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
 
-void CPU::ADC(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ADC()
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto value = read(addr);
+    auto [value, page_cross] = read_operand<M>();
     add_to_register_a(value);
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
 
-void CPU::asl_accumulator()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::asl_accumulator()
 {
     auto data = registers.a;
     // set carry flag
@@ -419,10 +603,11 @@ void CPU::asl_accumulator()
     data <<= 1;
     set_register_a(data);
 }
-uint8_t CPU::ASL(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> uint8_t BasicCPU<Timing, BusT>::asl_memory()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     auto data = read(addr);
+    dummy_write(addr, data);
 
     set_flag(C, data >> 7 == 1);
     data <<= 1;
@@ -431,17 +616,18 @@ uint8_t CPU::ASL(const AddressingMode &mode)
     return data;
 }
 
-void CPU::lsr_accumulator()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::lsr_accumulator()
 {
     auto data = registers.a;
     set_flag(C, (data & 1) == 1);
     data >>= 1;
     set_register_a(data);
 }
-uint8_t CPU::LSR(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> uint8_t BasicCPU<Timing, BusT>::lsr_memory()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     auto data = read(addr);
+    dummy_write(addr, data);
 
     set_flag(C, (data & 1) == 1);
 
@@ -451,10 +637,11 @@ uint8_t CPU::LSR(const AddressingMode &mode)
     return data;
 }
 
-uint8_t CPU::ROL(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> uint8_t BasicCPU<Timing, BusT>::rol_memory()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     auto data = read(addr);
+    dummy_write(addr, data);
     bool old_carry = get_flag(C);
 
     set_flag(C, data >> 7 == 1);
@@ -471,7 +658,7 @@ uint8_t CPU::ROL(const AddressingMode &mode)
 
     return data;
 }
-void CPU::rol_accumulator()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::rol_accumulator()
 {
     auto data = registers.a;
     bool old_carry = get_flag(C);
@@ -488,10 +675,11 @@ void CPU::rol_accumulator()
     set_register_a(data);
 }
 
-uint8_t CPU::ROR(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> uint8_t BasicCPU<Timing, BusT>::ror_memory()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     auto data = read(addr);
+    dummy_write(addr, data);
     bool old_carry = get_flag(C);
 
     set_flag(C, (data & 1) == 1);
@@ -508,7 +696,7 @@ uint8_t CPU::ROR(const AddressingMode &mode)
 
     return data;
 }
-void CPU::ror_accumulator()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::ror_accumulator()
 {
     auto data = registers.a;
     bool old_carry = get_flag(C);
@@ -525,95 +713,1047 @@ void CPU::ror_accumulator()
     set_register_a(data);
 }
 
-uint8_t CPU::INC(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> uint8_t BasicCPU<Timing, BusT>::inc_memory()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     uint8_t data = read(addr);
+    dummy_write(addr, data);
     ++data;
     write(addr, data);
     update_zero_and_negative_flags(data);
     return data;
 }
 
-void CPU::DEX()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::DEX()
 {
     registers.x = registers.x - 1;
     update_zero_and_negative_flags(registers.x);
 }
-void CPU::DEY()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::DEY()
 {
     --registers.y;
     update_zero_and_negative_flags(registers.y);
 }
-uint8_t CPU::DEC(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> uint8_t BasicCPU<Timing, BusT>::dec_memory()
 {
-    auto [addr, _] = get_operand_address(mode);
+    auto [addr, _] = get_operand_address<M>();
     auto data = read(addr);
+    dummy_write(addr, data);
     --data;
     write(addr, data);
     update_zero_and_negative_flags(data);
     return data;
 }
 
-void CPU::PLA()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::PLA()
 {
     auto data = stack_pop();
     set_register_a(data);
 }
-void CPU::PLP()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::PLP()
 {
-    registers.p = stack_pop();
+    set_status(stack_pop());
     // Clear BREAK flag
     set_flag(B, false);
     // Set BREAK2 flag
     set_flag(U, true);
 }
-void CPU::PHP()
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::PHP()
 {
     // Save previous status
-    auto flags = registers.p;
-    flags |= B;
-    flags |= U;
-    stack_push(flags);
+    auto p = status();
+    p |= B;
+    p |= U;
+    stack_push(p);
 }
 
-void CPU::BIT(const AddressingMode &mode)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::BIT()
 {
-    auto [addr, _] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, _] = read_operand<M>();
     auto and_result = registers.a & data;
     set_flag(Z, and_result == 0);
     set_flag(N, (data & 0b1000'0000) > 0);
     set_flag(V, (data & 0b0100'1000) > 0);
 }
 
-void CPU::COMPARE(const AddressingMode &mode, uint8_t compare_with)
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::COMPARE(uint8_t compare_with)
 {
-    auto [addr, page_cross] = get_operand_address(mode);
-    auto data = read(addr);
+    auto [data, page_cross] = read_operand<M>();
     set_flag(C, data <= compare_with);
     update_zero_and_negative_flags(compare_with - data);
     if (page_cross)
     {
-        bus->tick(1);
+        page_cross_cycle();
     }
 }
 
-void CPU::BRANCH(bool condition)
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BRANCH(bool condition)
 {
     if (condition)
     {
-        bus->tick(1);
+        auto next = static_cast<uint16_t>(registers.pc + 1);
+        extra_cycle(next);
 
-        auto jump = static_cast<int8_t>(read(registers.pc));
+        auto jump = static_cast<int8_t>(operand);
         auto jump_addr = static_cast<uint16_t>(static_cast<uint16_t>(registers.pc + 1) + static_cast<uint16_t>(jump));
 
         if ((static_cast<uint16_t>(registers.pc + 1) & 0xff00) != (jump_addr & 0xff00))
         {
-            bus->tick(1);
+            extra_cycle(static_cast<uint16_t>((next & 0xff00) | (jump_addr & 0x00ff)));
         }
 
         registers.pc = jump_addr;
     }
 }
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::STX()
+{
+    auto [addr, _] = get_operand_address<M>();
+    write(addr, registers.x);
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::STY()
+{
+    auto [addr, _] = get_operand_address<M>();
+    write(addr, registers.y);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ASL()
+{
+    asl_memory<M>();
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LSR()
+{
+    lsr_memory<M>();
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ROL()
+{
+    rol_memory<M>();
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ROR()
+{
+    ror_memory<M>();
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::INC()
+{
+    inc_memory<M>();
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::DEC()
+{
+    dec_memory<M>();
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::CMP()
+{
+    COMPARE<M>(registers.a);
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::CPX()
+{
+    COMPARE<M>(registers.x);
+}
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::CPY()
+{
+    COMPARE<M>(registers.y);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TAY()
+{
+    registers.y = registers.a;
+    update_zero_and_negative_flags(registers.y);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TSX()
+{
+    registers.x = registers.sp;
+    update_zero_and_negative_flags(registers.x);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TXA()
+{
+    registers.a = registers.x;
+    update_zero_and_negative_flags(registers.a);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TXS()
+{
+    registers.sp = registers.x;
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TYA()
+{
+    registers.a = registers.y;
+    update_zero_and_negative_flags(registers.a);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::PHA()
+{
+    stack_push(registers.a);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BRK()
+{
+    // BRK is not emulated as an interrupt; it behaves like CLD
+    CLD();
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::NOP()
+{
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::CLC()
+{
+    set_flag(C, false);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::CLD()
+{
+    set_flag(D, false);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::CLI()
+{
+    set_flag(I, false);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::CLV()
+{
+    set_flag(V, false);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::SEC()
+{
+    set_flag(C, true);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::SED()
+{
+    set_flag(D, true);
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::SEI()
+{
+    set_flag(I, true);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::JMP()
+{
+    auto addr = operand;
+    registers.pc = addr;
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::JMP_INDIRECT()
+{
+    auto addr = operand;
+    // bug info from
+    // https://github.com/bugzmanov/nes_ebook/blob/master/code/ch3.4/src/cpu.rs
+
+    uint16_t ref;
+    if ((addr & 0x00FF) == 0x00FF)
+    {
+        auto lo = read(addr);
+        auto hi = read(addr & 0xFF00);
+        ref = static_cast<uint16_t>(static_cast<uint16_t>(static_cast<uint16_t>(hi)) << 8 |
+                                    (static_cast<uint16_t>(lo)));
+    }
+    else
+    {
+        ref = read_u16(addr);
+    }
+    registers.pc = ref;
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::JSR()
+{
+    stack_push_u16(static_cast<uint16_t>(registers.pc + 2 - 1));
+    auto target = operand;
+    registers.pc = target;
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::RTS()
+{
+    registers.pc = static_cast<uint16_t>(stack_pop_u16());
+    ++registers.pc;
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::RTI()
+{
+    set_status(stack_pop());
+    set_flag(B, false);
+    set_flag(U, true);
+    registers.pc = stack_pop_u16();
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BCC()
+{
+    BRANCH(!get_flag(C));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BCS()
+{
+    BRANCH(get_flag(C));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BEQ()
+{
+    BRANCH(get_flag(Z));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BMI()
+{
+    BRANCH(get_flag(N));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BNE()
+{
+    BRANCH(!get_flag(Z));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BPL()
+{
+    BRANCH(!get_flag(N));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BVC()
+{
+    BRANCH(!get_flag(V));
+}
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::BVS()
+{
+    BRANCH(get_flag(V));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Unofficial instructions
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::DCP()
+{
+    const auto [addr, _] = get_operand_address<M>();
+    auto data = read(addr);
+    dummy_write(addr, data);
+    --data;
+    write(addr, data);
+    if (data <= registers.a)
+    {
+        set_flag(C, true);
+    }
+    update_zero_and_negative_flags(registers.a - data);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::RLA()
+{
+    auto data = rol_memory<M>();
+    set_register_a(data & registers.a);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::SLO()
+{
+    auto data = asl_memory<M>();
+    set_register_a(data | registers.a);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::SRE()
+{
+    auto data = lsr_memory<M>();
+    set_register_a(data ^ registers.a);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::AXS()
+{
+    auto [data, _] = read_operand<M>();
+    auto x_and_a = static_cast<uint8_t>(registers.x & registers.a);
+    auto result = static_cast<uint8_t>(x_and_a - data);
+
+    if (data <= x_and_a)
+    {
+        set_flag(C, true);
+    }
+
+    update_zero_and_negative_flags(result);
+    registers.x = result;
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ARR()
+{
+    auto [data, _] = read_operand<M>();
+    set_register_a(data & registers.a);
+    ror_accumulator();
+
+    auto result = registers.a;
+    auto bit_5 = (result >> 5) & 1;
+    auto bit_6 = (result >> 6) & 1;
+
+    if (bit_6 == 1)
+    {
+        set_flag(C, true);
+    }
+    else
+    {
+        set_flag(C, false);
+    }
+
+    if ((bit_5 ^ bit_6) == 1)
+    {
+        set_flag(V, true);
+    }
+    else
+    {
+        set_flag(V, false); // TODO: !
+    }
+
+    update_zero_and_negative_flags(result);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::SBC_UNOFFICIAL()
+{
+    auto [data, _] = read_operand<M>();
+    // TODO: not sure
+    sub_from_register_a(data);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ANC()
+{
+    auto [data, _] = read_operand<M>();
+    set_register_a(data & registers.a);
+    if (get_flag(N))
+    {
+        set_flag(C, true);
+    }
+    else
+    {
+        set_flag(C, false);
+    }
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ALR()
+{
+    auto [data, _] = read_operand<M>();
+    set_register_a(data & registers.a);
+    lsr_accumulator();
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::NOP_READ()
+{
+    auto [data, page_cross] = read_operand<M>();
+    if (page_cross)
+    {
+        page_cross_cycle();
+    }
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::RRA()
+{
+    auto data = ror_memory<M>();
+    add_to_register_a(data);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::ISB()
+{
+    auto data = inc_memory<M>();
+    sub_from_register_a(data);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LAX()
+{
+    auto [data, _] = read_operand<M>();
+    set_register_a(data);
+    registers.x = registers.a;
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::SAX()
+{
+    auto data = static_cast<uint8_t>(registers.a & registers.x);
+    auto [addr, _] = get_operand_address<M>();
+    write(addr, data);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LXA()
+{
+    LDA<M>();
+    TAX();
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::XAA()
+{
+    registers.a = registers.x;
+    update_zero_and_negative_flags(registers.a);
+    auto [data, _] = read_operand<M>();
+    set_register_a(data & registers.a);
+}
+
+template <typename Timing, typename BusT> template <AddressingMode M> void BasicCPU<Timing, BusT>::LAS()
+{
+    auto [data, _] = read_operand<M>();
+    data = data & registers.sp;
+    registers.a = data;
+    registers.x = data;
+    registers.sp = data;
+    update_zero_and_negative_flags(data);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::TAS()
+{
+    uint8_t data = registers.a & registers.x;
+    registers.sp = data;
+    uint16_t mem_addr = operand + static_cast<uint16_t>(registers.y);
+    data = (static_cast<uint8_t>(mem_addr >> 8) + 1) & registers.sp;
+    write(mem_addr, data);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::AHX_INDIRECT_Y()
+{
+    auto pos = static_cast<uint8_t>(operand);
+    uint16_t mem_addr = read_u16(static_cast<uint16_t>(pos)) + static_cast<uint16_t>(registers.y);
+    uint8_t data = registers.a & registers.x & static_cast<uint8_t>(mem_addr >> 8);
+    write(mem_addr, data);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::AHX_ABSOLUTE_Y()
+{
+    auto mem_addr = static_cast<uint16_t>(operand + static_cast<uint16_t>(registers.y));
+    uint8_t data = registers.a & registers.x & static_cast<uint8_t>(mem_addr >> 8);
+    write(mem_addr, data);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::SHX()
+{
+    uint16_t mem_addr = operand + static_cast<uint16_t>(registers.y);
+    uint8_t data = registers.x & (static_cast<uint8_t>(mem_addr >> 8) + 1);
+    write(mem_addr, data);
+}
+
+template <typename Timing, typename BusT> void BasicCPU<Timing, BusT>::SHY()
+{
+    uint16_t mem_addr = operand + static_cast<uint16_t>(registers.x);
+    uint8_t data = registers.y & (static_cast<uint8_t>(mem_addr >> 8) + 1);
+    write(mem_addr, data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Opcode table
+template <typename Timing, typename BusT> constexpr std::array<BasicOpCode<Timing, BusT>, 256> BasicCPU<Timing, BusT>::make_opcode_table()
+{
+    // Handlers of this timing policy
+    using CPU = BasicCPU;
+
+    const BasicOpCode<Timing, BusT> opcodes[] = {
+        {0x00, "BRK", 1, 7, NoneAddressing, &CPU::BRK},
+        {0xea, "NOP", 1, 2, NoneAddressing, &CPU::NOP},
+
+        /* Arithmetic */
+        {0x69, "ADC", 2, 2, Immediate, &CPU::ADC<Immediate>},
+        {0x65, "ADC", 2, 3, ZeroPage, &CPU::ADC<ZeroPage>},
+        {0x75, "ADC", 2, 4, ZeroPage_X, &CPU::ADC<ZeroPage_X>},
+        {0x6d, "ADC", 3, 4, Absolute, &CPU::ADC<Absolute>},
+        {0x7d, "ADC", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::ADC<Absolute_X>},
+        {0x79, "ADC", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::ADC<Absolute_Y>},
+        {0x61, "ADC", 2, 6, Indirect_X, &CPU::ADC<Indirect_X>},
+        {0x71, "ADC", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::ADC<Indirect_Y>},
+
+        {0xe9, "SBC", 2, 2, Immediate, &CPU::SBC<Immediate>},
+        {0xe5, "SBC", 2, 3, ZeroPage, &CPU::SBC<ZeroPage>},
+        {0xf5, "SBC", 2, 4, ZeroPage_X, &CPU::SBC<ZeroPage_X>},
+        {0xed, "SBC", 3, 4, Absolute, &CPU::SBC<Absolute>},
+        {0xfd, "SBC", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::SBC<Absolute_X>},
+        {0xf9, "SBC", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::SBC<Absolute_Y>},
+        {0xe1, "SBC", 2, 6, Indirect_X, &CPU::SBC<Indirect_X>},
+        {0xf1, "SBC", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::SBC<Indirect_Y>},
+
+        {0x29, "AND", 2, 2, Immediate, &CPU::AND<Immediate>},
+        {0x25, "AND", 2, 3, ZeroPage, &CPU::AND<ZeroPage>},
+        {0x35, "AND", 2, 4, ZeroPage_X, &CPU::AND<ZeroPage_X>},
+        {0x2d, "AND", 3, 4, Absolute, &CPU::AND<Absolute>},
+        {0x3d, "AND", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::AND<Absolute_X>},
+        {0x39, "AND", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::AND<Absolute_Y>},
+        {0x21, "AND", 2, 6, Indirect_X, &CPU::AND<Indirect_X>},
+        {0x31, "AND", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::AND<Indirect_Y>},
+
+        {0x49, "EOR", 2, 2, Immediate, &CPU::EOR<Immediate>},
+        {0x45, "EOR", 2, 3, ZeroPage, &CPU::EOR<ZeroPage>},
+        {0x55, "EOR", 2, 4, ZeroPage_X, &CPU::EOR<ZeroPage_X>},
+        {0x4d, "EOR", 3, 4, Absolute, &CPU::EOR<Absolute>},
+        {0x5d, "EOR", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::EOR<Absolute_X>},
+        {0x59, "EOR", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::EOR<Absolute_Y>},
+        {0x41, "EOR", 2, 6, Indirect_X, &CPU::EOR<Indirect_X>},
+        {0x51, "EOR", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::EOR<Indirect_Y>},
+
+        {0x09, "ORA", 2, 2, Immediate, &CPU::ORA<Immediate>},
+        {0x05, "ORA", 2, 3, ZeroPage, &CPU::ORA<ZeroPage>},
+        {0x15, "ORA", 2, 4, ZeroPage_X, &CPU::ORA<ZeroPage_X>},
+        {0x0d, "ORA", 3, 4, Absolute, &CPU::ORA<Absolute>},
+        {0x1d, "ORA", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::ORA<Absolute_X>},
+        {0x19, "ORA", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::ORA<Absolute_Y>},
+        {0x01, "ORA", 2, 6, Indirect_X, &CPU::ORA<Indirect_X>},
+        {0x11, "ORA", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::ORA<Indirect_Y>},
+
+        /* Shifts */
+        {0x0a, "ASL", 1, 2, NoneAddressing, &CPU::asl_accumulator},
+        {0x06, "ASL", 2, 5, ZeroPage, &CPU::ASL<ZeroPage>},
+        {0x16, "ASL", 2, 6, ZeroPage_X, &CPU::ASL<ZeroPage_X>},
+        {0x0e, "ASL", 3, 6, Absolute, &CPU::ASL<Absolute>},
+        {0x1e, "ASL", 3, 7, Absolute_X, &CPU::ASL<Absolute_X>},
+
+        {0x4a, "LSR", 1, 2, NoneAddressing, &CPU::lsr_accumulator},
+        {0x46, "LSR", 2, 5, ZeroPage, &CPU::LSR<ZeroPage>},
+        {0x56, "LSR", 2, 6, ZeroPage_X, &CPU::LSR<ZeroPage_X>},
+        {0x4e, "LSR", 3, 6, Absolute, &CPU::LSR<Absolute>},
+        {0x5e, "LSR", 3, 7, Absolute_X, &CPU::LSR<Absolute_X>},
+
+        {0x2a, "ROL", 1, 2, NoneAddressing, &CPU::rol_accumulator},
+        {0x26, "ROL", 2, 5, ZeroPage, &CPU::ROL<ZeroPage>},
+        {0x36, "ROL", 2, 6, ZeroPage_X, &CPU::ROL<ZeroPage_X>},
+        {0x2e, "ROL", 3, 6, Absolute, &CPU::ROL<Absolute>},
+        {0x3e, "ROL", 3, 7, Absolute_X, &CPU::ROL<Absolute_X>},
+
+        {0x6a, "ROR", 1, 2, NoneAddressing, &CPU::ror_accumulator},
+        {0x66, "ROR", 2, 5, ZeroPage, &CPU::ROR<ZeroPage>},
+        {0x76, "ROR", 2, 6, ZeroPage_X, &CPU::ROR<ZeroPage_X>},
+        {0x6e, "ROR", 3, 6, Absolute, &CPU::ROR<Absolute>},
+        {0x7e, "ROR", 3, 7, Absolute_X, &CPU::ROR<Absolute_X>},
+
+        {0xe6, "INC", 2, 5, ZeroPage, &CPU::INC<ZeroPage>},
+        {0xf6, "INC", 2, 6, ZeroPage_X, &CPU::INC<ZeroPage_X>},
+        {0xee, "INC", 3, 6, Absolute, &CPU::INC<Absolute>},
+        {0xfe, "INC", 3, 7, Absolute_X, &CPU::INC<Absolute_X>},
+
+        {0xe8, "INX", 1, 2, NoneAddressing, &CPU::INX},
+        {0xc8, "INY", 1, 2, NoneAddressing, &CPU::INY},
+
+        {0xc6, "DEC", 2, 5, ZeroPage, &CPU::DEC<ZeroPage>},
+        {0xd6, "DEC", 2, 6, ZeroPage_X, &CPU::DEC<ZeroPage_X>},
+        {0xce, "DEC", 3, 6, Absolute, &CPU::DEC<Absolute>},
+        {0xde, "DEC", 3, 7, Absolute_X, &CPU::DEC<Absolute_X>},
+
+        {0xca, "DEX", 1, 2, NoneAddressing, &CPU::DEX},
+        {0x88, "DEY", 1, 2, NoneAddressing, &CPU::DEY},
+
+        {0xc9, "CMP", 2, 2, Immediate, &CPU::CMP<Immediate>},
+        {0xc5, "CMP", 2, 3, ZeroPage, &CPU::CMP<ZeroPage>},
+        {0xd5, "CMP", 2, 4, ZeroPage_X, &CPU::CMP<ZeroPage_X>},
+        {0xcd, "CMP", 3, 4, Absolute, &CPU::CMP<Absolute>},
+        {0xdd, "CMP", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::CMP<Absolute_X>},
+        {0xd9, "CMP", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::CMP<Absolute_Y>},
+        {0xc1, "CMP", 2, 6, Indirect_X, &CPU::CMP<Indirect_X>},
+        {0xd1, "CMP", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::CMP<Indirect_Y>},
+
+        {0xc0, "CPY", 2, 2, Immediate, &CPU::CPY<Immediate>},
+        {0xc4, "CPY", 2, 3, ZeroPage, &CPU::CPY<ZeroPage>},
+        {0xcc, "CPY", 3, 4, Absolute, &CPU::CPY<Absolute>},
+
+        {0xe0, "CPX", 2, 2, Immediate, &CPU::CPX<Immediate>},
+        {0xe4, "CPX", 2, 3, ZeroPage, &CPU::CPX<ZeroPage>},
+        {0xec, "CPX", 3, 4, Absolute, &CPU::CPX<Absolute>},
+
+        /* Branching */
+
+        {0x4c, "JMP", 3, 3, NoneAddressing, &CPU::JMP},
+        // AddressingMode that acts as Immidiate
+        {0x6c, "JMP", 3, 5, NoneAddressing, &CPU::JMP_INDIRECT},
+        // AddressingMode:Indirect with 6502 bug
+
+        {0x20, "JSR", 3, 6, NoneAddressing, &CPU::JSR},
+        {0x60, "RTS", 1, 6, NoneAddressing, &CPU::RTS},
+
+        {0x40, "RTI", 1, 6, NoneAddressing, &CPU::RTI},
+
+        {0xd0, "BNE", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BNE},
+        {0x70, "BVS", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BVS},
+        {0x50, "BVC", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BVC},
+        {0x30, "BMI", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BMI},
+        {0xf0, "BEQ", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BEQ},
+        {0xb0, "BCS", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BCS},
+        {0x90, "BCC", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BCC},
+        {0x10, "BPL", 2, 2 /*(+1 if branch succeeds +2 if to a new page)*/, NoneAddressing, &CPU::BPL},
+
+        {0x24, "BIT", 2, 3, ZeroPage, &CPU::BIT<ZeroPage>},
+        {0x2c, "BIT", 3, 4, Absolute, &CPU::BIT<Absolute>},
+
+        /* Stores, Loads */
+        {0xa9, "LDA", 2, 2, Immediate, &CPU::LDA<Immediate>},
+        {0xa5, "LDA", 2, 3, ZeroPage, &CPU::LDA<ZeroPage>},
+        {0xb5, "LDA", 2, 4, ZeroPage_X, &CPU::LDA<ZeroPage_X>},
+        {0xad, "LDA", 3, 4, Absolute, &CPU::LDA<Absolute>},
+        {0xbd, "LDA", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::LDA<Absolute_X>},
+        {0xb9, "LDA", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::LDA<Absolute_Y>},
+        {0xa1, "LDA", 2, 6, Indirect_X, &CPU::LDA<Indirect_X>},
+        {0xb1, "LDA", 2, 5 /*+1 if page crossed*/, Indirect_Y, &CPU::LDA<Indirect_Y>},
+
+        {0xa2, "LDX", 2, 2, Immediate, &CPU::LDX<Immediate>},
+        {0xa6, "LDX", 2, 3, ZeroPage, &CPU::LDX<ZeroPage>},
+        {0xb6, "LDX", 2, 4, ZeroPage_Y, &CPU::LDX<ZeroPage_Y>},
+        {0xae, "LDX", 3, 4, Absolute, &CPU::LDX<Absolute>},
+        {0xbe, "LDX", 3, 4 /*+1 if page crossed*/, Absolute_Y, &CPU::LDX<Absolute_Y>},
+
+        {0xa0, "LDY", 2, 2, Immediate, &CPU::LDY<Immediate>},
+        {0xa4, "LDY", 2, 3, ZeroPage, &CPU::LDY<ZeroPage>},
+        {0xb4, "LDY", 2, 4, ZeroPage_X, &CPU::LDY<ZeroPage_X>},
+        {0xac, "LDY", 3, 4, Absolute, &CPU::LDY<Absolute>},
+        {0xbc, "LDY", 3, 4 /*+1 if page crossed*/, Absolute_X, &CPU::LDY<Absolute_X>},
+
+        {0x85, "STA", 2, 3, ZeroPage, &CPU::STA<ZeroPage>},
+        {0x95, "STA", 2, 4, ZeroPage_X, &CPU::STA<ZeroPage_X>},
+        {0x8d, "STA", 3, 4, Absolute, &CPU::STA<Absolute>},
+        {0x9d, "STA", 3, 5, Absolute_X, &CPU::STA<Absolute_X>},
+        {0x99, "STA", 3, 5, Absolute_Y, &CPU::STA<Absolute_Y>},
+        {0x81, "STA", 2, 6, Indirect_X, &CPU::STA<Indirect_X>},
+        {0x91, "STA", 2, 6, Indirect_Y, &CPU::STA<Indirect_Y>},
+
+        {0x86, "STX", 2, 3, ZeroPage, &CPU::STX<ZeroPage>},
+        {0x96, "STX", 2, 4, ZeroPage_Y, &CPU::STX<ZeroPage_Y>},
+        {0x8e, "STX", 3, 4, Absolute, &CPU::STX<Absolute>},
+
+        {0x84, "STY", 2, 3, ZeroPage, &CPU::STY<ZeroPage>},
+        {0x94, "STY", 2, 4, ZeroPage_X, &CPU::STY<ZeroPage_X>},
+        {0x8c, "STY", 3, 4, Absolute, &CPU::STY<Absolute>},
+
+        /* Flags clear */
+
+        {0xd8, "CLD", 1, 2, NoneAddressing, &CPU::CLD},
+        {0x58, "CLI", 1, 2, NoneAddressing, &CPU::CLI},
+        {0xb8, "CLV", 1, 2, NoneAddressing, &CPU::CLV},
+        {0x18, "CLC", 1, 2, NoneAddressing, &CPU::CLC},
+        {0x38, "SEC", 1, 2, NoneAddressing, &CPU::SEC},
+        {0x78, "SEI", 1, 2, NoneAddressing, &CPU::SEI},
+        {0xf8, "SED", 1, 2, NoneAddressing, &CPU::SED},
+
+        {0xaa, "TAX", 1, 2, NoneAddressing, &CPU::TAX},
+        {0xa8, "TAY", 1, 2, NoneAddressing, &CPU::TAY},
+        {0xba, "TSX", 1, 2, NoneAddressing, &CPU::TSX},
+        {0x8a, "TXA", 1, 2, NoneAddressing, &CPU::TXA},
+        {0x9a, "TXS", 1, 2, NoneAddressing, &CPU::TXS},
+        {0x98, "TYA", 1, 2, NoneAddressing, &CPU::TYA},
+
+        /* Stack */
+        {0x48, "PHA", 1, 3, NoneAddressing, &CPU::PHA},
+        {0x68, "PLA", 1, 4, NoneAddressing, &CPU::PLA},
+        {0x08, "PHP", 1, 3, NoneAddressing, &CPU::PHP},
+        {0x28, "PLP", 1, 4, NoneAddressing, &CPU::PLP},
+
+        /* unofficial */
+
+        {0xc7, "*DCP", 2, 5, ZeroPage, &CPU::DCP<ZeroPage>},
+        {0xd7, "*DCP", 2, 6, ZeroPage_X, &CPU::DCP<ZeroPage_X>},
+        {0xcf, "*DCP", 3, 6, Absolute, &CPU::DCP<Absolute>},
+        {0xdf, "*DCP", 3, 7, Absolute_X, &CPU::DCP<Absolute_X>},
+        {0xdb, "*DCP", 3, 7, Absolute_Y, &CPU::DCP<Absolute_Y>},
+        {0xd3, "*DCP", 2, 8, Indirect_Y, &CPU::DCP<Indirect_Y>},
+        {0xc3, "*DCP", 2, 8, Indirect_X, &CPU::DCP<Indirect_X>},
+
+        {0x27, "*RLA", 2, 5, ZeroPage, &CPU::RLA<ZeroPage>},
+        {0x37, "*RLA", 2, 6, ZeroPage_X, &CPU::RLA<ZeroPage_X>},
+        {0x2f, "*RLA", 3, 6, Absolute, &CPU::RLA<Absolute>},
+        {0x3f, "*RLA", 3, 7, Absolute_X, &CPU::RLA<Absolute_X>},
+        {0x3b, "*RLA", 3, 7, Absolute_Y, &CPU::RLA<Absolute_Y>},
+        {0x33, "*RLA", 2, 8, Indirect_Y, &CPU::RLA<Indirect_Y>},
+        {0x23, "*RLA", 2, 8, Indirect_X, &CPU::RLA<Indirect_X>},
+
+        {0x07, "*SLO", 2, 5, ZeroPage, &CPU::SLO<ZeroPage>},
+        {0x17, "*SLO", 2, 6, ZeroPage_X, &CPU::SLO<ZeroPage_X>},
+        {0x0f, "*SLO", 3, 6, Absolute, &CPU::SLO<Absolute>},
+        {0x1f, "*SLO", 3, 7, Absolute_X, &CPU::SLO<Absolute_X>},
+        {0x1b, "*SLO", 3, 7, Absolute_Y, &CPU::SLO<Absolute_Y>},
+        {0x03, "*SLO", 2, 8, Indirect_X, &CPU::SLO<Indirect_X>},
+        {0x13, "*SLO", 2, 8, Indirect_Y, &CPU::SLO<Indirect_Y>},
+
+        {0x47, "*SRE", 2, 5, ZeroPage, &CPU::SRE<ZeroPage>},
+        {0x57, "*SRE", 2, 6, ZeroPage_X, &CPU::SRE<ZeroPage_X>},
+        {0x4f, "*SRE", 3, 6, Absolute, &CPU::SRE<Absolute>},
+        {0x5f, "*SRE", 3, 7, Absolute_X, &CPU::SRE<Absolute_X>},
+        {0x5b, "*SRE", 3, 7, Absolute_Y, &CPU::SRE<Absolute_Y>},
+        {0x43, "*SRE", 2, 8, Indirect_X, &CPU::SRE<Indirect_X>},
+        {0x53, "*SRE", 2, 8, Indirect_Y, &CPU::SRE<Indirect_Y>},
+
+        {0x80, "*NOP", 2, 2, Immediate, &CPU::NOP},
+        {0x82, "*NOP", 2, 2, Immediate, &CPU::NOP},
+        {0x89, "*NOP", 2, 2, Immediate, &CPU::NOP},
+        {0xc2, "*NOP", 2, 2, Immediate, &CPU::NOP},
+        {0xe2, "*NOP", 2, 2, Immediate, &CPU::NOP},
+
+        {0xcb, "*AXS", 2, 2, Immediate, &CPU::AXS<Immediate>},
+
+        {0x6b, "*ARR", 2, 2, Immediate, &CPU::ARR<Immediate>},
+
+        {0xeb, "*SBC", 2, 2, Immediate, &CPU::SBC_UNOFFICIAL<Immediate>},
+
+        {0x0b, "*ANC", 2, 2, Immediate, &CPU::ANC<Immediate>},
+        {0x2b, "*ANC", 2, 2, Immediate, &CPU::ANC<Immediate>},
+
+        {0x4b, "*ALR", 2, 2, Immediate, &CPU::ALR<Immediate>},
+
+        {0x04, "*NOP", 2, 3, ZeroPage, &CPU::NOP_READ<ZeroPage>},
+        {0x44, "*NOP", 2, 3, ZeroPage, &CPU::NOP_READ<ZeroPage>},
+        {0x64, "*NOP", 2, 3, ZeroPage, &CPU::NOP_READ<ZeroPage>},
+        {0x14, "*NOP", 2, 4, ZeroPage_X, &CPU::NOP_READ<ZeroPage_X>},
+        {0x34, "*NOP", 2, 4, ZeroPage_X, &CPU::NOP_READ<ZeroPage_X>},
+        {0x54, "*NOP", 2, 4, ZeroPage_X, &CPU::NOP_READ<ZeroPage_X>},
+        {0x74, "*NOP", 2, 4, ZeroPage_X, &CPU::NOP_READ<ZeroPage_X>},
+        {0xd4, "*NOP", 2, 4, ZeroPage_X, &CPU::NOP_READ<ZeroPage_X>},
+        {0xf4, "*NOP", 2, 4, ZeroPage_X, &CPU::NOP_READ<ZeroPage_X>},
+        {0x0c, "*NOP", 3, 4, Absolute, &CPU::NOP_READ<Absolute>},
+        {0x1c, "*NOP", 3, 4 /*or 5*/, Absolute_X, &CPU::NOP_READ<Absolute_X>},
+        {0x3c, "*NOP", 3, 4 /*or 5*/, Absolute_X, &CPU::NOP_READ<Absolute_X>},
+        {0x5c, "*NOP", 3, 4 /*or 5*/, Absolute_X, &CPU::NOP_READ<Absolute_X>},
+        {0x7c, "*NOP", 3, 4 /*or 5*/, Absolute_X, &CPU::NOP_READ<Absolute_X>},
+        {0xdc, "*NOP", 3, 4 /* or 5*/, Absolute_X, &CPU::NOP_READ<Absolute_X>},
+        {0xfc, "*NOP", 3, 4 /* or 5*/, Absolute_X, &CPU::NOP_READ<Absolute_X>},
+
+        {0x67, "*RRA", 2, 5, ZeroPage, &CPU::RRA<ZeroPage>},
+        {0x77, "*RRA", 2, 6, ZeroPage_X, &CPU::RRA<ZeroPage_X>},
+        {0x6f, "*RRA", 3, 6, Absolute, &CPU::RRA<Absolute>},
+        {0x7f, "*RRA", 3, 7, Absolute_X, &CPU::RRA<Absolute_X>},
+        {0x7b, "*RRA", 3, 7, Absolute_Y, &CPU::RRA<Absolute_Y>},
+        {0x63, "*RRA", 2, 8, Indirect_X, &CPU::RRA<Indirect_X>},
+        {0x73, "*RRA", 2, 8, Indirect_Y, &CPU::RRA<Indirect_Y>},
+
+        {0xe7, "*ISB", 2, 5, ZeroPage, &CPU::ISB<ZeroPage>},
+        {0xf7, "*ISB", 2, 6, ZeroPage_X, &CPU::ISB<ZeroPage_X>},
+        {0xef, "*ISB", 3, 6, Absolute, &CPU::ISB<Absolute>},
+        {0xff, "*ISB", 3, 7, Absolute_X, &CPU::ISB<Absolute_X>},
+        {0xfb, "*ISB", 3, 7, Absolute_Y, &CPU::ISB<Absolute_Y>},
+        {0xe3, "*ISB", 2, 8, Indirect_X, &CPU::ISB<Indirect_X>},
+        {0xf3, "*ISB", 2, 8, Indirect_Y, &CPU::ISB<Indirect_Y>},
+
+        {0x02, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x12, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x22, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x32, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x42, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x52, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x62, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x72, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x92, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0xb2, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0xd2, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0xf2, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+
+        {0x1a, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x3a, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x5a, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0x7a, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0xda, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+        {0xfa, "*NOP", 1, 2, NoneAddressing, &CPU::NOP},
+
+        {0xab, "*LXA", 2, 3, Immediate, &CPU::LXA<Immediate>}, // todo: highly unstable and not used
+        // http://visual6502.org/wiki/index.php?title=6502_Opcode_8B_%28XAA,_ANE%29
+        {0x8b, "*XAA", 2, 3, Immediate, &CPU::XAA<Immediate>}, // todo: highly unstable and not used
+        {0xbb, "*LAS", 3, 2, Absolute_Y, &CPU::LAS<Absolute_Y>},
+        // todo: highly unstable and not used
+        {0x9b, "*TAS", 3, 2, Absolute_Y, &CPU::TAS},
+        // todo: highly unstable and not used
+        {0x93, "*AHX", 2, /* guess */ 8, Indirect_Y, &CPU::AHX_INDIRECT_Y},
+        // todo: highly unstable and not used
+        {0x9f, "*AHX", 3, /* guess */ 4 /* or 5*/, Absolute_Y, &CPU::AHX_ABSOLUTE_Y},
+        // todo: highly unstable and not used
+        {0x9e, "*SHX", 3, /* guess */ 4 /* or 5*/, Absolute_Y, &CPU::SHX},
+        // todo: highly unstable and not used
+        {0x9c, "*SHY", 3, /* guess */ 4 /* or 5*/, Absolute_X, &CPU::SHY},
+        // todo: highly unstable and not used
+
+        {0xa7, "*LAX", 2, 3, ZeroPage, &CPU::LAX<ZeroPage>},
+        {0xb7, "*LAX", 2, 4, ZeroPage_Y, &CPU::LAX<ZeroPage_Y>},
+        {0xaf, "*LAX", 3, 4, Absolute, &CPU::LAX<Absolute>},
+        {0xbf, "*LAX", 3, 4, Absolute_Y, &CPU::LAX<Absolute_Y>},
+        {0xa3, "*LAX", 2, 6, Indirect_X, &CPU::LAX<Indirect_X>},
+        {0xb3, "*LAX", 2, 5, Indirect_Y, &CPU::LAX<Indirect_Y>},
+
+        {0x87, "*SAX", 2, 3, ZeroPage, &CPU::SAX<ZeroPage>},
+        {0x97, "*SAX", 2, 4, ZeroPage_Y, &CPU::SAX<ZeroPage_Y>},
+        {0x8f, "*SAX", 3, 4, Absolute, &CPU::SAX<Absolute>},
+        {0x83, "*SAX", 2, 6, Indirect_X, &CPU::SAX<Indirect_X>},
+    };
+
+    std::array<BasicOpCode<Timing, BusT>, 256> table{};
+    for (const auto &op : opcodes)
+    {
+        table[op.code] = op;
+    }
+    return table;
+}
+
+constexpr std::array<OpCode, 256> OPCODE_TABLE = CPU::make_opcode_table();
+static_assert(
+    [] {
+        for (size_t i = 0; i < OPCODE_TABLE.size(); ++i)
+        {
+            if (OPCODE_TABLE[i].code != i || OPCODE_TABLE[i].handler == nullptr)
+            {
+                return false;
+            }
+        }
+        return true;
+    }(),
+    "every opcode needs a handler");
+
+template <typename Timing, typename BusT>
+const std::array<BasicOpCode<Timing, BusT>, 256> BasicCPU<Timing, BusT>::OPCODES = BasicCPU<Timing, BusT>::make_opcode_table();
+
+///////////////////////////////////////////////////////////////////////////////
+// Threaded interpreter core
+//
+// Direct-threaded variant of run_with_callback(). Instructions come from the
+// predecoded block cache, so opcode and operand bytes are not re-read through
+// the bus. It lives next to the opcode table so every handler call below is
+// resolved at compile time and can be inlined; each handler then takes the
+// next predecoded instruction and jumps straight to its label. There is no
+// per-instruction callback or DEBUG output, and the try block is entered only
+// once per runtime_error instead of once per instruction. Pairs the block
+// cache marked as superinstructions run both handlers from one label.
+#if defined(__GNUC__) || defined(__clang__)
+
+#define EM_FOR_EACH_OPCODE(X) \
+    X(00) X(01) X(02) X(03) X(04) X(05) X(06) X(07) X(08) X(09) X(0a) X(0b) X(0c) X(0d) X(0e) X(0f) \
+    X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(1a) X(1b) X(1c) X(1d) X(1e) X(1f) \
+    X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(2a) X(2b) X(2c) X(2d) X(2e) X(2f) \
+    X(30) X(31) X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(3a) X(3b) X(3c) X(3d) X(3e) X(3f) \
+    X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) X(49) X(4a) X(4b) X(4c) X(4d) X(4e) X(4f) \
+    X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(5a) X(5b) X(5c) X(5d) X(5e) X(5f) \
+    X(60) X(61) X(62) X(63) X(64) X(65) X(66) X(67) X(68) X(69) X(6a) X(6b) X(6c) X(6d) X(6e) X(6f) \
+    X(70) X(71) X(72) X(73) X(74) X(75) X(76) X(77) X(78) X(79) X(7a) X(7b) X(7c) X(7d) X(7e) X(7f) \
+    X(80) X(81) X(82) X(83) X(84) X(85) X(86) X(87) X(88) X(89) X(8a) X(8b) X(8c) X(8d) X(8e) X(8f) \
+    X(90) X(91) X(92) X(93) X(94) X(95) X(96) X(97) X(98) X(99) X(9a) X(9b) X(9c) X(9d) X(9e) X(9f) \
+    X(a0) X(a1) X(a2) X(a3) X(a4) X(a5) X(a6) X(a7) X(a8) X(a9) X(aa) X(ab) X(ac) X(ad) X(ae) X(af) \
+    X(b0) X(b1) X(b2) X(b3) X(b4) X(b5) X(b6) X(b7) X(b8) X(b9) X(ba) X(bb) X(bc) X(bd) X(be) X(bf) \
+    X(c0) X(c1) X(c2) X(c3) X(c4) X(c5) X(c6) X(c7) X(c8) X(c9) X(ca) X(cb) X(cc) X(cd) X(ce) X(cf) \
+    X(d0) X(d1) X(d2) X(d3) X(d4) X(d5) X(d6) X(d7) X(d8) X(d9) X(da) X(db) X(dc) X(dd) X(de) X(df) \
+    X(e0) X(e1) X(e2) X(e3) X(e4) X(e5) X(e6) X(e7) X(e8) X(e9) X(ea) X(eb) X(ec) X(ed) X(ee) X(ef) \
+    X(f0) X(f1) X(f2) X(f3) X(f4) X(f5) X(f6) X(f7) X(f8) X(f9) X(fa) X(fb) X(fc) X(fd) X(fe) X(ff)
+
+template <> void CPU::run_threaded()
+{
+#define EM_OPCODE_LABEL(n) &&op_##n,
+#define EM_FUSED_LABEL(a, b) &&fused_##a##_##b,
+    // Opcodes, then superinstructions from number 1 up
+    static void *const dispatch_table[256 + std::size(SUPERINSTRUCTIONS)] = {
+        EM_FOR_EACH_OPCODE(EM_OPCODE_LABEL) EM_FOR_EACH_SUPERINSTRUCTION(EM_FUSED_LABEL)};
+#undef EM_FUSED_LABEL
+#undef EM_OPCODE_LABEL
+
+    const OpCode *op = nullptr;
+    uint16_t state = 0;
+
+    set_status(registers.p);
+    StatusWriteBack write_back{*this};
+
+    // Position in the current basic block
+    const DecodedInstruction *cursor = nullptr;
+    const DecodedInstruction *end = nullptr;
+    // The bus mapping the block was decoded under; a bank switch leaves it
+    uint32_t map_generation = bus->map_generation;
+    IdleLoopSkipper idle_loop(bus->rom);
+
+    while (true)
+    {
+        try
+        {
+#define EM_DISPATCH()                                                                                                   \
+    do                                                                                                                  \
+    {                                                                                                                   \
+        if (bus->nmi_pending() || bus->irq_pending())                                                                   \
+        {                                                                                                               \
+            poll_interrupts();                                                                                          \
+        }                                                                                                               \
+        if (bus->ram_code_dirty)                                                                                        \
+        {                                                                                                               \
+            block_cache.invalidate_dirty_pages(*bus);                                                                   \
+            cursor = end = nullptr;                                                                                     \
+        }                                                                                                               \
+        if (bus->map_generation != map_generation)                                                                      \
+        {                                                                                                               \
+            map_generation = bus->map_generation;                                                                       \
+            cursor = end = nullptr;                                                                                     \
+        }                                                                                                               \
+        if (cursor == end || cursor->pc != registers.pc)                                                                \
+        {                                                                                                               \
+            if (const BasicBlock *block = block_cache.lookup(*bus, registers.pc))                                       \
+            {                                                                                                           \
+                if (block->loops_to_start)                                                                              \
+                {                                                                                                       \
+                    idle_loop.enter(*this, *block);                                                                     \
+                    if (block->loop_idiom)                                                                              \
+                    {                                                                                                   \
+                        LoopIdiom::run(*this, *block);                                                                  \
+                    }                                                                                                   \
+                }                                                                                                       \
+                else                                                                                                    \
+                {                                                                                                       \
+                    idle_loop.leave();                                                                                  \
+                }                                                                                                       \
+                cursor = block->instructions.data();                                                                    \
+                end = cursor + block->instructions.size();                                                              \
+            }                                                                                                           \
+            else                                                                                                        \
+            {                                                                                                           \
+                goto interpret;                                                                                         \
+            }                                                                                                           \
+        }                                                                                                               \
+        const DecodedInstruction *instruction = cursor++;                                                               \
+        registers.pc = static_cast<uint16_t>(instruction->pc + 1);                                                      \
+        state = registers.pc;                                                                                           \
+        operand = instruction->operand;                                                                                 \
+        goto *dispatch_table[instruction->fused ? 255 + instruction->fused : instruction->code];                        \
+    } while (false)
+
+#define EM_EXECUTE(n)                                                                                                   \
+    do                                                                                                                  \
+    {                                                                                                                   \
+        constexpr const OpCode &entry = OPCODE_TABLE[0x##n];                                                            \
+        op = &entry;                                                                                                    \
+        (this->*entry.handler)();                                                                                       \
+        bus->tick(entry.cycles);                                                                                        \
+        if (state == registers.pc)                                                                                      \
+        {                                                                                                               \
+            registers.pc += static_cast<uint16_t>(entry.len - 1);                                                       \
+        }                                                                                                               \
+    } while (false)
+
+#define EM_OPCODE_BODY(n)                                                                                               \
+    op_##n:                                                                                                             \
+    {                                                                                                                   \
+        EM_EXECUTE(n);                                                                                                  \
+        EM_DISPATCH();                                                                                                  \
+    }
+
+// The second half is skipped for a plain dispatch whenever that would do more
+// than run the next instruction: after an interrupt, a write to code in RAM
+// or a bank switch
+#define EM_FUSED_BODY(a, b)                                                                                             \
+    fused_##a##_##b:                                                                                                    \
+    {                                                                                                                   \
+        EM_EXECUTE(a);                                                                                                  \
+        if (bus->nmi_pending() || bus->irq_pending() || bus->ram_code_dirty ||                                          \
+            bus->map_generation != map_generation)                                                                      \
+        {                                                                                                               \
+            EM_DISPATCH();                                                                                              \
+        }                                                                                                               \
+        const DecodedInstruction *second = cursor++;                                                                    \
+        registers.pc = static_cast<uint16_t>(second->pc + 1);                                                          \
+        state = registers.pc;                                                                                           \
+        operand = second->operand;                                                                                      \
+        EM_EXECUTE(b);                                                                                                  \
+        EM_DISPATCH();                                                                                                  \
+    }
+
+            EM_DISPATCH();
+            EM_FOR_EACH_OPCODE(EM_OPCODE_BODY)
+            EM_FOR_EACH_SUPERINSTRUCTION(EM_FUSED_BODY)
+
+            // PCs the block cache leaves out, those on watched pages among
+            // them, run through the interpreter so watchpoints see them
+        interpret:
+            step();
+            EM_DISPATCH();
+
+#undef EM_FUSED_BODY
+#undef EM_OPCODE_BODY
+#undef EM_EXECUTE
+#undef EM_DISPATCH
+        }
+        catch (const std::runtime_error &e)
+        {
+            // Same recovery as the portable core: report, then finish the instruction
+            std::cerr << "Runtime error: " << e.what();
+            std::cerr << " Opcode: " << op->mnemonic << " 0x" << std::hex << static_cast<int>(op->code);
+            std::cerr << " PC: " << registers.pc;
+            std::cerr << std::endl;
+
+            bus->tick(op->cycles);
+            if (state == registers.pc)
+            {
+                registers.pc += static_cast<uint16_t>(op->len - 1);
+            }
+        }
+    }
+}
+
+#undef EM_FOR_EACH_OPCODE
+
+#else
+
+template <> void CPU::run_threaded()
+{
+    // Labels-as-values are a GCC/Clang extension; fall back to the portable core
+    run_with_callback(NoHook{});
+}
+
+#endif
+
+template class BasicCPU<InstructionStep>;
+template class BasicCPU<CycleStep>;
+template class BasicCPU<InstructionStep, FlatBus>;
 } // namespace EM
@@ -6,13 +6,19 @@
 #ifndef MYNESEMULATOR__CPU_H_
 #define MYNESEMULATOR__CPU_H_
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <type_traits>
 #include <vector>
 
 #include "../bus/bus.h"
+#include "../bus/flat_bus.h"
+#include "block_cache.h"
+#include "hooks.h"
 #include "op_code.h"
+#include "timing.h"
 
 namespace EM
 {
@@ -24,7 +30,7 @@ struct Registers
     uint8_t y = 0x00;   // index register y
     uint8_t sp = 0x00;  // stack pointer
     uint16_t pc = 0x00; // program counter
-    uint8_t p = 0x00;   // process status (flag)
+    uint8_t p = 0x00;   // process status (flag), see BasicCPU::status()
 };
 
 // Flags
@@ -40,10 +46,29 @@ enum CpuFlags
     N = (0b10000000), // Negative
 };
 
+// N, Z, C and V in the form instructions produce them, so most instructions
+// store a byte instead of updating P bit by bit
+struct LazyFlags
+{
+    uint8_t n = 0; // N is bit 7 of this
+    uint8_t z = 1; // Z is set when this is zero
+    bool c = false;
+    bool v = false;
+};
+
+// Why a bounded run (run_cycles, run_instructions, run_frame) returned
+enum class RunStatus
+{
+    FrameCompleted,  // a vblank NMI was raised, so the PPU has a finished frame
+    BudgetExhausted, // the cycle or instruction budget was spent
+    Fault,           // an instruction handler threw; it was reported and skipped
+};
+
 enum class InterruptType
 {
     NMI,
 	BRK,
+    IRQ,
 };
 
 class Interrupt
@@ -60,34 +85,47 @@ class Interrupt
     }
 };
 
-class CPU
+// 6502 core, templated on its timing policy (cpu/timing.h) and its bus.
+// CPU is the instruction-stepped core; CycleCPU ticks the bus on every
+// access. BusT is called directly, so inline read/write fast paths compile
+// into the instruction handlers. Besides Bus, FlatBus runs the interpreter
+// on plain memory for tests.
+template <typename Timing, typename BusT> class BasicCPU
 {
   public:
-    CPU();
-    CPU(EM::Bus *bus);
-    ~CPU();
+    BasicCPU();
+    BasicCPU(BusT *bus);
+    ~BasicCPU();
 
-    // egisters
+    // Registers
     EM::Registers registers;
+    // Operand bytes (little endian) of the instruction being executed
+    uint16_t operand = 0;
+    // N/Z/C/V while the interpreter runs. registers.p holds the other bits,
+    // and is brought up to date when a run loop calls back, returns or throws.
+    LazyFlags flags;
 
-    // Opcode map
-    const std::unordered_map<uint8_t, std::shared_ptr<OpCode>> &opcode_map =
-        EM::OpCodeSingleton::get_instance().get_opcode_map();
-    const std::vector<std::shared_ptr<OpCode>> &opcodes = EM::OpCodeSingleton::get_instance().get_opcodes();
+    // The full P byte, valid at any time
+    uint8_t status() const;
+    // Sets registers.p and the lazy flags. Code that changes registers.p
+    // itself (the JIT and AOT cores) calls it before interpreter code runs.
+    void set_status(uint8_t p);
 
     // Linkage with bus
-    EM::Bus *bus = nullptr;
+    BusT *bus = nullptr;
 
     // Connect with bus
-    void connect_bus(EM::Bus *b)
+    void connect_bus(BusT *b)
     {
         bus = b;
     }
 
     // Read & write from & to the bus
-    uint8_t read(uint16_t addr) const;
+    uint8_t read(uint16_t addr);
     void write(uint16_t addr, uint8_t data);
-    uint16_t read_u16(uint16_t addr) const;
+    // An opcode fetch, which only execute watchpoints see
+    uint8_t fetch(uint16_t addr);
+    uint16_t read_u16(uint16_t addr);
     void write_u16(uint16_t addr, uint16_t data);
 
     // Load and reset functions
@@ -95,8 +133,28 @@ class CPU
     void load(std::vector<uint8_t> program);
     void load_and_run(std::vector<uint8_t> program);
     void run();
-    void run_with_callback(std::function<void(CPU &)> callback);
+    // Portable interpreter calling hook(*this) before every instruction;
+    // with NoHook the loop carries no hook code at all
+    template <typename Hook> void run_with_callback(Hook &&hook);
+    // Computed-goto core over the predecoded block cache, without the
+    // per-instruction callback; run() uses it when built with NES_THREADED_CORE
+    void run_threaded();
+    // Dynamic recompiler (cpu/jit_x64.cpp); run() uses it when built with
+    // NES_JIT. Falls back to the threaded core off x86-64.
+    void run_jit();
+    // Ahead-of-time translated blocks of one ROM (aot/aot_runtime.cpp); only
+    // linked into emulator_aot, where run() uses it
+    void run_aot();
+    // Bounded runs on the interpreter for hosts that drive the frame loop
+    // themselves. Each returns after the instruction that finished a frame,
+    // faulted or spent the budget, with registers.p up to date.
+    RunStatus run_cycles(size_t cycles);
+    RunStatus run_instructions(size_t count);
+    RunStatus run_frame();
     void interrupt(Interrupt i);
+    // Takes the NMI if the PPU raised it, or the IRQ if a device asserts it
+    // and the I flag lets it in. Run loops call it between instructions.
+    void poll_interrupts();
 
   private:
     // Get and update flag
@@ -105,6 +163,20 @@ class CPU
     void update_zero_and_negative_flags(const uint8_t result);
     void update_negative_flags(const uint8_t result);
 
+    // Timing policy hooks. Under CycleStep every read() and write() ticks
+    // one cycle, counted in bus_cycles.
+    uint8_t bus_cycles = 0;
+    void dummy_read(uint16_t addr);
+    void dummy_write(uint16_t addr, uint8_t data);
+    // Cycle added by a taken branch or its page cross; CycleStep spends it
+    // on the dummy read of addr
+    void extra_cycle(uint16_t addr);
+    // Cycle added when an indexed read crossed a page; CycleStep has spent it
+    // on the dummy read already
+    void page_cross_cycle();
+    // Ticks the cycles of an instruction or interrupt not yet ticked
+    void finish_cycles(uint8_t cycles);
+
     // set registers and stack
     void set_register_a(const uint8_t value);
     void add_to_register_a(uint8_t data);
@@ -120,46 +192,198 @@ class CPU
 
   private:
     /*** Instructions ***/
-    void LDY(const AddressingMode &mode);
-    void LDX(const AddressingMode &mode);
-    void LDA(const AddressingMode &mode);
-    void STA(const AddressingMode &mode);
-    void AND(const AddressingMode &mode);
-    void EOR(const AddressingMode &mode);
-    void ORA(const AddressingMode &mode);
+    // Handlers are dispatched through OPCODE_TABLE; memory operand handlers
+    // are specialised on their addressing mode.
+    template <AddressingMode M> void LDY();
+    template <AddressingMode M> void LDX();
+    template <AddressingMode M> void LDA();
+    template <AddressingMode M> void STA();
+    template <AddressingMode M> void STX();
+    template <AddressingMode M> void STY();
+    template <AddressingMode M> void AND();
+    template <AddressingMode M> void EOR();
+    template <AddressingMode M> void ORA();
+    template <AddressingMode M> void SBC();
+    template <AddressingMode M> void ADC();
+    template <AddressingMode M> void ASL();
+    template <AddressingMode M> void LSR();
+    template <AddressingMode M> void ROL();
+    template <AddressingMode M> void ROR();
+    template <AddressingMode M> void INC();
+    template <AddressingMode M> void DEC();
+    template <AddressingMode M> void BIT();
+    template <AddressingMode M> void CMP();
+    template <AddressingMode M> void CPX();
+    template <AddressingMode M> void CPY();
     void TAX();
+    void TAY();
+    void TSX();
+    void TXA();
+    void TXS();
+    void TYA();
     void INX();
     void INY();
-    void SBC(const AddressingMode &mode);
-    void ADC(const AddressingMode &mode);
-    uint8_t ASL(const AddressingMode &mode);
-    uint8_t LSR(const AddressingMode &mode);
-    uint8_t ROL(const AddressingMode &mode);
-    uint8_t ROR(const AddressingMode &mode);
-    uint8_t INC(const AddressingMode &mode);
     void DEX();
     void DEY();
-    uint8_t DEC(const AddressingMode &mode);
+    void PHA();
     void PLA();
     void PLP();
     void PHP();
-    void BIT(const AddressingMode &mode);
-    void COMPARE(const AddressingMode &mode, uint8_t compare_with);
+    void BRK();
+    void NOP();
+    void CLC();
+    void CLD();
+    void CLI();
+    void CLV();
+    void SEC();
+    void SED();
+    void SEI();
+    void JMP();
+    void JMP_INDIRECT();
+    void JSR();
+    void RTS();
+    void RTI();
+    void BCC();
+    void BCS();
+    void BEQ();
+    void BMI();
+    void BNE();
+    void BPL();
+    void BVC();
+    void BVS();
+
+    /* Unofficial */
+    template <AddressingMode M> void DCP();
+    template <AddressingMode M> void RLA();
+    template <AddressingMode M> void SLO();
+    template <AddressingMode M> void SRE();
+    template <AddressingMode M> void AXS();
+    template <AddressingMode M> void ARR();
+    template <AddressingMode M> void SBC_UNOFFICIAL();
+    template <AddressingMode M> void ANC();
+    template <AddressingMode M> void ALR();
+    template <AddressingMode M> void NOP_READ();
+    template <AddressingMode M> void RRA();
+    template <AddressingMode M> void ISB();
+    template <AddressingMode M> void LAX();
+    template <AddressingMode M> void SAX();
+    template <AddressingMode M> void LXA();
+    template <AddressingMode M> void XAA();
+    template <AddressingMode M> void LAS();
+    void TAS();
+    void AHX_INDIRECT_Y();
+    void AHX_ABSOLUTE_Y();
+    void SHX();
+    void SHY();
+
+    // Read-modify-write helpers, returning the value written back
+    template <AddressingMode M> uint8_t asl_memory();
+    template <AddressingMode M> uint8_t lsr_memory();
+    template <AddressingMode M> uint8_t rol_memory();
+    template <AddressingMode M> uint8_t ror_memory();
+    template <AddressingMode M> uint8_t inc_memory();
+    template <AddressingMode M> uint8_t dec_memory();
+    template <AddressingMode M> void COMPARE(uint8_t compare_with);
     void BRANCH(bool condition);
 
 	bool page_cross(uint16_t addr1, uint16_t addr2);
 
   public:
     std::pair<uint16_t, bool> get_absolute_address(const AddressingMode &mode, uint16_t addr);
-    std::pair<uint16_t, bool> get_operand_address(const AddressingMode &mode);
+    std::pair<uint16_t, bool> resolve_operand_address(const AddressingMode &mode, uint16_t value);
+    // Operand address of a store or read-modify-write; indexed modes always
+    // read the address before the carry is fixed, as the 6502 does
+    template <AddressingMode M> std::pair<uint16_t, bool> get_operand_address();
+    // Indexed reads only take that dummy read when they cross a page
+    template <AddressingMode M> std::pair<uint8_t, bool> read_operand();
+    uint16_t fetch_operand(uint16_t addr, uint8_t len);
+
+    // Binds every opcode to its handler, used to build OPCODE_TABLE
+    static constexpr std::array<BasicOpCode<Timing, BusT>, 256> make_opcode_table();
+    // Same table for this timing policy; OPCODE_TABLE is CPU's
+    static const std::array<BasicOpCode<Timing, BusT>, 256> OPCODES;
 
   private:
-    const uint16_t STACK = 0x0100;
-    const uint8_t STACK_RESET = 0xfd;
+    template <AddressingMode M> std::pair<uint16_t, bool> get_indexed_address();
+
+    // One fetch/execute of the interpreter; false if the handler threw
+    bool step();
+    template <typename Done> RunStatus run_until(Done done);
+
+    // Writes the lazy flags back to registers.p however a run loop is left
+    struct StatusWriteBack
+    {
+        BasicCPU &cpu;
+        ~StatusWriteBack()
+        {
+            cpu.registers.p = cpu.status();
+        }
+    };
+
+    static constexpr uint16_t STACK = 0x0100;
+    static constexpr uint8_t STACK_RESET = 0xfd;
+
+  public:
+    // Predecoded instructions used by the threaded core. Declared last: the
+    // core only reaches it on a block change, so it stays behind the
+    // registers, flags, bus pointer and bus_cycles every instruction uses.
+    BlockCache block_cache;
 };
+
+using CycleCPU = BasicCPU<CycleStep>;
+// Interpreter on 64 KiB of RAM, without a PPU (bus/flat_bus.h)
+using FlatCPU = BasicCPU<InstructionStep, FlatBus>;
+
+// Defined for the instruction-stepped core only
+template <> void CPU::run_threaded();
+template <> void CPU::run_jit();
+template <> void CPU::run_aot();
+
+extern template class BasicCPU<InstructionStep>;
+extern template class BasicCPU<CycleStep>;
+extern template class BasicCPU<InstructionStep, FlatBus>;
+
 // Define the NMI interrupt as a constant instance of Interrupt
-	static const Interrupt NMI(InterruptType::NMI, 0xfffa, 0b00100000, 2);
-	static const Interrupt BRK(InterruptType::BRK, 0xfffe, 0b00110000, 1);
+    static const Interrupt NMI(InterruptType::NMI, 0xfffa, 0b00100000, 2);
+    static const Interrupt BRK(InterruptType::BRK, 0xfffe, 0b00110000, 1);
+    static const Interrupt IRQ(InterruptType::IRQ, 0xfffe, 0b00100000, 2);
+
+template <typename Timing, typename BusT> inline void BasicCPU<Timing, BusT>::poll_interrupts()
+{
+    if (bus->nmi_pending())
+    {
+        interrupt(NMI);
+    }
+    else if (bus->irq_pending() && !(registers.p & I))
+    {
+        interrupt(IRQ);
+    }
+}
+
+template <typename Timing, typename BusT>
+template <typename Hook>
+void BasicCPU<Timing, BusT>::run_with_callback(Hook &&hook)
+{
+    set_status(registers.p);
+    StatusWriteBack write_back{*this};
+
+    while (true)
+    {
+        if (bus->nmi_pending() || bus->irq_pending())
+        {
+            poll_interrupts();
+        }
+
+        if constexpr (!std::is_same_v<std::decay_t<Hook>, NoHook>)
+        {
+            registers.p = status();
+            hook(*this);
+            set_status(registers.p);
+        }
+
+        step();
+    }
+}
 } // namespace EM
 
 #endif // MYNESEMULATOR__CPU_H_
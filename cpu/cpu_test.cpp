@@ -1,66 +1,114 @@
-#include "../bus/bus.h"
+#include "../bus/flat_bus.h"
+#include "../cartridge/rom_db.h"
+#include "../cheats/cheats.h"
+#include "../console/console.h"
 #include "cpu.h"
+#include "superinstructions.h"
 #include <SDL.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
+// The bundled games, relative to cpu/ where the tests run
+#ifndef NES_ROM_DIR
+#define NES_ROM_DIR "../game_roms"
+#endif
+
+// Loads program at $0600 of a flat bus, points the reset vector at it and
+// runs it up to its first BRK
+void run_program(EM::FlatCPU &cpu, const std::vector<uint8_t> &program)
+{
+    cpu.bus->write(0xfffc, 0x00);
+    cpu.bus->write(0xfffd, 0x06);
+    cpu.load(program);
+    cpu.reset();
+    while (cpu.bus->read(cpu.registers.pc) != 0x00)
+    {
+        cpu.run_instructions(1);
+    }
+}
+
 void test_ops_working_together()
 {
-    auto cpu = EM::CPU();
-    cpu.load_and_run(std::vector<uint8_t>{0xa9, 0xc0, 0xaa, 0xe8, 0x00});
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
+    run_program(cpu, std::vector<uint8_t>{0xa9, 0xc0, 0xaa, 0xe8, 0x00});
     assert(0xc1 == cpu.registers.x);
 }
 
 void test_0xa9_lda_immediate_load_data()
 {
-    auto cpu = EM::CPU();
-    cpu.load_and_run(std::vector<uint8_t>{0xa9, 0x05, 0x00});
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
+    run_program(cpu, std::vector<uint8_t>{0xa9, 0x05, 0x00});
 
     assert(0x5 == cpu.registers.a);
-    assert(0x5 == cpu.read(0x8001));
+    assert(0x5 == cpu.read(0x0601));
     assert(0b00 == (cpu.registers.p & 0b0000'0010));
-    assert(0b00 == (cpu.registers.p & 0b0000'0000));
+    assert(0b00 == (cpu.registers.p & 0b1000'0000));
 }
 
 void test_5_ops_working_together()
 {
-    auto cpu = EM::CPU();
-    cpu.load_and_run(std::vector<uint8_t>{0xa9, 0xc0, 0xaa, 0xe8, 0x00});
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
+    run_program(cpu, std::vector<uint8_t>{0xa9, 0xc0, 0xaa, 0xe8, 0x00});
     assert(0xc1 == cpu.registers.x);
 }
 
 void test_0xaa_tax_move_to_x()
 {
-    auto cpu = EM::CPU();
-    cpu.load(std::vector<uint8_t>{0xaa, 0x00});
-    cpu.reset();
-    cpu.registers.a = 10;
-    cpu.run();
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
+    run_program(cpu, std::vector<uint8_t>{0xa9, 0x0a, 0xaa, 0x00});
     assert(10 == cpu.registers.x);
 }
 
 void test_inx_overflow()
 {
-    auto cpu = EM::CPU();
-    cpu.load(std::vector<uint8_t>{0xe8, 0xe8, 0x00});
-    cpu.reset();
-    cpu.registers.x = 0xff;
-    cpu.run();
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
+    run_program(cpu, std::vector<uint8_t>{0xa2, 0xff, 0xe8, 0xe8, 0x00});
     assert(1 == cpu.registers.x);
 }
 
 void test_lda_from_memory()
 {
-    auto cpu = EM::CPU();
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
     cpu.write(0x10, 0x55);
-    cpu.load_and_run(std::vector<uint8_t>{0xa5, 0x10, 0x00});
+    run_program(cpu, std::vector<uint8_t>{0xa5, 0x10, 0x00});
     assert(0x55 == cpu.registers.a);
 }
 
+void test_cycles()
+{
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
+    // LDX #0; DEX; BNE -3: 2 + 256 * 2 + 255 * 3 + 2
+    run_program(cpu, std::vector<uint8_t>{0xa2, 0x00, 0xca, 0xd0, 0xfd, 0x00});
+    assert(0 == cpu.registers.x);
+    assert(2 + 256 * 2 + 255 * 3 + 2 == bus.cycles);
+
+    // An empty budget runs nothing
+    auto pc = cpu.registers.pc;
+    assert(cpu.run_instructions(0) == EM::RunStatus::BudgetExhausted);
+    assert(cpu.registers.pc == pc && 2 + 256 * 2 + 255 * 3 + 2 == bus.cycles);
+    assert(cpu.run_cycles(0) == EM::RunStatus::BudgetExhausted);
+    assert(cpu.registers.pc == pc && 2 + 256 * 2 + 255 * 3 + 2 == bus.cycles);
+}
+
 void test_game()
 {
-    auto cpu = EM::CPU();
+    EM::FlatBus bus;
+    EM::FlatCPU cpu(&bus);
     std::vector<uint8_t> game_code{
         0x20, 0x06, 0x06, 0x20, 0x38, 0x06, 0x20, 0x0d, 0x06, 0x20, 0x2a, 0x06, 0x60, 0xa9, 0x02, 0x85, 0x02, 0xa9,
         0x04, 0x85, 0x03, 0xa9, 0x11, 0x85, 0x10, 0xa9, 0x10, 0x85, 0x12, 0xa9, 0x0f, 0x85, 0x14, 0xa9, 0x04, 0x85,
@@ -80,8 +128,1086 @@ void test_game()
         0x10, 0x29, 0x1f, 0xc9, 0x1f, 0xf0, 0x01, 0x60, 0x4c, 0x35, 0x07, 0xa0, 0x00, 0xa5, 0xfe, 0x91, 0x00, 0x60,
         0xa6, 0x03, 0xa9, 0x00, 0x81, 0x10, 0xa2, 0x00, 0xa9, 0x01, 0x81, 0x10, 0x60, 0xa2, 0x00, 0xea, 0xea, 0xca,
         0xd0, 0xfb, 0x60};
+    cpu.write(0xfffc, 0x00);
+    cpu.write(0xfffd, 0x06);
     cpu.load(game_code);
     cpu.reset();
+    cpu.run_instructions(1000);
+}
+
+// One-bank NROM image running program from $8000, with NMI at nmi_offset
+std::vector<uint8_t> make_rom(const std::vector<uint8_t> &program, uint16_t nmi_offset)
+{
+    std::vector<uint8_t> image{'N', 'E', 'S', 0x1a, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<uint8_t> prg(0x4000, 0xea);
+    std::copy(program.begin(), program.end(), prg.begin());
+    auto nmi = static_cast<uint16_t>(0x8000 + nmi_offset);
+    prg[0x3ffa] = static_cast<uint8_t>(nmi);
+    prg[0x3ffb] = static_cast<uint8_t>(nmi >> 8);
+    prg[0x3ffc] = 0x00;
+    prg[0x3ffd] = 0x80;
+    image.insert(image.end(), prg.begin(), prg.end());
+    image.resize(image.size() + 0x2000);
+    return image;
+}
+
+struct Stop
+{
+};
+
+// Runs rom on the threaded core until the third vblank NMI
+void run_threaded(EM::Console &console)
+{
+    console.cpu.reset();
+    try
+    {
+        console.cpu.run_threaded();
+    }
+    catch (const Stop &)
+    {
+    }
+}
+
+// Runs rom on the portable core until the frame callback stops it
+void run_interpreted(EM::Console &console)
+{
+    console.cpu.reset();
+    try
+    {
+        console.cpu.run_with_callback(EM::NoHook{});
+    }
+    catch (const Stop &)
+    {
+    }
+}
+
+// Both consoles stopped in the same cycle with the same CPU, RAM and VRAM
+template <typename ConsoleA, typename ConsoleB> void assert_same_state(const ConsoleA &a, const ConsoleB &b)
+{
+    assert(a.bus.cycles == b.bus.cycles);
+    assert(a.cpu.registers.pc == b.cpu.registers.pc && a.cpu.registers.sp == b.cpu.registers.sp);
+    assert(a.cpu.registers.a == b.cpu.registers.a && a.cpu.registers.x == b.cpu.registers.x);
+    assert(a.cpu.registers.y == b.cpu.registers.y && a.cpu.registers.p == b.cpu.registers.p);
+    assert(a.bus.ram == b.bus.ram && a.bus.ppu.vram == b.bus.ppu.vram);
+}
+
+// Every superinstruction against its two instructions dispatched one by one.
+// The pair runs in a loop over varied registers, flags and memory, logging
+// A, X, Y and P after each iteration to $0300-$06FF, until the third vblank.
+// The runs must end in the same cycle with the same registers and RAM.
+void test_superinstructions()
+{
+    for (const auto &pair : EM::SUPERINSTRUCTIONS)
+    {
+        std::vector<uint8_t> program{
+            0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+            0xa9, 0x00, 0x85, 0x00,       // LDA #0; STA $00
+        };
+        auto loop = static_cast<uint16_t>(0x8000 + program.size());
+        std::vector<uint8_t> setup{
+            0xa5, 0x00, 0x8d, 0x10, 0x02, // LDA $00; STA $0210
+            0x49, 0xa5, 0x85, 0x10,       // EOR #$a5; STA $10
+            0xa8, 0xa6, 0x00,             // TAY; LDX $00
+            0xa5, 0x00, 0x4a, 0x65, 0x10, // LDA $00; LSR A; ADC $10
+        };
+        program.insert(program.end(), setup.begin(), setup.end());
+
+        auto pair_pc = static_cast<uint16_t>(0x8000 + program.size());
+        for (auto code : {pair.first, pair.second})
+        {
+            const EM::OpCode &op = EM::OPCODE_TABLE[code];
+            program.push_back(code);
+            if (op.len == 3)
+            {
+                // $0210, or $0210 plus the index
+                program.push_back(0x10);
+                program.push_back(0x02);
+            }
+            else if (op.len == 2)
+            {
+                // Branches fall through either way; otherwise #$80 or $10
+                program.push_back(op.mode == EM::Immediate ? 0x80 : op.mode == EM::NoneAddressing ? 0x00 : 0x10);
+            }
+        }
+
+        std::vector<uint8_t> log{
+            0x08, 0x85, 0x01, 0x86, 0x02, 0x84, 0x03, 0xa4, 0x00, // PHP; STA $01; STX $02; STY $03; LDY $00
+            0xa5, 0x01, 0x99, 0x00, 0x03,                         // LDA $01; STA $0300,Y
+            0xa5, 0x02, 0x99, 0x00, 0x04,                         // LDA $02; STA $0400,Y
+            0xa5, 0x03, 0x99, 0x00, 0x05,                         // LDA $03; STA $0500,Y
+            0x68, 0x99, 0x00, 0x06,                               // PLA; STA $0600,Y
+            0xe6, 0x00,                                           // INC $00
+            0x4c, static_cast<uint8_t>(loop), static_cast<uint8_t>(loop >> 8),
+        };
+        program.insert(program.end(), log.begin(), log.end());
+        auto nmi_offset = static_cast<uint16_t>(program.size());
+        // NMI: RTI
+        program.push_back(0x40);
+
+        EM::Rom rom(make_rom(program, nmi_offset));
+        size_t fused_frames = 0;
+        size_t plain_frames = 0;
+        EM::Console fused(rom, [&](EM::NesPPU &, EM::Joypad &) {
+            if (++fused_frames == 3)
+            {
+                throw Stop{};
+            }
+        });
+        EM::Console plain(rom, [&](EM::NesPPU &, EM::Joypad &) {
+            if (++plain_frames == 3)
+            {
+                throw Stop{};
+            }
+        });
+        plain.cpu.block_cache.superinstructions = false;
+
+        run_threaded(fused);
+        run_threaded(plain);
+
+        const EM::BasicBlock *block = fused.cpu.block_cache.lookup(fused.bus, loop);
+        assert(block != nullptr);
+        bool marked = false;
+        for (const auto &instruction : block->instructions)
+        {
+            marked = marked || (instruction.pc == pair_pc && instruction.fused != 0);
+        }
+        assert(marked);
+
+        assert(fused.bus.cycles == plain.bus.cycles);
+        assert(fused.cpu.registers.pc == plain.cpu.registers.pc);
+        assert(fused.cpu.registers.a == plain.cpu.registers.a);
+        assert(fused.cpu.registers.x == plain.cpu.registers.x);
+        assert(fused.cpu.registers.y == plain.cpu.registers.y);
+        assert(fused.cpu.registers.sp == plain.cpu.registers.sp);
+        assert(fused.cpu.registers.p == plain.cpu.registers.p);
+        assert(fused.bus.ram == plain.bus.ram);
+    }
+}
+
+// Both loop idioms, a RAM fill and a PPUDATA upload from a ROM table,
+// batched by the threaded core against the interpreter. Each pass starts the
+// loops at a new index and the NMI handler bumps a counter, so over three
+// frames batches end at vblank and the NMI lands inside the loops. Then the
+// same with a watchpoint on a filled byte and on an uploaded one, which must
+// report the interpreter's hits.
+void test_loop_idioms()
+{
+    std::vector<uint8_t> program{
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+        0xe6, 0x10, 0xa5, 0x10,       // $8005: INC $10; LDA $10
+        0xa6, 0x10,                   // LDX $10
+        0x9d, 0x00, 0x02,             // $800B: STA $0200,X
+        0xe8, 0xd0, 0xfa,             // INX; BNE $800B
+        0xa9, 0x20, 0x8d, 0x06, 0x20, // LDA #$20; STA $2006
+        0xa5, 0x10, 0x8d, 0x06, 0x20, // LDA $10; STA $2006
+        0xa4, 0x10,                   // LDY $10
+        0xb9, 0x00, 0x81,             // $801D: LDA $8100,Y
+        0x8d, 0x07, 0x20,             // STA $2007
+        0xc8, 0xd0, 0xf7,             // INY; BNE $801D
+        0x4c, 0x05, 0x80,             // JMP $8005
+        0xe6, 0x11, 0x40,             // NMI: INC $11; RTI
+    };
+    program.resize(0x100, 0xea);
+    for (size_t i = 0; i < 0x100; ++i)
+    {
+        program.push_back(static_cast<uint8_t>(i * 7 + 3));
+    }
+    EM::Rom rom(make_rom(program, 0x29));
+
+    for (bool watched : {false, true})
+    {
+        auto stop_at_third = [frames = 0](EM::NesPPU &, EM::Joypad &) mutable {
+            if (++frames == 3)
+            {
+                throw Stop{};
+            }
+        };
+        EM::Console batched(rom, stop_at_third);
+        EM::Console stepped(rom, stop_at_third);
+        std::vector<EM::WatchHit> batched_hits;
+        std::vector<EM::WatchHit> stepped_hits;
+        if (watched)
+        {
+            for (auto *console : {&batched, &stepped})
+            {
+                console->bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchWrite, 0x0280, 0x0280, {}});
+                console->bus.add_watchpoint({EM::WatchSpace::Vram, EM::WatchWrite, 0x2080, 0x2080, {}});
+            }
+            batched.bus.watchpoints.on_hit = [&](const EM::WatchHit &hit) { batched_hits.push_back(hit); };
+            stepped.bus.watchpoints.on_hit = [&](const EM::WatchHit &hit) { stepped_hits.push_back(hit); };
+        }
+
+        run_threaded(batched);
+        run_interpreted(stepped);
+
+        assert(batched.cpu.block_cache.lookup(batched.bus, 0x800b)->loop_idiom);
+        assert(batched.cpu.block_cache.lookup(batched.bus, 0x801d)->loop_idiom);
+        assert(batched.bus.ram[0x11] == 2);
+        assert_same_state(batched, stepped);
+        assert(batched_hits.size() == stepped_hits.size() && (!watched || !batched_hits.empty()));
+        for (size_t i = 0; i < batched_hits.size(); ++i)
+        {
+            assert(batched_hits[i].addr == stepped_hits[i].addr && batched_hits[i].value == stepped_hits[i].value);
+            assert(batched_hits[i].pc == stepped_hits[i].pc && batched_hits[i].cycle == stepped_hits[i].cycle);
+        }
+    }
+}
+
+// `LDA $2002 / BPL` waiting for vblank, fast-forwarded by the threaded
+// core's idle-loop skipper, against the interpreter, which runs every
+// iteration. Each loop exit jumps to $8100, where an execute watchpoint
+// records the cycle, PPU scanline and registers; the exits must match over
+// three frames. The second loop also stores A, which the heuristic rejects,
+// and is only skipped through a RomInfo idle_loops entry.
+void test_idle_loops()
+{
+    struct Exit
+    {
+        size_t cycle;
+        uint16_t scanline;
+        uint8_t a, x, y, p;
+
+        bool operator==(const Exit &other) const
+        {
+            return cycle == other.cycle && scanline == other.scanline && a == other.a && x == other.x &&
+                   y == other.y && p == other.p;
+        }
+    };
+
+    std::vector<uint8_t> plain_wait{
+        0xad, 0x02, 0x20, // $8005: LDA $2002
+        0x10, 0xfb,       // BPL $8005
+    };
+    std::vector<uint8_t> storing_wait{
+        0xad, 0x02, 0x20, // $8005: LDA $2002
+        0x85, 0x00,       // STA $00
+        0x10, 0xf9,       // BPL $8005
+    };
+    for (const auto *wait : {&plain_wait, &storing_wait})
+    {
+        std::vector<uint8_t> program{0xa9, 0x80, 0x8d, 0x00, 0x20}; // LDA #$80; STA $2000 (NMI on)
+        program.insert(program.end(), wait->begin(), wait->end());
+        program.insert(program.end(), {0x4c, 0x00, 0x81}); // JMP $8100
+        auto nmi_offset = static_cast<uint16_t>(program.size());
+        program.insert(program.end(), {0xe6, 0x11, 0xa2, 0x40, 0x40}); // NMI: INC $11; LDX #$40; RTI
+        program.resize(0x100, 0xea);
+        program.insert(program.end(), {0xe6, 0x10, 0xa6, 0x10, 0x4c, 0x05, 0x80}); // INC $10; LDX $10; JMP $8005
+
+        EM::Rom rom(make_rom(program, nmi_offset));
+        EM::RomInfo info{rom.crc32, 0, 0, EM::Mirroring::HORIZONTAL, EM::Region::NTSC, {0x8005, 0}};
+        if (wait == &storing_wait)
+        {
+            rom.info = &info;
+        }
+
+        auto stop_at_third = [frames = 0](EM::NesPPU &, EM::Joypad &) mutable {
+            if (++frames == 3)
+            {
+                throw Stop{};
+            }
+        };
+        EM::Console skipped(rom, stop_at_third);
+        EM::Console stepped(rom, stop_at_third);
+        std::vector<Exit> skipped_exits;
+        std::vector<Exit> stepped_exits;
+        for (auto [console, exits] : {std::pair{&skipped, &skipped_exits}, std::pair{&stepped, &stepped_exits}})
+        {
+            console->bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchExecute, 0x8100, 0x8100, {}});
+            console->bus.watchpoints.on_hit = [console, exits](const EM::WatchHit &hit) {
+                console->bus.sync_ppu();
+                const auto &registers = console->cpu.registers;
+                exits->push_back({hit.cycle, console->bus.ppu.scanline, registers.a, registers.x, registers.y,
+                                  console->cpu.status()});
+            };
+        }
+
+        run_threaded(skipped);
+        run_interpreted(stepped);
+
+        const EM::BasicBlock *block = skipped.cpu.block_cache.lookup(skipped.bus, 0x8005);
+        assert(block->spin_loop == (wait == &plain_wait));
+        assert(skipped_exits.size() == 2 && skipped_exits == stepped_exits);
+        assert(skipped_exits[0].scanline == 241 && skipped_exits[1].scanline == 241);
+        assert_same_state(skipped, stepped);
+    }
+}
+
+// Code copied to $0300 rewrites the operand of its own next instruction,
+// then a routine later on the same page that has already run from the block
+// cache. The threaded core must run the new bytes both times.
+void test_self_modifying_code()
+{
+    std::vector<uint8_t> program{
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+        0xa2, 0x00,                   // LDX #0
+        0xbd, 0x00, 0x81,             // $8007: LDA $8100,X
+        0x9d, 0x00, 0x03,             // STA $0300,X
+        0xe8, 0xe0, 0x30, 0xd0, 0xf5, // INX; CPX #$30; BNE $8007
+        0xa2, 0x00,                   // LDX #0
+        0x4c, 0x00, 0x03,             // JMP $0300
+        0x40,                         // NMI: RTI
+    };
+    program.resize(0x100, 0xea);
+    std::vector<uint8_t> ram_code{
+        0xa9, 0x42, 0x8d, 0x06, 0x03, // $0300: LDA #$42; STA $0306
+        0xa9, 0x00, 0x85, 0x10,       // $0305: LDA #$00, run as LDA #$42; STA $10
+        0x20, 0x20, 0x03,             // JSR $0320
+        0xa9, 0x99, 0x8d, 0x21, 0x03, // LDA #$99; STA $0321
+        0x20, 0x20, 0x03,             // JSR $0320
+        0x4c, 0x14, 0x03,             // $0314: JMP $0314
+    };
+    ram_code.resize(0x20, 0xea);
+    ram_code.insert(ram_code.end(), {0xa9, 0x11, 0x95, 0x11, 0xe8, 0x60}); // $0320: LDA #$11; STA $11,X; INX; RTS
+    program.insert(program.end(), ram_code.begin(), ram_code.end());
+    EM::Rom rom(make_rom(program, 0x17));
+
+    auto stop_at_third = [frames = 0](EM::NesPPU &, EM::Joypad &) mutable {
+        if (++frames == 3)
+        {
+            throw Stop{};
+        }
+    };
+    EM::Console threaded(rom, stop_at_third);
+    EM::Console stepped(rom, stop_at_third);
+    run_threaded(threaded);
+    run_interpreted(stepped);
+
+    assert(threaded.bus.ram[0x10] == 0x42);
+    assert(threaded.bus.ram[0x11] == 0x11 && threaded.bus.ram[0x12] == 0x99);
+    assert(threaded.cpu.registers.pc == 0x0314);
+    assert_same_state(threaded, stepped);
+}
+
+// CycleStep ticks every access as it happens, InstructionStep each whole
+// instruction; a program with page-crossing indexed and indirect accesses, a
+// read-modify-write, a subroutine and a branch across a page must end in the
+// same state and cycle under both.
+void test_cycle_step()
+{
+    std::vector<uint8_t> program{
+        0xa2, 0xff, 0xa0, 0x10, 0xa9, 0x37, // LDX #$FF; LDY #$10; LDA #$37
+        0x9d, 0x01, 0x02,                   // STA $0201,X ($0300)
+        0xbd, 0x01, 0x02,                   // LDA $0201,X, crossing
+        0x7d, 0x02, 0x02,                   // ADC $0202,X, crossing
+        0x85, 0x10,                         // STA $10
+        0xa9, 0xf8, 0x85, 0x20,             // LDA #$F8; STA $20
+        0xa9, 0x02, 0x85, 0x21,             // LDA #$02; STA $21
+        0xb1, 0x20,                         // LDA ($20),Y ($0308), crossing
+        0x91, 0x20,                         // STA ($20),Y
+        0xfe, 0xf0, 0x02,                   // INC $02F0,X
+        0x20, 0x40, 0x80,                   // JSR $8040
+        0xa2, 0x01, 0x4c, 0xfc, 0x80,       // LDX #1; JMP $80FC
+    };
+    program.resize(0x40, 0xea);
+    program.insert(program.end(), {0xe6, 0x11, 0x60}); // $8040: INC $11; RTS
+    program.resize(0xfc, 0xea);
+    program.insert(program.end(), {0xd0, 0x05});                   // $80FC: BNE $8103, to the next page
+    program.insert(program.end(), {0xea, 0xea, 0xea, 0xea, 0xea});
+    program.insert(program.end(), {0x4c, 0x03, 0x81});             // $8103: JMP $8103
+    EM::Rom rom(make_rom(program, 0));
+
+    EM::Console instruction_step(rom, [](EM::NesPPU &, EM::Joypad &) {});
+    EM::CycleConsole cycle_step(rom, [](EM::NesPPU &, EM::Joypad &) {});
+    instruction_step.cpu.reset();
+    cycle_step.cpu.reset();
+    instruction_step.cpu.run_instructions(22);
+    cycle_step.cpu.run_instructions(22);
+
+    assert(instruction_step.cpu.registers.pc == 0x8103);
+    assert(instruction_step.bus.ram[0x300] == 0x37 && instruction_step.bus.ram[0x10] == 0x37);
+    assert(instruction_step.bus.ram[0x308] == 0x00 && instruction_step.bus.ram[0x3ef] == 0x01);
+    assert(instruction_step.bus.ram[0x11] == 0x01);
+    assert_same_state(instruction_step, cycle_step);
+
+    // The page crosses cost one cycle each under both policies
+    std::vector<uint8_t> crossing{0xa2, 0x00, 0xbd, 0xff, 0x02, 0xa2, 0x01, 0xbd, 0xff, 0x02};
+    EM::Console instruction_cross(EM::Rom(make_rom(crossing, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    EM::CycleConsole cycle_cross(EM::Rom(make_rom(crossing, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    instruction_cross.cpu.reset();
+    cycle_cross.cpu.reset();
+    auto start = instruction_cross.bus.cycles;
+    instruction_cross.cpu.run_instructions(2);
+    cycle_cross.cpu.run_instructions(2);
+    assert(instruction_cross.bus.cycles - start == 2 + 4 && cycle_cross.bus.cycles - start == 2 + 4);
+    instruction_cross.cpu.run_instructions(2);
+    cycle_cross.cpu.run_instructions(2);
+    assert(instruction_cross.bus.cycles - start == 2 + 4 + 2 + 5);
+    assert_same_state(instruction_cross, cycle_cross);
+}
+
+// $4014 copies a RAM or ROM page into OAM from OAMADDR on, and halts the CPU
+// after the writing instruction for 513 cycles, or 514 from an odd cycle
+void test_oam_dma()
+{
+    // LDA #$02; STA $4014
+    EM::Console console(EM::Rom(make_rom({0xa9, 0x02, 0x8d, 0x14, 0x40}, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    console.cpu.reset();
+    for (size_t i = 0; i < 256; ++i)
+    {
+        console.bus.ram[0x200 + i] = static_cast<uint8_t>(i);
+    }
+    console.bus.ppu.write_to_oam_addr(0x10);
+
+    auto start = console.bus.cycles;
+    console.cpu.run_instructions(2);
+    assert(console.bus.cycles - start == 6 + 513 + ((start + 6) & 1));
+    assert(console.bus.scheduler.at(EM::Event::OamDma) == EM::Scheduler::NEVER);
+    assert(console.bus.ppu.oam_addr == 0x10);
+    assert(console.bus.ppu.oam_data[0x10] == 0x00);
+    assert(console.bus.ppu.oam_data[0xff] == 0xef);
+    assert(console.bus.ppu.oam_data[0x0f] == 0xff);
+
+    // From PRG-ROM
+    console.bus.write(0x4014, 0x80);
+    assert(console.bus.ppu.oam_data[0x10] == 0xa9);
+    assert(console.bus.ppu.oam_data[0x14] == 0x40);
+    assert(console.bus.ppu.oam_data[0x15] == 0xea);
+}
+
+// Events due by the same tick come out in Event order, not cycle order.
+// Rescheduling a pending event moves it, later as well as earlier.
+void test_scheduler()
+{
+    EM::Scheduler scheduler;
+    assert(scheduler.next == EM::Scheduler::NEVER);
+
+    scheduler.schedule(EM::Event::PpuNmi, 20);
+    scheduler.schedule(EM::Event::OamDma, 10);
+    assert(scheduler.next == 10);
+    assert(!scheduler.take_due(9).has_value());
+
+    assert(scheduler.take_due(30) == EM::Event::PpuNmi);
+    assert(scheduler.next == 10);
+    assert(scheduler.take_due(30) == EM::Event::OamDma);
+    assert(scheduler.next == EM::Scheduler::NEVER);
+
+    scheduler.schedule(EM::Event::OamDma, 5);
+    scheduler.cancel(EM::Event::OamDma);
+    assert(!scheduler.take_due(30).has_value());
+
+    // Moving the earliest event later lets the next one come first
+    scheduler.schedule(EM::Event::PpuNmi, 40);
+    scheduler.schedule(EM::Event::OamDma, 10);
+    scheduler.schedule(EM::Event::OamDma, 50);
+    assert(scheduler.next == 40);
+    assert(!scheduler.take_due(39).has_value());
+    scheduler.schedule(EM::Event::PpuNmi, 60);
+    assert(scheduler.next == 50);
+    assert(scheduler.take_due(55) == EM::Event::OamDma);
+    assert(scheduler.next == 60);
+}
+
+// The PPU trails the CPU until something looks at it, then lands exactly
+// where ticking it every instruction would have
+void test_ppu_catch_up()
+{
+    // NOPs, then JMP $8000
+    std::vector<uint8_t> program(0x40, 0xea);
+    program.insert(program.end(), {0x4c, 0x00, 0x80});
+    EM::Console console(EM::Rom(make_rom(program, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    console.cpu.reset();
+
+    console.cpu.run_cycles(10000);
+    EM::Bus &bus = console.bus;
+    assert(bus.ppu.timestamp < bus.cycles);
+    assert(bus.cycles < bus.scheduler.next);
+
+    bus.read(0x2002);
+    assert(bus.ppu.timestamp == bus.cycles);
+    assert(bus.ppu.scanline * 341 + bus.ppu.cycles == bus.cycles * 3);
+
+    // Vblank starts at the end of line 240
+    console.cpu.run_cycles(bus.scheduler.at(EM::Event::PpuNmi) - bus.cycles);
+    assert(bus.ppu.timestamp == bus.cycles);
+    assert(bus.ppu.scanline == 241);
+    assert(bus.ppu.status.is_in_vblank());
+}
+
+// Watched pages leave the fast page tables until the watchpoint is removed;
+// RAM is watched in every mirror
+void test_watchpoints()
+{
+    // LDA #$42; STA $0310; LDA $0B10; LDA #$07; STA $0310; NOP;
+    // PPUADDR = $2108; PPUDATA = $55
+    std::vector<uint8_t> program{0xa9, 0x42, 0x8d, 0x10, 0x03, 0xad, 0x10, 0x0b, 0xa9, 0x07, 0x8d, 0x10,
+                                 0x03, 0xea, 0xa9, 0x21, 0x8d, 0x06, 0x20, 0xa9, 0x08, 0x8d, 0x06, 0x20,
+                                 0xa9, 0x55, 0x8d, 0x07, 0x20};
+    EM::Console console(EM::Rom(make_rom(program, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    EM::Bus &bus = console.bus;
+    std::vector<EM::WatchHit> hits;
+    bus.watchpoints.on_hit = [&](const EM::WatchHit &hit) { hits.push_back(hit); };
+
+    EM::Watchpoint stores{EM::WatchSpace::Cpu, EM::WatchWrite, 0x0310, 0x0310, {}};
+    stores.condition = [](const EM::WatchHit &hit) { return hit.value == 0x07; };
+    auto store_id = bus.add_watchpoint(stores);
+    auto load_id = bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchRead, 0x0310, 0x0310, {}});
+    bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchExecute, 0x800d, 0x800d, {}});
+    bus.add_watchpoint({EM::WatchSpace::Vram, EM::WatchWrite, 0x2100, 0x21ff, {}});
+    assert(bus.read_pages[0x0b] == nullptr);
+    assert(bus.write_pages[0x03] == nullptr);
+    assert(bus.read_pages[0x02] != nullptr);
+    assert(bus.fetch_pages[0x80] == nullptr && bus.read_pages[0x80] != nullptr);
+
+    console.cpu.reset();
+    console.cpu.run_instructions(12);
+    assert(hits.size() == 4);
+    assert(hits[0].id == load_id && hits[0].addr == 0x0310 && hits[0].value == 0x42 && hits[0].pc == 0x8006);
+    assert(hits[1].id == store_id && hits[1].access == EM::WatchWrite && hits[1].pc == 0x800b);
+    assert(hits[2].access == EM::WatchExecute && hits[2].pc == 0x800d && hits[2].value == 0xea);
+    assert(hits[3].space == EM::WatchSpace::Vram && hits[3].addr == 0x2108 && hits[3].value == 0x55);
+    assert(bus.ram[0x310] == 0x07);
+
+    bus.remove_watchpoint(load_id);
+    bus.remove_watchpoint(store_id);
+    assert(bus.read_pages[0x0b] == bus.ram.data() + 0x300);
+    assert(bus.write_pages[0x03] == bus.ram.data() + 0x300);
+
+    // The threaded core leaves the watched page to the interpreter and
+    // reports the same hits at the same PCs and cycles
+    EM::Console threaded(EM::Rom(make_rom(program, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    std::vector<EM::WatchHit> threaded_hits;
+    threaded.bus.watchpoints.on_hit = [&](const EM::WatchHit &hit) {
+        threaded_hits.push_back(hit);
+        if (hit.space == EM::WatchSpace::Vram)
+        {
+            throw Stop{};
+        }
+    };
+    threaded.bus.add_watchpoint(stores);
+    threaded.bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchRead, 0x0310, 0x0310, {}});
+    threaded.bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchExecute, 0x800d, 0x800d, {}});
+    threaded.bus.add_watchpoint({EM::WatchSpace::Vram, EM::WatchWrite, 0x2100, 0x21ff, {}});
+    run_threaded(threaded);
+    assert(threaded.cpu.block_cache.lookup(threaded.bus, 0x8000) == nullptr);
+    assert(threaded_hits.size() == hits.size());
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        assert(threaded_hits[i].id == hits[i].id && threaded_hits[i].access == hits[i].access);
+        assert(threaded_hits[i].addr == hits[i].addr && threaded_hits[i].value == hits[i].value);
+        assert(threaded_hits[i].pc == hits[i].pc && threaded_hits[i].cycle == hits[i].cycle);
+    }
+
+    // Looking a block up reads no watched byte, and arming a watchpoint on
+    // a cached block's page drops the block
+    EM::Console decoded(EM::Rom(make_rom(program, 0)), [](EM::NesPPU &, EM::Joypad &) {});
+    size_t decoded_hits = 0;
+    decoded.bus.watchpoints.on_hit = [&](const EM::WatchHit &) { ++decoded_hits; };
+    assert(decoded.cpu.block_cache.lookup(decoded.bus, 0x8000) != nullptr);
+    auto operand_id = decoded.bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchRead, 0x8001, 0x8001, {}});
+    assert(decoded.cpu.block_cache.lookup(decoded.bus, 0x8000) == nullptr);
+    decoded.bus.remove_watchpoint(operand_id);
+    assert(decoded.cpu.block_cache.lookup(decoded.bus, 0x8000) != nullptr);
+    decoded.bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchExecute, 0x8000, 0x8000, {}});
+    assert(decoded.cpu.block_cache.lookup(decoded.bus, 0x8000) == nullptr);
+    assert(decoded_hits == 0);
+}
+
+// Runs program on run_with_callback with hook until the third frame. A read
+// watchpoint on the program's operand bytes records what the hook reads.
+template <typename Hook>
+std::unique_ptr<EM::Console> run_hooked(const std::vector<uint8_t> &program, uint16_t nmi_offset, Hook &hook,
+                                        std::vector<EM::WatchHit> &hits)
+{
+    auto stop_at_third = [frames = 0](EM::NesPPU &, EM::Joypad &) mutable {
+        if (++frames == 3)
+        {
+            throw Stop{};
+        }
+    };
+    auto console = std::make_unique<EM::Console>(EM::Rom(make_rom(program, nmi_offset)), stop_at_third);
+    console->bus.watchpoints.on_hit = [&hits](const EM::WatchHit &hit) { hits.push_back(hit); };
+    console->bus.add_watchpoint({EM::WatchSpace::Cpu, EM::WatchRead, 0x8000, 0x80ff, {}});
+    console->cpu.reset();
+    try
+    {
+        console->cpu.run_with_callback(hook);
+    }
+    catch (const Stop &)
+    {
+    }
+    return console;
+}
+
+// Hooks only watch: every hook policy leaves the same registers, RAM,
+// cycle count and watchpoint hits as NoHook
+void test_hook_policies()
+{
+    std::vector<uint8_t> program{
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+        0xe8, 0x8a,                   // INX; TXA
+        0x9d, 0x00, 0x02,             // STA $0200,X
+        0x4c, 0x05, 0x80,             // JMP $8005
+        0xe6, 0x00,                   // NMI: INC $00
+        0x40,                         // RTI
+    };
+    EM::NoHook none;
+    EM::ProfilerHook profiler;
+    EM::OpcodePairHook pairs;
+    std::vector<EM::WatchHit> none_hits;
+    std::vector<EM::WatchHit> profiler_hits;
+    std::vector<EM::WatchHit> pair_hits;
+    auto plain = run_hooked(program, 13, none, none_hits);
+    auto profiled = run_hooked(program, 13, profiler, profiler_hits);
+    auto paired = run_hooked(program, 13, pairs, pair_hits);
+
+    assert(profiler.pc_counts[0x8005] > 0 && profiler.pc_counts[0x800d] == 2);
+    assert(pairs.pair_counts[0xe8 << 8 | 0x8a] == profiler.pc_counts[0x8005]);
+    for (const auto *console : {profiled.get(), paired.get()})
+    {
+        const auto &registers = console->cpu.registers;
+        assert(registers.a == plain->cpu.registers.a && registers.x == plain->cpu.registers.x);
+        assert(registers.y == plain->cpu.registers.y && registers.p == plain->cpu.registers.p);
+        assert(registers.sp == plain->cpu.registers.sp && registers.pc == plain->cpu.registers.pc);
+        assert(console->bus.ram == plain->bus.ram && console->bus.cycles == plain->bus.cycles);
+    }
+    assert(!none_hits.empty());
+    for (const auto *hits : {&profiler_hits, &pair_hits})
+    {
+        assert(hits->size() == none_hits.size());
+        for (size_t i = 0; i < hits->size(); ++i)
+        {
+            assert((*hits)[i].addr == none_hits[i].addr && (*hits)[i].cycle == none_hits[i].cycle);
+        }
+    }
+}
+
+// ROM codes read through a patched copy of their page only; RAM codes are
+// written back at each frame boundary
+void test_cheats()
+{
+    auto patch = EM::decode_cheat("SXIOPO");
+    assert(patch.addr == 0x91d9 && patch.value == 0xad && !patch.compare);
+    patch = EM::decode_cheat("075a:09:03");
+    assert(patch.addr == 0x075a && patch.value == 0x09 && patch.compare == 0x03);
+
+    // PPUCTRL = $80; LDA $8020; STA $0300; LDA $9000; JMP $800E; the NMI
+    // handler is an RTI
+    std::vector<uint8_t> program{0xa9, 0x80, 0x8d, 0x00, 0x20, 0xad, 0x20, 0x80, 0x8d,
+                                 0x00, 0x03, 0xad, 0x00, 0x90, 0x4c, 0x0e, 0x80, 0x40};
+    EM::Console console(EM::Rom(make_rom(program, 0x11)), [](EM::NesPPU &, EM::Joypad &) {});
+    EM::Bus &bus = console.bus;
+    const uint8_t *page_80 = bus.read_pages[0x80];
+    EM::add_cheat(bus, "8020:77");
+    EM::add_cheat(bus, "9000:55:00");
+    EM::add_cheat(bus, "0301:42");
+    assert(bus.read_pages[0x80] != page_80 && bus.read_pages[0x81] == page_80 + 0x100);
+    assert(bus.read(0x8020) == 0x77 && bus.read(0x8021) == 0xea);
+    assert(bus.read(0x9000) == 0xea);
+
+    console.cpu.reset();
+    console.cpu.run_instructions(5);
+    assert(bus.ram[0x300] == 0x77);
+    assert(bus.ram[0x301] == 0x00);
+    console.cpu.run_frame();
+    assert(bus.ram[0x301] == 0x42);
+
+    bus.clear_patches();
+    assert(bus.read_pages[0x80] == page_80);
+}
+
+// UxROM: the program in the fixed bank at $C000 switches each of four banks
+// in at $8000, reads its number from $A000 and calls the routine at $A010
+// that every bank has, returning $10 plus the number. The threaded core must
+// decode that routine again after each switch. Then MMC1 loads its PRG bank
+// and control registers through the serial port, and AxROM selects its
+// nametable.
+void test_mappers()
+{
+    std::vector<uint8_t> image{'N', 'E', 'S', 0x1a, 4, 0, 0x21, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<uint8_t> prg(4 * 0x4000, 0xea);
+    for (uint8_t bank = 0; bank < 4; ++bank)
+    {
+        size_t base = bank * 0x4000u;
+        prg[base + 0x2000] = bank;
+        std::vector<uint8_t> routine{0xa9, static_cast<uint8_t>(0x10 + bank), 0x60}; // LDA #$1n; RTS
+        std::copy(routine.begin(), routine.end(), prg.begin() + static_cast<std::ptrdiff_t>(base + 0x2010));
+    }
+    std::vector<uint8_t> program{
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+        0xa2, 0x00,                   // LDX #0
+        0x8e, 0x00, 0xc0,             // STX $C000 (bank X at $8000)
+        0xad, 0x00, 0xa0,             // LDA $A000
+        0x9d, 0x00, 0x03,             // STA $0300,X
+        0x20, 0x10, 0xa0,             // JSR $A010
+        0x9d, 0x10, 0x03,             // STA $0310,X
+        0xe8, 0xe0, 0x04, 0xd0, 0xec, // INX; CPX #4; BNE $C007
+        0x4c, 0x1b, 0xc0,             // JMP $C01B
+        0x40,                         // RTI
+    };
+    std::copy(program.begin(), program.end(), prg.begin() + 3 * 0x4000);
+    std::vector<uint8_t> vectors{0x1e, 0xc0, 0x00, 0xc0, 0x1e, 0xc0};
+    std::copy(vectors.begin(), vectors.end(), prg.end() - 6);
+    image.insert(image.end(), prg.begin(), prg.end());
+
+    for (bool threaded : {false, true})
+    {
+        EM::Console console(EM::Rom(image), [](EM::NesPPU &, EM::Joypad &) { throw Stop{}; });
+        if (threaded)
+        {
+            run_threaded(console);
+        }
+        else
+        {
+            console.cpu.reset();
+            console.cpu.run_instructions(100);
+        }
+        for (uint8_t bank = 0; bank < 4; ++bank)
+        {
+            assert(console.bus.ram[0x300 + bank] == bank);
+            assert(console.bus.ram[0x310 + bank] == 0x10 + bank);
+        }
+        // CHR-RAM takes PPUDATA writes
+        console.bus.ppu.write_to_ppu_addr(0x04);
+        console.bus.ppu.write_to_ppu_addr(0x10);
+        console.bus.ppu.write_to_data(0x5a);
+        assert(*console.bus.ppu.chr_data(0x0410) == 0x5a);
+    }
+
+    // MMC1 with the same PRG-ROM and 16 KiB of CHR-ROM: PRG bank 2 at $8000,
+    // then bank 0 fixed there, bank 2 at $C000 and vertical mirroring, until
+    // a reset write fixes the last bank at $C000 again
+    image[4] = 4;
+    image[5] = 2;
+    image[6] = 0x10;
+    image.resize(image.size() + 0x4000);
+    EM::Console mmc1(EM::Rom(image), [](EM::NesPPU &, EM::Joypad &) {});
+    auto serial_write = [&](uint16_t addr, uint8_t value) {
+        for (int bit = 0; bit < 5; ++bit)
+        {
+            mmc1.bus.write(addr, static_cast<uint8_t>(value >> bit));
+        }
+    };
+    assert(mmc1.bus.read(0xa000) == 0 && mmc1.bus.read(0xe000) == 3);
+    serial_write(0xe000, 2);
+    assert(mmc1.bus.read(0xa000) == 2 && mmc1.bus.read(0xc000) == 0xa9);
+    serial_write(0x8000, 0x1a);
+    assert(mmc1.bus.read(0xa000) == 0 && mmc1.bus.read(0xe000) == 2);
+    assert(mmc1.bus.ppu.mirroring == EM::Mirroring::VERTICAL);
+    serial_write(0xa000, 1);
+    assert(mmc1.bus.ppu.chr_data(0x0000) == mmc1.bus.rom->chr_rom.data() + 0x1000);
+    mmc1.bus.write(0x8000, 0x80);
+    assert(mmc1.bus.read(0xa000) == 2 && mmc1.bus.read(0xe000) == 3);
+
+    // AxROM switches 32 KiB of PRG-ROM and the one-screen nametable together
+    image[6] = 0x70;
+    EM::Console axrom(EM::Rom(image), [](EM::NesPPU &, EM::Joypad &) {});
+    axrom.bus.write(0x8000, 0x11);
+    assert(axrom.bus.read(0xa000) == 2 && axrom.bus.ppu.mirroring == EM::Mirroring::ONE_SCREEN_UPPER);
+    assert(axrom.bus.ppu.mirror_vram_addr(0x2c05) == 0x405);
+}
+
+// A UxROM block in the switchable bank selects another bank and runs on: the
+// instructions after the write come from the new bank in every core, however
+// often the old bank's block ran before
+void test_bank_switch_mid_block()
+{
+    std::vector<uint8_t> image{'N', 'E', 'S', 0x1a, 4, 0, 0x20, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<uint8_t> prg(4 * 0x4000, 0xea);
+    for (uint8_t bank = 0; bank < 3; ++bank)
+    {
+        std::vector<uint8_t> code{
+            0xa2, 0x01, 0x8e, 0x00, 0xc0,                        // LDX #1; STX $C000 (bank 1 at $8000)
+            0xa9, static_cast<uint8_t>(0x10 + bank), 0x85, 0x00, // LDA #$1n; STA $00
+            0x4c, 0x05, 0xc0,                                    // JMP $C005
+        };
+        std::copy(code.begin(), code.end(), prg.begin() + static_cast<std::ptrdiff_t>(bank * 0x4000u));
+    }
+    std::vector<uint8_t> program{
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+        0xa2, 0x00, 0x8e, 0x00, 0xc0, // LDX #0; STX $C000 (bank 0 at $8000)
+        0x4c, 0x00, 0x80,             // JMP $8000
+        0x40,                         // RTI
+    };
+    std::copy(program.begin(), program.end(), prg.begin() + 3 * 0x4000);
+    std::vector<uint8_t> vectors{0x0d, 0xc0, 0x00, 0xc0, 0x0d, 0xc0};
+    std::copy(vectors.begin(), vectors.end(), prg.end() - 6);
+    image.insert(image.end(), prg.begin(), prg.end());
+
+    for (int core = 0; core < 3; ++core)
+    {
+        EM::Console console(EM::Rom(image), [](EM::NesPPU &, EM::Joypad &) { throw Stop{}; });
+        console.cpu.reset();
+        try
+        {
+            if (core == 0)
+            {
+                console.cpu.run_with_callback([](EM::CPU &) {});
+            }
+            else if (core == 1)
+            {
+                console.cpu.run_threaded();
+            }
+            else
+            {
+                console.cpu.run_jit();
+            }
+        }
+        catch (const Stop &)
+        {
+        }
+        assert(console.bus.ram[0] == 0x11);
+    }
+}
+
+// MMC3 banking, then its scanline IRQ: with sprites fetched from $1000 and
+// a latch of 9, every tenth rendered line raises the IRQ at cycle 260. The
+// program spins on a JMP, which the threaded core skips over in bulk, so it
+// must stop at each IRQ. Every core counts the same IRQs per frame.
+void test_mmc3()
+{
+    std::vector<uint8_t> image{'N', 'E', 'S', 0x1a, 4, 2, 0x40, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<uint8_t> prg(4 * 0x4000, 0xea);
+    for (uint8_t bank = 0; bank < 8; ++bank)
+    {
+        prg[bank * 0x2000u] = bank;
+    }
+    std::vector<uint8_t> program{
+        0x78,                         // SEI
+        0xa9, 0x88, 0x8d, 0x00, 0x20, // LDA #$88; STA $2000 (NMI on, sprites at $1000)
+        0xa9, 0x09, 0x8d, 0x00, 0xc0, // LDA #9; STA $C000 (IRQ latch)
+        0x8d, 0x01, 0xc0,             // STA $C001 (reload)
+        0x8d, 0x01, 0xe0,             // STA $E001 (IRQ on)
+        0xa9, 0x18, 0x8d, 0x01, 0x20, // LDA #$18; STA $2001 (rendering on)
+        0x58,                         // CLI
+        0x4c, 0x27, 0xe0,             // JMP $E027
+        0xe6, 0x00,                   // IRQ: INC $00
+        0x8d, 0x00, 0xe0,             // STA $E000 (acknowledge)
+        0x8d, 0x01, 0xe0,             // STA $E001
+        0x40,                         // RTI
+        0x40,                         // NMI: RTI
+    };
+    std::copy(program.begin(), program.end(), prg.end() - 0x2000 + 0x10);
+    std::vector<uint8_t> vectors{0x33, 0xe0, 0x10, 0xe0, 0x2a, 0xe0};
+    std::copy(vectors.begin(), vectors.end(), prg.end() - 6);
+    image.insert(image.end(), prg.begin(), prg.end());
+    image.resize(image.size() + 0x4000);
+
+    EM::Console banks(EM::Rom(image), [](EM::NesPPU &, EM::Joypad &) {});
+    EM::Bus &bus = banks.bus;
+    assert(bus.read(0x8000) == 0 && bus.read(0xa000) == 1 && bus.read(0xc000) == 6 && bus.read(0xe000) == 7);
+    bus.write(0x8000, 0x46);
+    bus.write(0x8001, 3);
+    assert(bus.read(0x8000) == 6 && bus.read(0xa000) == 1 && bus.read(0xc000) == 3 && bus.read(0xe000) == 7);
+    bus.write(0x8000, 0x80);
+    bus.write(0x8001, 5);
+    assert(bus.ppu.chr_data(0x1000) == bus.rom->chr_rom.data() + 4 * 0x400);
+    assert(bus.ppu.chr_data(0x1400) == bus.rom->chr_rom.data() + 5 * 0x400);
+    bus.write(0x8000, 0x82);
+    bus.write(0x8001, 9);
+    assert(bus.ppu.chr_data(0x0000) == bus.rom->chr_rom.data() + 9 * 0x400);
+    bus.write(0xa000, 1);
+    assert(bus.ppu.mirroring == EM::Mirroring::HORIZONTAL);
+
+    std::vector<std::vector<uint8_t>> counts;
+    for (int core = 0; core < 3; ++core)
+    {
+        std::vector<uint8_t> frames;
+        EM::Console console(EM::Rom(image), [&](EM::NesPPU &, EM::Joypad &) {
+            frames.push_back(console.bus.ram[0]);
+            if (frames.size() == 3)
+            {
+                throw Stop{};
+            }
+        });
+        std::vector<std::pair<uint16_t, size_t>> irqs;
+        console.cpu.reset();
+        try
+        {
+            if (core == 0)
+            {
+                console.cpu.run_with_callback([&](EM::CPU &cpu) {
+                    if (cpu.registers.pc == 0xe02a)
+                    {
+                        cpu.bus->sync_ppu();
+                        irqs.emplace_back(cpu.bus->ppu.scanline, cpu.bus->ppu.cycles);
+                    }
+                });
+            }
+            else if (core == 1)
+            {
+                console.cpu.run_threaded();
+            }
+            else
+            {
+                console.cpu.run_jit();
+            }
+        }
+        catch (const Stop &)
+        {
+        }
+        for (size_t i = 0; i < 24 && core == 0; ++i)
+        {
+            assert(irqs[i].first == 9 + 10 * i);
+            assert(irqs[i].second >= 260 && irqs[i].second < 300);
+        }
+        counts.push_back(frames);
+    }
+    assert((counts[0] == std::vector<uint8_t>{24, 48, 72}));
+    assert(counts[1] == counts[0] && counts[2] == counts[0]);
+}
+
+void test_rom_images()
+{
+    auto bytes = make_rom({0x4c, 0x00, 0x80}, 0);
+    char path[] = "/tmp/cpu_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()));
+    close(fd);
+
+    // Loaded or copied, the same game is one image
+    EM::Rom mapped = EM::Rom::load(path);
+    EM::Rom mapped_again = EM::Rom::load(path);
+    EM::Rom copied(bytes);
+    unlink(path);
+    assert(mapped.image == mapped_again.image && mapped.image == copied.image);
+    assert(mapped.prg_rom.data() == mapped.image->bytes().data() + 16);
+    assert(std::equal(mapped.prg_rom.begin(), mapped.prg_rom.end(), bytes.begin() + 16));
+    assert(mapped.chr_rom.size() == 0x2000);
+
+    EM::Console console(mapped, [](EM::NesPPU &, EM::Joypad &) {});
+    assert(console.bus.rom->prg_rom.data() == mapped.prg_rom.data());
+
+    bytes[16] ^= 0xff;
+    EM::Rom other(bytes);
+    assert(other.image != mapped.image);
+    assert(other.crc32 != mapped.crc32);
+
+    bool threw = false;
+    try
+    {
+        EM::Rom::load("/nonexistent/rom.nes");
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    assert(threw);
+}
+
+void test_rom_headers()
+{
+    // NES 2.0: mapper 0x104 submapper 3, battery, 8 KiB PRG-NVRAM, 32 KiB
+    // CHR-RAM, PAL
+    auto bytes = make_rom({0x4c, 0x00, 0x80}, 0);
+    bytes[5] = 0;
+    bytes[6] = 0x42;
+    bytes[7] = 0x08;
+    bytes[8] = 0x31;
+    bytes[10] = 0x70;
+    bytes[11] = 0x09;
+    bytes[12] = 0x01;
+    EM::Rom nes2(bytes);
+    assert(nes2.mapper == 0x104 && nes2.submapper == 3 && nes2.battery);
+    assert(nes2.prg_ram_size == 0x2000 && nes2.chr_ram_size == 0x8000);
+    assert(nes2.region == EM::Region::PAL);
+    assert(nes2.prg_rom.size() == 0x4000 && nes2.chr_rom.empty());
+
+    // Exponent-multiplier size: 2^14 * 1
+    bytes[4] = 14 << 2;
+    bytes[9] = 0x0f;
+    assert(EM::Rom(bytes).prg_rom.size() == 0x4000);
+
+    // iNES with text over bytes 7-15 keeps only byte 6's mapper nibble
+    bytes = make_rom({0x4c, 0x00, 0x80}, 0);
+    bytes[6] = 0x10;
+    std::copy_n("DiskDude!", 9, bytes.begin() + 7);
+    EM::Rom dirty(bytes);
+    assert(dirty.mapper == 1 && dirty.prg_ram_size == 0x2000 && dirty.region == EM::Region::NTSC);
+    assert(dirty.info == nullptr);
+
+    const EM::RomInfo *mario = EM::find_rom_info(0xd445f698);
+    assert(mario != nullptr && mario->mapper == 0 && mario->mirroring == EM::Mirroring::VERTICAL);
+    assert(EM::find_rom_info(0) == nullptr && EM::find_rom_info(0xffffffff) == nullptr);
+}
+
+// Two bundled games, one on a bank-switching board, for 120 frames with
+// START tapped, on the threaded core and on run_with_callback. A hash of the
+// registers, the status flags as status() assembles them from the lazy ones,
+// RAM and VRAM at every frame boundary must match frame by frame.
+void test_bundled_roms()
+{
+    constexpr size_t FRAMES = 120;
+    for (const char *name : {"mario.nes", "contra.nes"})
+    {
+        EM::Rom rom = EM::Rom::load(std::string(NES_ROM_DIR) + "/" + name);
+        std::vector<uint32_t> hashes[2];
+        for (int core = 0; core < 2; ++core)
+        {
+            auto &frames = hashes[core];
+            std::unique_ptr<EM::Console> console;
+            console = std::make_unique<EM::Console>(rom, [&](EM::NesPPU &ppu, EM::Joypad &joypad) {
+                // FNV-1a
+                uint32_t hash = 2166136261u;
+                auto mix = [&hash](uint8_t byte) { hash = (hash ^ byte) * 16777619u; };
+                const auto &registers = console->cpu.registers;
+                for (auto byte : {registers.a, registers.x, registers.y, registers.sp, console->cpu.status()})
+                {
+                    mix(byte);
+                }
+                std::for_each(console->bus.ram.begin(), console->bus.ram.end(), mix);
+                std::for_each(ppu.vram.begin(), ppu.vram.end(), mix);
+                frames.push_back(hash);
+                joypad.set_button_pressed_status(EM::JoypadButton::START, frames.size() % 60 < 5);
+                if (frames.size() == FRAMES)
+                {
+                    throw Stop{};
+                }
+            });
+            if (core == 0)
+            {
+                run_threaded(*console);
+            }
+            else
+            {
+                run_interpreted(*console);
+            }
+        }
+        assert(hashes[0].size() == FRAMES && hashes[0] == hashes[1]);
+    }
+}
+
+// NMI is edge triggered: each core takes it once per vblank, however long
+// the handler leaves the PPU in vblank
+void test_nmi_once_per_vblank()
+{
+    std::vector<uint8_t> program{
+        0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000 (NMI on)
+        0x4c, 0x05, 0x80,             // JMP $8005
+        0xe6, 0x00,                   // NMI: INC $00
+        0x40,                         // RTI
+    };
+    for (int core = 0; core < 3; ++core)
+    {
+        std::vector<uint8_t> frames;
+        EM::Console console(EM::Rom(make_rom(program, 8)), [&](EM::NesPPU &, EM::Joypad &) {
+            frames.push_back(console.bus.ram[0]);
+            if (frames.size() == 4)
+            {
+                throw Stop{};
+            }
+        });
+        console.cpu.reset();
+        try
+        {
+            if (core == 0)
+            {
+                console.cpu.run_with_callback([](EM::CPU &) {});
+            }
+            else if (core == 1)
+            {
+                console.cpu.run_threaded();
+            }
+            else
+            {
+                console.cpu.run_jit();
+            }
+        }
+        catch (const Stop &)
+        {
+        }
+        assert((frames == std::vector<uint8_t>{0, 1, 2, 3}));
+    }
 }
 
 int main()
@@ -97,13 +1223,32 @@ int main()
     // std::cout << code->mnemonic << std::endl;
     // std::cout << static_cast<unsigned>(code->len) << std::endl;
 
-    // test_ops_working_together();
-    // test_0xa9_lda_immediate_load_data();
-    // test_0xaa_tax_move_to_x();
-    // test_5_ops_working_together();
-    // test_inx_overflow();
-    // test_lda_from_memory();
+    test_ops_working_together();
+    test_0xa9_lda_immediate_load_data();
+    test_0xaa_tax_move_to_x();
+    test_5_ops_working_together();
+    test_inx_overflow();
+    test_lda_from_memory();
+    test_cycles();
+    test_nmi_once_per_vblank();
     test_game();
+    test_superinstructions();
+    test_loop_idioms();
+    test_idle_loops();
+    test_self_modifying_code();
+    test_cycle_step();
+    test_oam_dma();
+    test_scheduler();
+    test_ppu_catch_up();
+    test_watchpoints();
+    test_hook_policies();
+    test_cheats();
+    test_mappers();
+    test_bank_switch_mid_block();
+    test_mmc3();
+    test_rom_images();
+    test_rom_headers();
+    test_bundled_roms();
 
     return 0;
 }
@@ -0,0 +1,75 @@
+#ifndef MYNESEMULATOR__HOOKS_H_
+#define MYNESEMULATOR__HOOKS_H_
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "op_code.h"
+
+namespace EM
+{
+// Per-instruction hooks for BasicCPU::run_with_callback(). A hook is called
+// with the CPU before each instruction; any callable works, these are the
+// common ones. The TraceHook lives with trace() in emulator/trace.h.
+
+// No hook: run_with_callback() compiles the call and the status packing
+// around it out entirely. run() uses it.
+struct NoHook
+{
+    template <typename Cpu> void operator()(Cpu &)
+    {
+    }
+};
+
+// Calls on_hit before the instruction at any of the set addresses runs
+template <typename Cpu> struct BreakpointHook
+{
+    std::bitset<0x10000> addresses;
+    std::function<void(Cpu &)> on_hit;
+
+    void operator()(Cpu &cpu)
+    {
+        if (addresses.test(cpu.registers.pc))
+        {
+            on_hit(cpu);
+        }
+    }
+};
+
+// Counts how many times the instruction at each address was executed
+struct ProfilerHook
+{
+    std::vector<uint64_t> pc_counts = std::vector<uint64_t>(0x10000);
+
+    template <typename Cpu> void operator()(Cpu &cpu)
+    {
+        ++pc_counts[cpu.registers.pc];
+    }
+};
+
+// Counts how often each opcode runs straight after another, at pair_counts
+// [first << 8 | second]. Pairs split by a taken branch, a jump or an
+// interrupt are left out; they could never run as one superinstruction.
+struct OpcodePairHook
+{
+    std::vector<uint64_t> pair_counts = std::vector<uint64_t>(0x10000);
+    int previous = -1;
+    uint16_t next_pc = 0;
+
+    template <typename Cpu> void operator()(Cpu &cpu)
+    {
+        auto pc = cpu.registers.pc;
+        // Looked at, not read: no watchpoint sees it
+        auto code = cpu.bus->peek(pc);
+        if (previous >= 0 && pc == next_pc)
+        {
+            ++pair_counts[static_cast<size_t>(previous << 8 | code)];
+        }
+        previous = code;
+        next_pc = static_cast<uint16_t>(pc + OPCODE_TABLE[code].len);
+    }
+};
+} // namespace EM
+#endif
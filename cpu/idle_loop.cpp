@@ -0,0 +1,170 @@
+#include "idle_loop.h"
+
+#include "../cartridge/rom_db.h"
+#include "cpu.h"
+
+namespace EM
+{
+namespace
+{
+bool is_branch(uint8_t code)
+{
+    return (code & 0x1f) == 0x10;
+}
+
+// Reading addr has no side effect, or only the repeatable one of PPUSTATUS
+bool readable(uint16_t addr)
+{
+    return addr < 0x2000 || (addr < 0x4000 && (addr & 0x07) == 0x02) || addr >= 0x8000;
+}
+
+// Reads only memory, registers and flags, and writes only registers and flags
+bool register_only(uint8_t code)
+{
+    switch (code)
+    {
+    case 0xa9: case 0xa5: case 0xb5: case 0xad: case 0xbd: case 0xb9: // LDA
+    case 0xa2: case 0xa6: case 0xb6: case 0xae: case 0xbe:             // LDX
+    case 0xa0: case 0xa4: case 0xb4: case 0xac: case 0xbc:             // LDY
+    case 0x29: case 0x25: case 0x35: case 0x2d: case 0x3d: case 0x39: // AND
+    case 0x09: case 0x05: case 0x15: case 0x0d: case 0x1d: case 0x19: // ORA
+    case 0x49: case 0x45: case 0x55: case 0x4d: case 0x5d: case 0x59: // EOR
+    case 0x69: case 0x65: case 0x75: case 0x6d: case 0x7d: case 0x79: // ADC
+    case 0xe9: case 0xe5: case 0xf5: case 0xed: case 0xfd: case 0xf9: // SBC
+    case 0xc9: case 0xc5: case 0xd5: case 0xcd: case 0xdd: case 0xd9: // CMP
+    case 0xe0: case 0xe4: case 0xec:                                   // CPX
+    case 0xc0: case 0xc4: case 0xcc:                                   // CPY
+    case 0x24: case 0x2c:                                              // BIT
+    case 0xaa: case 0xa8: case 0x8a: case 0x98: case 0xba:             // transfers
+    case 0xe8: case 0xc8: case 0xca: case 0x88:                        // INX INY DEX DEY
+    case 0x0a: case 0x4a: case 0x2a: case 0x6a:                        // shifts of A
+    case 0x18: case 0x38: case 0x58: case 0x78: case 0xb8: case 0xd8: case 0xf8:
+    case 0xea:                                                         // NOP
+    case 0x4c:                                                         // JMP
+        return true;
+    default:
+        return is_branch(code);
+    }
+}
+} // namespace
+
+IdleLoopSkipper::IdleLoopSkipper(const Rom *rom)
+{
+    if (rom == nullptr || rom->info == nullptr)
+    {
+        return;
+    }
+    for (auto loop : rom->info->idle_loops)
+    {
+        if (loop != 0)
+        {
+            overrides.push_back(loop);
+        }
+    }
+}
+
+bool IdleLoopSkipper::loops_to_start(const BasicBlock &block)
+{
+    const DecodedInstruction &last = block.instructions.back();
+    if (last.code == 0x4c)
+    {
+        return last.operand == block.start;
+    }
+    if (is_branch(last.code))
+    {
+        auto next = static_cast<uint16_t>(last.pc + 2);
+        return static_cast<uint16_t>(next + static_cast<int8_t>(last.operand)) == block.start;
+    }
+    return false;
+}
+
+bool IdleLoopSkipper::is_spin_loop(const BasicBlock &block)
+{
+    if (!loops_to_start(block))
+    {
+        return false;
+    }
+    for (const auto &instruction : block.instructions)
+    {
+        if (!register_only(instruction.code))
+        {
+            return false;
+        }
+
+        auto addr = instruction.operand;
+        switch (OPCODE_TABLE[instruction.code].mode)
+        {
+        case Absolute:
+            if (instruction.code != 0x4c && !readable(addr))
+            {
+                return false;
+            }
+            break;
+        case Absolute_X:
+        case Absolute_Y:
+            // Any index has to stay in RAM or in PRG-ROM
+            if (!(addr >= 0x8000 || addr + 0xff < 0x2000))
+            {
+                return false;
+            }
+            break;
+        default:
+            // Immediate, zero page or no memory operand
+            break;
+        }
+    }
+    return true;
+}
+
+bool IdleLoopSkipper::overridden(uint16_t start) const
+{
+    for (auto entry : overrides)
+    {
+        if (entry == start)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void IdleLoopSkipper::enter(CPU &cpu, const BasicBlock &block)
+{
+    if (!block.spin_loop && !overridden(block.start))
+    {
+        arrivals = 0;
+        return;
+    }
+
+    Bus &bus = *cpu.bus;
+    Snapshot now{cpu.registers.a, cpu.registers.x, cpu.registers.y, cpu.registers.sp, cpu.status()};
+
+    if (arrivals == 0 || head != block.start || (bus.cycles - first_cycles) * 3 >= first_horizon)
+    {
+        // Start over, also when PPUSTATUS may have changed since the first arrival
+        head = block.start;
+        arrivals = 1;
+        first_cycles = bus.cycles;
+        bus.sync_ppu();
+        first_horizon = bus.ppu_cycles_to_next_event();
+    }
+    else if (arrivals >= 2 && now == last)
+    {
+        // The iteration that just repeated the state started after one that
+        // had already read PPUSTATUS, so every later one reads the same values.
+        // Skip those that end before the PPU next changes anything.
+        auto iteration = bus.cycles - last_cycles;
+        bus.sync_ppu();
+        auto skipped = (bus.ppu_cycles_to_next_event() - 1) / (iteration * 3);
+        bus.tick_many(skipped * iteration);
+        arrivals = 0;
+        return;
+    }
+    else
+    {
+        ++arrivals;
+    }
+    last = now;
+    last_cycles = bus.cycles;
+}
+} // namespace EM
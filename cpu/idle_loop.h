@@ -0,0 +1,70 @@
+#ifndef MYNESEMULATOR__IDLE_LOOP_H_
+#define MYNESEMULATOR__IDLE_LOOP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../cartridge/cartridge.h"
+#include "block_cache.h"
+
+namespace EM
+{
+class Bus;
+template <typename Timing, typename BusT> class BasicCPU;
+struct InstructionStep;
+using CPU = BasicCPU<InstructionStep, Bus>;
+
+// Fast-forwards spin loops such as `LDA $2002 / BPL` or `LDA $xx / BEQ`
+// waiting for the NMI handler. A spin loop is a block that loops to its own
+// start, writes nothing and reads only RAM, PRG-ROM and PPUSTATUS. Once an
+// iteration leaves A/X/Y/SP/P exactly as the previous one did, every further
+// iteration does the same until the PPU next changes PPUSTATUS or raises NMI,
+// or the board raises IRQ, so the iterations before that are ticked in bulk
+// instead of executed.
+class IdleLoopSkipper
+{
+  public:
+    // Takes the spin loops the heuristic rejects from rom's RomInfo. rom may
+    // be null.
+    explicit IdleLoopSkipper(const Rom *rom);
+
+    static bool loops_to_start(const BasicBlock &block);
+    static bool is_spin_loop(const BasicBlock &block);
+
+    // Called by the threaded core each time it enters a block that loops to
+    // its start, before running it
+    void enter(CPU &cpu, const BasicBlock &block);
+    // Called for every other block
+    void leave()
+    {
+        arrivals = 0;
+    }
+
+  private:
+    struct Snapshot
+    {
+        uint8_t a, x, y, sp, p;
+
+        bool operator==(const Snapshot &other) const
+        {
+            return a == other.a && x == other.x && y == other.y && sp == other.sp && p == other.p;
+        }
+    };
+
+    bool overridden(uint16_t start) const;
+
+    std::vector<uint16_t> overrides;
+
+    uint16_t head = 0;
+    // Consecutive arrivals at head, with the state and bus cycles of the last
+    size_t arrivals = 0;
+    Snapshot last{};
+    size_t last_cycles = 0;
+    // Bus cycles of the first arrival, and the PPU cycles it had left before
+    // the next PPUSTATUS change
+    size_t first_cycles = 0;
+    size_t first_horizon = 0;
+};
+} // namespace EM
+#endif
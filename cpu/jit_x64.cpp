@@ -0,0 +1,1771 @@
+#include "jit_x64.h"
+
+#include "cpu.h"
+
+#ifdef EM_JIT_X64
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+#include "op_code.h"
+
+namespace EM
+{
+namespace
+{
+// x86-64 general purpose registers, numbered as in the instruction encoding
+enum class Reg : uint8_t
+{
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+enum class Cond : uint8_t
+{
+    Below = 0x2,
+    AboveEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+};
+
+// Group-1 ALU operations, as encoded in the ModRM reg field
+enum class Alu : uint8_t
+{
+    Add = 0,
+    Or = 1,
+    And = 4,
+    Sub = 5,
+    Xor = 6,
+    Cmp = 7,
+};
+
+// [base + index + disp]
+struct Mem
+{
+    Reg base;
+    int32_t disp = 0;
+    std::optional<Reg> index = std::nullopt;
+};
+
+uint8_t low(Reg r)
+{
+    return static_cast<uint8_t>(static_cast<uint8_t>(r) & 7);
+}
+
+bool extended(Reg r)
+{
+    return static_cast<uint8_t>(r) >= 8;
+}
+
+bool fits_int8(int64_t value)
+{
+    return value >= -128 && value <= 127;
+}
+
+// Emits the handful of x86-64 instructions the translator needs into a
+// buffer. Jumps go to labels and are patched in finish(), so the result is
+// position independent and can be copied anywhere in the code arena.
+class Assembler
+{
+  public:
+    using Label = size_t;
+
+    Label new_label()
+    {
+        labels.push_back(UNBOUND);
+        return labels.size() - 1;
+    }
+
+    void bind(Label label)
+    {
+        labels[label] = code.size();
+    }
+
+    size_t size() const
+    {
+        return code.size();
+    }
+
+    // 32-bit register moves zero the upper half, so values stay 0-255
+    void mov(Reg dst, Reg src)
+    {
+        rex(false, src, dst);
+        emit(0x89);
+        modrm(src, dst);
+    }
+
+    void mov(Reg dst, uint32_t imm)
+    {
+        rex(false, Reg::RAX, dst);
+        emit(static_cast<uint8_t>(0xb8 + low(dst)));
+        emit32(imm);
+    }
+
+    void mov64(Reg dst, Reg src)
+    {
+        rex(true, src, dst);
+        emit(0x89);
+        modrm(src, dst);
+    }
+
+    void mov64(Reg dst, uint64_t imm)
+    {
+        rex(true, Reg::RAX, dst);
+        emit(static_cast<uint8_t>(0xb8 + low(dst)));
+        for (int i = 0; i < 8; ++i)
+        {
+            emit(static_cast<uint8_t>(imm >> (8 * i)));
+        }
+    }
+
+    void load64(Reg dst, const Mem &m)
+    {
+        rex_mem(true, dst, m);
+        emit(0x8b);
+        modrm_mem(low(dst), m);
+    }
+
+    void store64(const Mem &m, Reg src)
+    {
+        rex_mem(true, src, m);
+        emit(0x89);
+        modrm_mem(low(src), m);
+    }
+
+    // movzx r32, byte [m]
+    void load8(Reg dst, const Mem &m)
+    {
+        rex_mem(false, dst, m);
+        emit(0x0f);
+        emit(0xb6);
+        modrm_mem(low(dst), m);
+    }
+
+    void store8(const Mem &m, Reg src)
+    {
+        rex_mem(false, src, m, true);
+        emit(0x88);
+        modrm_mem(low(src), m);
+    }
+
+    void store16(const Mem &m, Reg src)
+    {
+        emit(0x66);
+        rex_mem(false, src, m);
+        emit(0x89);
+        modrm_mem(low(src), m);
+    }
+
+    void store16(const Mem &m, uint16_t imm)
+    {
+        emit(0x66);
+        rex_mem(false, Reg::RAX, m);
+        emit(0xc7);
+        modrm_mem(0, m);
+        emit(static_cast<uint8_t>(imm));
+        emit(static_cast<uint8_t>(imm >> 8));
+    }
+
+    void alu(Alu op, Reg dst, Reg src)
+    {
+        rex(false, src, dst);
+        emit(static_cast<uint8_t>(0x01 | static_cast<uint8_t>(op) << 3));
+        modrm(src, dst);
+    }
+
+    void alu(Alu op, Reg dst, int32_t imm)
+    {
+        rex(false, Reg::RAX, dst);
+        alu_imm(op, imm, [&](uint8_t digit) { modrm(digit, dst); });
+    }
+
+    void alu64(Alu op, Reg dst, int32_t imm)
+    {
+        rex(true, Reg::RAX, dst);
+        alu_imm(op, imm, [&](uint8_t digit) { modrm(digit, dst); });
+    }
+
+    // op r64, qword [m]
+    void alu64(Alu op, Reg dst, const Mem &m)
+    {
+        rex_mem(true, dst, m);
+        emit(static_cast<uint8_t>(0x03 | static_cast<uint8_t>(op) << 3));
+        modrm_mem(low(dst), m);
+    }
+
+    void alu64(Alu op, const Mem &m, int32_t imm)
+    {
+        rex_mem(true, Reg::RAX, m);
+        alu_imm(op, imm, [&](uint8_t digit) { modrm_mem(digit, m); });
+    }
+
+    // op byte [m], imm8
+    void alu8(Alu op, const Mem &m, uint8_t imm)
+    {
+        rex_mem(false, Reg::RAX, m);
+        emit(0x80);
+        modrm_mem(static_cast<uint8_t>(op), m);
+        emit(imm);
+    }
+
+    // or byte [m], r8
+    void or8(const Mem &m, Reg src)
+    {
+        rex_mem(false, src, m, true);
+        emit(0x08);
+        modrm_mem(low(src), m);
+    }
+
+    void test(Reg a, Reg b)
+    {
+        rex(false, b, a);
+        emit(0x85);
+        modrm(b, a);
+    }
+
+    void test(Reg r, uint32_t imm)
+    {
+        rex(false, Reg::RAX, r);
+        emit(0xf7);
+        modrm(0, r);
+        emit32(imm);
+    }
+
+    void test8(const Mem &m, uint8_t imm)
+    {
+        rex_mem(false, Reg::RAX, m);
+        emit(0xf6);
+        modrm_mem(0, m);
+        emit(imm);
+    }
+
+    void shl(Reg r, uint8_t count)
+    {
+        shift(4, r, count);
+    }
+
+    void shr(Reg r, uint8_t count)
+    {
+        shift(5, r, count);
+    }
+
+    // setcc on al/cl/dl/bl
+    void setcc(Cond cond, Reg r)
+    {
+        emit(0x0f);
+        emit(static_cast<uint8_t>(0x90 | static_cast<uint8_t>(cond)));
+        modrm(0, r);
+    }
+
+    // movzx r32, al/cl/dl/bl
+    void movzx8(Reg dst, Reg src)
+    {
+        rex(false, dst, src);
+        emit(0x0f);
+        emit(0xb6);
+        modrm(dst, src);
+    }
+
+    // bt r32, r32: CF = bit `bit` of `base`
+    void bt(Reg base, Reg bit)
+    {
+        rex(false, bit, base);
+        emit(0x0f);
+        emit(0xa3);
+        modrm(bit, base);
+    }
+
+    void push(Reg r)
+    {
+        rex(false, Reg::RAX, r);
+        emit(static_cast<uint8_t>(0x50 + low(r)));
+    }
+
+    void pop(Reg r)
+    {
+        rex(false, Reg::RAX, r);
+        emit(static_cast<uint8_t>(0x58 + low(r)));
+    }
+
+    void call(const void *function)
+    {
+        mov64(Reg::RAX, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(function)));
+        emit(0xff);
+        modrm(2, Reg::RAX);
+    }
+
+    void ret()
+    {
+        emit(0xc3);
+    }
+
+    void jmp(Label target)
+    {
+        emit(0xe9);
+        fixup(target);
+    }
+
+    void jcc(Cond cond, Label target)
+    {
+        emit(0x0f);
+        emit(static_cast<uint8_t>(0x80 | static_cast<uint8_t>(cond)));
+        fixup(target);
+    }
+
+    std::vector<uint8_t> finish()
+    {
+        for (const auto &[at, label] : fixups)
+        {
+            if (labels[label] == UNBOUND)
+            {
+                throw std::runtime_error("JIT: jump to an unbound label");
+            }
+            auto rel = static_cast<int32_t>(static_cast<int64_t>(labels[label]) - static_cast<int64_t>(at + 4));
+            std::memcpy(code.data() + at, &rel, sizeof(rel));
+        }
+        return std::move(code);
+    }
+
+  private:
+    static constexpr size_t UNBOUND = SIZE_MAX;
+
+    std::vector<uint8_t> code;
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, Label>> fixups;
+
+    void emit(uint8_t byte)
+    {
+        code.push_back(byte);
+    }
+
+    void emit32(uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            emit(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void fixup(Label target)
+    {
+        fixups.emplace_back(code.size(), target);
+        emit32(0);
+    }
+
+    // REX prefix for register-direct operands. Byte access to spl/bpl/sil/dil
+    // also needs one, but only al/cl/dl/bl and r8b-r15b are used here.
+    void rex(bool w, Reg reg, Reg rm)
+    {
+        auto value = static_cast<uint8_t>(0x40 | (w ? 8 : 0) | (extended(reg) ? 4 : 0) | (extended(rm) ? 1 : 0));
+        if (value != 0x40)
+        {
+            emit(value);
+        }
+    }
+
+    void rex_mem(bool w, Reg reg, const Mem &m, bool byte_reg = false)
+    {
+        bool index = m.index.has_value() && extended(*m.index);
+        auto value = static_cast<uint8_t>(0x40 | (w ? 8 : 0) | (extended(reg) ? 4 : 0) | (index ? 2 : 0) |
+                                          (extended(m.base) ? 1 : 0));
+        bool needs_byte_rex = byte_reg && low(reg) >= 4 && !extended(reg);
+        if (value != 0x40 || needs_byte_rex)
+        {
+            emit(value);
+        }
+    }
+
+    void modrm(uint8_t reg, Reg rm)
+    {
+        emit(static_cast<uint8_t>(0xc0 | (reg & 7) << 3 | low(rm)));
+    }
+
+    void modrm(Reg reg, Reg rm)
+    {
+        modrm(low(reg), rm);
+    }
+
+    void modrm_mem(uint8_t reg, const Mem &m)
+    {
+        uint8_t base = low(m.base);
+        uint8_t mod = 2;
+        if (m.disp == 0 && base != 5)
+        {
+            mod = 0;
+        }
+        else if (fits_int8(m.disp))
+        {
+            mod = 1;
+        }
+
+        if (!m.index.has_value() && base != 4)
+        {
+            emit(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | base));
+        }
+        else
+        {
+            uint8_t index = m.index.has_value() ? low(*m.index) : 4;
+            emit(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | 4));
+            emit(static_cast<uint8_t>(index << 3 | base));
+        }
+
+        if (mod == 1)
+        {
+            emit(static_cast<uint8_t>(m.disp));
+        }
+        else if (mod == 2)
+        {
+            emit32(static_cast<uint32_t>(m.disp));
+        }
+    }
+
+    template <typename F> void alu_imm(Alu op, int32_t imm, F &&modrm_for)
+    {
+        if (fits_int8(imm))
+        {
+            emit(0x83);
+            modrm_for(static_cast<uint8_t>(op));
+            emit(static_cast<uint8_t>(imm));
+        }
+        else
+        {
+            emit(0x81);
+            modrm_for(static_cast<uint8_t>(op));
+            emit32(static_cast<uint32_t>(imm));
+        }
+    }
+
+    void shift(uint8_t digit, Reg r, uint8_t count)
+    {
+        rex(false, Reg::RAX, r);
+        emit(0xc1);
+        modrm(digit, r);
+        emit(count);
+    }
+};
+
+// Guest state in host registers. All of them are callee-saved in the
+// System V ABI, so Bus and CPU code called from a block leaves them alone.
+constexpr Reg CONTEXT = Reg::RBX;
+constexpr Reg RAM_BASE = Reg::RBP;
+constexpr Reg REG_A = Reg::R12;
+constexpr Reg REG_X = Reg::R13;
+constexpr Reg REG_Y = Reg::R14;
+constexpr Reg REG_P = Reg::R15;
+
+// Matches the scanline length in NesPPU::tick()
+
+constexpr auto CONTEXT_REGISTERS = static_cast<int32_t>(offsetof(JitContext, registers));
+constexpr auto CONTEXT_RAM = static_cast<int32_t>(offsetof(JitContext, ram));
+constexpr auto CONTEXT_EXIT = static_cast<int32_t>(offsetof(JitContext, exit));
+constexpr auto CONTEXT_FAULT = static_cast<int32_t>(offsetof(JitContext, fault));
+constexpr auto CONTEXT_NZ = static_cast<int32_t>(offsetof(JitContext, nz));
+
+int32_t field(size_t offset)
+{
+    return static_cast<int32_t>(offset);
+}
+
+// Distance from the start of RAM to another member of the same Bus, so the
+// block can reach it through RAM_BASE
+template <typename T> int32_t ram_offset(Bus &bus, T &member)
+{
+    return static_cast<int32_t>(reinterpret_cast<const uint8_t *>(&member) - bus.ram.data());
+}
+
+// Runs one instruction whose opcode byte is at pc - 1, the same way as
+// run_with_callback()
+void execute(CPU &cpu, const OpCode &op)
+{
+    auto state = cpu.registers.pc;
+    cpu.set_status(cpu.registers.p);
+    try
+    {
+        (cpu.*op.handler)();
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << "Runtime error: " << e.what();
+        std::cerr << " Opcode: " << op.mnemonic << " 0x" << std::hex << static_cast<int>(op.code);
+        std::cerr << " PC: " << cpu.registers.pc;
+        std::cerr << std::endl;
+    }
+    cpu.registers.p = cpu.status();
+
+    cpu.bus->tick(op.cycles);
+
+    if (state == cpu.registers.pc)
+    {
+        cpu.registers.pc += static_cast<uint16_t>(op.len - 1);
+    }
+}
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// Translation of one basic block
+class JitTranslator
+{
+  public:
+    JitTranslator(JitX64 &jit, const BasicBlock &block) : jit(jit), bus(jit.bus), block(block)
+    {
+        bus_cycles = ram_offset(bus, bus.cycles);
+        code_pages = ram_offset(bus, bus.ram_code_pages);
+        next_event = ram_offset(bus, bus.scheduler.next);
+
+        // Fixed PRG-ROM is mapped the same way for every board that has it:
+        // the image mirrored over $8000-$FFFF. Cheats patch copies of pages
+        // and mappers switch banks, which only the page table knows.
+        const auto &prg = bus.rom->prg_rom;
+        prg_fixed = bus.mapper->fixed_prg();
+        prg_direct = prg_fixed && (prg.size() == 0x4000 || prg.size() >= 0x8000) && !bus.has_read_patches();
+        prg_base = reinterpret_cast<uintptr_t>(prg.data());
+        prg_mask = prg.size() == 0x4000 ? 0x3fff : 0x7fff;
+    }
+
+    std::vector<uint8_t> translate()
+    {
+        prologue();
+        loop = as.new_label();
+        exit_with_pc = as.new_label();
+        exit_pc_set = as.new_label();
+        as.bind(loop);
+
+        const auto &instructions = block.instructions;
+        for (size_t i = 0; i < instructions.size(); ++i)
+        {
+            instruction(instructions[i], i + 1 == instructions.size());
+        }
+
+        for (auto &path : cold_paths)
+        {
+            path();
+        }
+        for (const auto &[pc, label] : exits)
+        {
+            as.bind(label);
+            as.mov(Reg::RAX, pc);
+            as.jmp(exit_with_pc);
+        }
+        epilogue();
+        return as.finish();
+    }
+
+  private:
+    using Label = Assembler::Label;
+
+    JitX64 &jit;
+    Bus &bus;
+    const BasicBlock &block;
+    Assembler as;
+
+    int32_t bus_cycles = 0;
+    int32_t code_pages = 0;
+    int32_t next_event = 0;
+    bool prg_fixed = false;
+    bool prg_direct = false;
+    uintptr_t prg_base = 0;
+    uint32_t prg_mask = 0;
+
+    Label loop = 0;
+    Label exit_with_pc = 0;
+    Label exit_pc_set = 0;
+    std::map<uint16_t, Label> exits;
+    std::vector<std::function<void()>> cold_paths;
+    // The current instruction called a helper that may have set context.exit
+    bool check_exit = false;
+    // Where the current instruction goes when a Bus access threw
+    std::optional<Label> fault;
+
+    Label exit_to(uint16_t pc)
+    {
+        auto it = exits.find(pc);
+        if (it == exits.end())
+        {
+            it = exits.emplace(pc, as.new_label()).first;
+        }
+        return it->second;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Entry and exit
+    void prologue()
+    {
+        as.push(Reg::RBX);
+        as.push(Reg::RBP);
+        as.push(Reg::R12);
+        as.push(Reg::R13);
+        as.push(Reg::R14);
+        as.push(Reg::R15);
+        // Keep rsp 16-byte aligned for helper calls; [rsp] is scratch
+        as.alu64(Alu::Sub, Reg::RSP, 8);
+        as.mov64(CONTEXT, Reg::RDI);
+        as.load64(RAM_BASE, {CONTEXT, CONTEXT_RAM});
+        reload_registers();
+    }
+
+    void epilogue()
+    {
+        as.bind(exit_with_pc);
+        as.load64(Reg::RDX, {CONTEXT, CONTEXT_REGISTERS});
+        as.store16({Reg::RDX, field(offsetof(Registers, pc))}, Reg::RAX);
+        as.bind(exit_pc_set);
+        write_back_registers();
+        as.alu64(Alu::Add, Reg::RSP, 8);
+        as.pop(Reg::R15);
+        as.pop(Reg::R14);
+        as.pop(Reg::R13);
+        as.pop(Reg::R12);
+        as.pop(Reg::RBP);
+        as.pop(Reg::RBX);
+        as.ret();
+    }
+
+    void write_back_registers()
+    {
+        as.load64(Reg::RDX, {CONTEXT, CONTEXT_REGISTERS});
+        as.store8({Reg::RDX, field(offsetof(Registers, a))}, REG_A);
+        as.store8({Reg::RDX, field(offsetof(Registers, x))}, REG_X);
+        as.store8({Reg::RDX, field(offsetof(Registers, y))}, REG_Y);
+        as.store8({Reg::RDX, field(offsetof(Registers, p))}, REG_P);
+    }
+
+    void write_back_registers(uint16_t pc)
+    {
+        write_back_registers();
+        as.store16({Reg::RDX, field(offsetof(Registers, pc))}, pc);
+    }
+
+    void reload_registers()
+    {
+        as.load64(Reg::RDX, {CONTEXT, CONTEXT_REGISTERS});
+        as.load8(REG_A, {Reg::RDX, field(offsetof(Registers, a))});
+        as.load8(REG_X, {Reg::RDX, field(offsetof(Registers, x))});
+        as.load8(REG_Y, {Reg::RDX, field(offsetof(Registers, y))});
+        as.load8(REG_P, {Reg::RDX, field(offsetof(Registers, p))});
+    }
+
+    void call_helper(const void *helper)
+    {
+        as.mov64(Reg::RDI, CONTEXT);
+        as.call(helper);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Timing
+    //
+    // Advances the bus by `cycles`. Before the scheduler's next event only
+    // the cycle counter moves; reaching it calls Bus::tick() out of line
+    // with the registers written back, since interrupts, the frame callback
+    // and the OAM DMA stall can only happen there. `pc` is what registers.pc
+    // holds at this point in the interpreter. The instruction's last tick
+    // leaves the block at `exit_pc` if NMI or IRQ was raised; earlier ones
+    // defer that to the end of the instruction.
+    void tick(uint8_t cycles, uint16_t pc, std::optional<uint16_t> exit_pc = std::nullopt)
+    {
+        Label slow = as.new_label();
+        Label done = as.new_label();
+
+        as.load64(Reg::RAX, {RAM_BASE, bus_cycles});
+        as.alu64(Alu::Add, Reg::RAX, cycles);
+        as.alu64(Alu::Cmp, Reg::RAX, {RAM_BASE, next_event});
+        as.jcc(Cond::AboveEqual, slow);
+        as.store64({RAM_BASE, bus_cycles}, Reg::RAX);
+        as.bind(done);
+
+        if (!exit_pc)
+        {
+            check_exit = true;
+        }
+        cold_paths.push_back([this, slow, done, cycles, pc, exit_pc] {
+            as.bind(slow);
+            write_back_registers(pc);
+            as.mov(Reg::RSI, cycles);
+            call_helper(reinterpret_cast<const void *>(&JitX64::tick_helper));
+            if (exit_pc)
+            {
+                as.movzx8(Reg::RAX, Reg::RAX);
+                as.test(Reg::RAX, Reg::RAX);
+                as.jcc(Cond::NotEqual, exit_to(*exit_pc));
+            }
+            else
+            {
+                as.or8({CONTEXT, CONTEXT_EXIT}, Reg::RAX);
+            }
+            as.jmp(done);
+        });
+    }
+
+    // Leaves the block at `pc` if a helper asked for it during this instruction
+    void end_instruction(uint16_t pc)
+    {
+        if (check_exit)
+        {
+            as.alu8(Alu::Cmp, {CONTEXT, CONTEXT_EXIT}, 0);
+            as.jcc(Cond::NotEqual, exit_to(pc));
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Memory access
+
+    // Leaves the effective address in ecx, or returns it when it is known
+    // at translation time. Uses eax.
+    std::optional<uint16_t> address(AddressingMode mode, uint16_t operand)
+    {
+        auto zero_page = static_cast<int32_t>(operand & 0xff);
+        switch (mode)
+        {
+        case ZeroPage:
+            return static_cast<uint16_t>(zero_page);
+        case Absolute:
+            return operand;
+        case ZeroPage_X:
+        case ZeroPage_Y:
+            as.mov(Reg::RCX, mode == ZeroPage_X ? REG_X : REG_Y);
+            as.alu(Alu::Add, Reg::RCX, zero_page);
+            as.alu(Alu::And, Reg::RCX, 0xff);
+            return std::nullopt;
+        case Absolute_X:
+        case Absolute_Y:
+            as.mov(Reg::RCX, mode == Absolute_X ? REG_X : REG_Y);
+            as.alu(Alu::Add, Reg::RCX, operand);
+            as.alu(Alu::And, Reg::RCX, 0xffff);
+            return std::nullopt;
+        case Indirect_X:
+            as.mov(Reg::RAX, REG_X);
+            as.alu(Alu::Add, Reg::RAX, zero_page);
+            as.alu(Alu::And, Reg::RAX, 0xff);
+            as.load8(Reg::RCX, {RAM_BASE, 0, Reg::RAX});
+            as.alu(Alu::Add, Reg::RAX, 1);
+            as.alu(Alu::And, Reg::RAX, 0xff);
+            as.load8(Reg::RAX, {RAM_BASE, 0, Reg::RAX});
+            as.shl(Reg::RAX, 8);
+            as.alu(Alu::Or, Reg::RCX, Reg::RAX);
+            return std::nullopt;
+        case Indirect_Y:
+            as.load8(Reg::RCX, {RAM_BASE, zero_page});
+            as.load8(Reg::RAX, {RAM_BASE, (zero_page + 1) & 0xff});
+            as.shl(Reg::RAX, 8);
+            as.alu(Alu::Or, Reg::RCX, Reg::RAX);
+            as.alu(Alu::Add, Reg::RCX, REG_Y);
+            as.alu(Alu::And, Reg::RCX, 0xffff);
+            return std::nullopt;
+        default:
+            throw std::runtime_error("JIT: unsupported addressing mode");
+        }
+    }
+
+    // Sets esi to 1 when the indexed access crossed a page. Only depends on
+    // registers and zero page, so it can run after the access itself.
+    bool page_cross(AddressingMode mode, uint16_t operand)
+    {
+        auto zero_page = static_cast<int32_t>(operand & 0xff);
+        switch (mode)
+        {
+        case Absolute_X:
+        case Absolute_Y:
+            as.mov(Reg::RSI, mode == Absolute_X ? REG_X : REG_Y);
+            as.alu(Alu::Add, Reg::RSI, zero_page);
+            as.shr(Reg::RSI, 8);
+            return true;
+        case Indirect_Y:
+            as.load8(Reg::RSI, {RAM_BASE, zero_page});
+            as.alu(Alu::Add, Reg::RSI, REG_Y);
+            as.shr(Reg::RSI, 8);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void read_helper_call()
+    {
+        call_helper(reinterpret_cast<const void *>(&JitX64::read_helper));
+        as.movzx8(Reg::RAX, Reg::RAX);
+        check_fault();
+        check_exit = true;
+    }
+
+    void check_fault()
+    {
+        if (!fault)
+        {
+            fault = as.new_label();
+        }
+        as.alu8(Alu::Cmp, {CONTEXT, CONTEXT_FAULT}, 0);
+        as.jcc(Cond::NotEqual, *fault);
+    }
+
+    void read_static(uint16_t addr)
+    {
+        if (addr <= RAM_MIRRORS_END)
+        {
+            as.load8(Reg::RAX, {RAM_BASE, addr & 0x07ff});
+        }
+        else if (addr >= 0x8000 && bus.read_pages[addr >> 8] && prg_fixed)
+        {
+            as.mov64(Reg::RAX, reinterpret_cast<uint64_t>(bus.read_pages[addr >> 8] + (addr & 0xff)));
+            as.load8(Reg::RAX, {Reg::RAX});
+        }
+        else if (addr >= 0x6000)
+        {
+            // Switchable banks: the page table entry as of the access
+            Label through_bus = as.new_label();
+            Label done = as.new_label();
+            as.mov64(Reg::RAX, reinterpret_cast<uint64_t>(&bus.read_pages[addr >> 8]));
+            as.load64(Reg::RAX, {Reg::RAX});
+            as.alu64(Alu::Cmp, Reg::RAX, 0);
+            as.jcc(Cond::Equal, through_bus);
+            as.load8(Reg::RAX, {Reg::RAX, addr & 0xff});
+            as.jmp(done);
+            as.bind(through_bus);
+            as.mov(Reg::RSI, addr);
+            read_helper_call();
+            as.bind(done);
+        }
+        else
+        {
+            as.mov(Reg::RSI, addr);
+            read_helper_call();
+        }
+    }
+
+    // Reads the byte at the address in ecx into eax. ecx survives unless
+    // the access had to go through Bus.
+    void read_dynamic()
+    {
+        Label not_ram = as.new_label();
+        Label through_bus = as.new_label();
+        Label done = as.new_label();
+
+        as.alu(Alu::Cmp, Reg::RCX, RAM_MIRRORS_END + 1);
+        as.jcc(Cond::AboveEqual, not_ram);
+        as.mov(Reg::RAX, Reg::RCX);
+        as.alu(Alu::And, Reg::RAX, 0x07ff);
+        as.load8(Reg::RAX, {RAM_BASE, 0, Reg::RAX});
+        as.jmp(done);
+
+        as.bind(not_ram);
+        if (prg_direct)
+        {
+            as.alu(Alu::Cmp, Reg::RCX, 0x8000);
+            as.jcc(Cond::Below, through_bus);
+            as.mov(Reg::RAX, Reg::RCX);
+            as.alu(Alu::And, Reg::RAX, static_cast<int32_t>(prg_mask));
+            as.mov64(Reg::RDX, static_cast<uint64_t>(prg_base));
+            as.load8(Reg::RAX, {Reg::RDX, 0, Reg::RAX});
+            as.jmp(done);
+        }
+        else
+        {
+            // Through the page table; a null entry goes to Bus
+            as.mov(Reg::RAX, Reg::RCX);
+            as.shr(Reg::RAX, 8);
+            as.shl(Reg::RAX, 3);
+            as.mov64(Reg::RDX, reinterpret_cast<uint64_t>(bus.read_pages.data()));
+            as.load64(Reg::RDX, {Reg::RDX, 0, Reg::RAX});
+            as.alu64(Alu::Cmp, Reg::RDX, 0);
+            as.jcc(Cond::Equal, through_bus);
+            as.mov(Reg::RAX, Reg::RCX);
+            as.alu(Alu::And, Reg::RAX, 0xff);
+            as.load8(Reg::RAX, {Reg::RDX, 0, Reg::RAX});
+            as.jmp(done);
+        }
+
+        as.bind(through_bus);
+        as.mov(Reg::RSI, Reg::RCX);
+        read_helper_call();
+        as.bind(done);
+    }
+
+    // Operand value into eax; `cross` tells whether esi needs checking after
+    void read(AddressingMode mode, uint16_t operand)
+    {
+        if (mode == Immediate)
+        {
+            as.mov(Reg::RAX, static_cast<uint32_t>(operand & 0xff));
+            return;
+        }
+        if (auto addr = address(mode, operand))
+        {
+            read_static(*addr);
+        }
+        else
+        {
+            read_dynamic();
+        }
+    }
+
+    void write_helper_call()
+    {
+        as.mov(Reg::RDX, Reg::RAX);
+        call_helper(reinterpret_cast<const void *>(&JitX64::write_helper));
+        check_fault();
+        check_exit = true;
+    }
+
+    // Writes eax to a known address. A RAM page holding translated code is
+    // handed to Bus::write so the block cache sees the change.
+    void write_static(uint16_t addr)
+    {
+        if (addr <= RAM_MIRRORS_END)
+        {
+            Label done = as.new_label();
+            auto mirrored = static_cast<int32_t>(addr & 0x07ff);
+            as.store8({RAM_BASE, mirrored}, Reg::RAX);
+            as.test8({RAM_BASE, code_pages}, static_cast<uint8_t>(1 << (mirrored >> 8)));
+            as.jcc(Cond::Equal, done);
+            as.mov(Reg::RSI, addr);
+            write_helper_call();
+            as.bind(done);
+        }
+        else
+        {
+            as.mov(Reg::RSI, addr);
+            write_helper_call();
+        }
+    }
+
+    // Writes eax to the address in ecx
+    void write_dynamic()
+    {
+        Label through_bus = as.new_label();
+        Label done = as.new_label();
+
+        as.alu(Alu::Cmp, Reg::RCX, RAM_MIRRORS_END + 1);
+        as.jcc(Cond::AboveEqual, through_bus);
+        as.mov(Reg::RDX, Reg::RCX);
+        as.alu(Alu::And, Reg::RDX, 0x07ff);
+        as.store8({RAM_BASE, 0, Reg::RDX}, Reg::RAX);
+        as.shr(Reg::RDX, 8);
+        as.load8(Reg::RSI, {RAM_BASE, code_pages});
+        as.bt(Reg::RSI, Reg::RDX);
+        as.jcc(Cond::AboveEqual, done);
+
+        as.bind(through_bus);
+        as.mov(Reg::RSI, Reg::RCX);
+        write_helper_call();
+        as.bind(done);
+    }
+
+    void write(std::optional<uint16_t> addr)
+    {
+        if (addr)
+        {
+            write_static(*addr);
+        }
+        else
+        {
+            write_dynamic();
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Flags
+
+    // N and Z from the byte in eax
+    void update_zero_and_negative_flags()
+    {
+        as.alu(Alu::And, REG_P, static_cast<uint8_t>(~(N | Z)));
+        as.load8(Reg::RDX, {CONTEXT, CONTEXT_NZ, Reg::RAX});
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+    }
+
+    void update_negative_flag()
+    {
+        as.alu(Alu::And, REG_P, static_cast<uint8_t>(~N));
+        as.mov(Reg::RDX, Reg::RAX);
+        as.alu(Alu::And, Reg::RDX, N);
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+    }
+
+    void set_flag(CpuFlags flag, bool value)
+    {
+        if (value)
+        {
+            as.alu(Alu::Or, REG_P, flag);
+        }
+        else
+        {
+            as.alu(Alu::And, REG_P, static_cast<uint8_t>(~flag));
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Instructions
+
+    void load(Reg target)
+    {
+        as.mov(target, Reg::RAX);
+        update_zero_and_negative_flags();
+    }
+
+    // INX/INY/DEX/DEY
+    void increment(Reg target, Alu op)
+    {
+        as.mov(Reg::RAX, target);
+        as.alu(op, Reg::RAX, 1);
+        as.alu(Alu::And, Reg::RAX, 0xff);
+        load(target);
+    }
+
+    // A op= eax
+    void logic(Alu op)
+    {
+        as.alu(op, Reg::RAX, REG_A);
+        as.mov(REG_A, Reg::RAX);
+        update_zero_and_negative_flags();
+    }
+
+    void add_to_register_a()
+    {
+        as.mov(Reg::RCX, Reg::RAX);
+        as.mov(Reg::RAX, REG_A);
+        as.mov(Reg::RDX, REG_P);
+        as.alu(Alu::And, Reg::RDX, C);
+        as.alu(Alu::Add, Reg::RAX, Reg::RCX);
+        as.alu(Alu::Add, Reg::RAX, Reg::RDX);
+
+        // V from (data ^ result) & (a ^ result) & 0x80
+        as.mov(Reg::RDX, Reg::RAX);
+        as.alu(Alu::Xor, Reg::RDX, Reg::RCX);
+        as.mov(Reg::RSI, Reg::RAX);
+        as.alu(Alu::Xor, Reg::RSI, REG_A);
+        as.alu(Alu::And, Reg::RDX, Reg::RSI);
+        as.alu(Alu::And, Reg::RDX, 0x80);
+        as.shr(Reg::RDX, 1);
+        as.alu(Alu::And, REG_P, static_cast<uint8_t>(~(C | V)));
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+
+        // C from the ninth bit of the sum
+        as.mov(Reg::RDX, Reg::RAX);
+        as.shr(Reg::RDX, 8);
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+
+        as.alu(Alu::And, Reg::RAX, 0xff);
+        as.mov(REG_A, Reg::RAX);
+        update_zero_and_negative_flags();
+    }
+
+    void compare(Reg with)
+    {
+        as.mov(Reg::RCX, Reg::RAX);
+        as.mov(Reg::RAX, with);
+        as.alu(Alu::Cmp, Reg::RAX, Reg::RCX);
+        as.setcc(Cond::AboveEqual, Reg::RDX);
+        as.movzx8(Reg::RDX, Reg::RDX);
+        as.alu(Alu::And, REG_P, static_cast<uint8_t>(~C));
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+        as.alu(Alu::Sub, Reg::RAX, Reg::RCX);
+        as.alu(Alu::And, Reg::RAX, 0xff);
+        update_zero_and_negative_flags();
+    }
+
+    void bit()
+    {
+        as.alu(Alu::And, REG_P, static_cast<uint8_t>(~(Z | V | N)));
+        as.mov(Reg::RDX, Reg::RAX);
+        as.alu(Alu::And, Reg::RDX, N);
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+
+        // Same V test as CPU::BIT
+        as.test(Reg::RAX, 0b0100'1000);
+        as.setcc(Cond::NotEqual, Reg::RDX);
+        as.movzx8(Reg::RDX, Reg::RDX);
+        as.shl(Reg::RDX, 6);
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+
+        as.test(Reg::RAX, REG_A);
+        as.setcc(Cond::Equal, Reg::RDX);
+        as.movzx8(Reg::RDX, Reg::RDX);
+        as.shl(Reg::RDX, 1);
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+    }
+
+    // Ordered like bits 5-6 of the opcode
+    enum class Shift
+    {
+        ASL,
+        ROL,
+        LSR,
+        ROR,
+    };
+
+    // Shifts eax and updates C; the caller sets N/Z like the matching handler
+    void shift(Shift kind)
+    {
+        if (kind == Shift::ROL || kind == Shift::ROR)
+        {
+            as.mov(Reg::RSI, REG_P);
+            as.alu(Alu::And, Reg::RSI, C);
+            if (kind == Shift::ROR)
+            {
+                as.shl(Reg::RSI, 7);
+            }
+        }
+
+        as.mov(Reg::RDX, Reg::RAX);
+        if (kind == Shift::ASL || kind == Shift::ROL)
+        {
+            as.shr(Reg::RDX, 7);
+            as.shl(Reg::RAX, 1);
+            as.alu(Alu::And, Reg::RAX, 0xff);
+        }
+        else
+        {
+            as.alu(Alu::And, Reg::RDX, C);
+            as.shr(Reg::RAX, 1);
+        }
+        as.alu(Alu::And, REG_P, static_cast<uint8_t>(~C));
+        as.alu(Alu::Or, REG_P, Reg::RDX);
+
+        if (kind == Shift::ROL || kind == Shift::ROR)
+        {
+            as.alu(Alu::Or, Reg::RAX, Reg::RSI);
+        }
+    }
+
+    void shift_accumulator(Shift kind)
+    {
+        as.mov(Reg::RAX, REG_A);
+        shift(kind);
+        as.mov(REG_A, Reg::RAX);
+        update_zero_and_negative_flags();
+    }
+
+    // Read-modify-write on memory. The address is parked in [rsp] because a
+    // read through Bus clobbers ecx.
+    template <typename F> void modify(AddressingMode mode, uint16_t operand, F &&operation)
+    {
+        auto addr = address(mode, operand);
+        if (addr)
+        {
+            read_static(*addr);
+        }
+        else
+        {
+            as.store64({Reg::RSP}, Reg::RCX);
+            read_dynamic();
+            as.load64(Reg::RCX, {Reg::RSP});
+        }
+        operation();
+        write(addr);
+    }
+
+    void fallback(const DecodedInstruction &instruction, bool last)
+    {
+        // The handler works on CPU::registers, so hand the registers over
+        write_back_registers();
+        as.mov(Reg::RSI, static_cast<uint32_t>(instruction.pc | instruction.code << 16));
+        as.mov(Reg::RDX, instruction.operand);
+        call_helper(reinterpret_cast<const void *>(&JitX64::execute_helper));
+        reload_registers();
+        as.movzx8(Reg::RAX, Reg::RAX);
+        as.test(Reg::RAX, Reg::RAX);
+        as.jcc(Cond::NotEqual, exit_pc_set);
+        if (last)
+        {
+            as.jmp(exit_pc_set);
+        }
+    }
+
+    // Continues at `target` after a taken branch or jump, with the same PC
+    // adjustment as the interpreter when the target is the next opcode
+    void transfer(const DecodedInstruction &instruction, uint16_t target)
+    {
+        const OpCode &op = OPCODE_TABLE[instruction.code];
+        auto after_opcode = static_cast<uint16_t>(instruction.pc + 1);
+        auto final_pc = target == after_opcode ? static_cast<uint16_t>(target + op.len - 1) : target;
+
+        tick(op.cycles, target, final_pc);
+        end_instruction(final_pc);
+        if (final_pc == block.start)
+        {
+            as.jmp(loop);
+        }
+        else
+        {
+            as.jmp(exit_to(final_pc));
+        }
+    }
+
+    void branch(const DecodedInstruction &instruction, CpuFlags flag, bool taken_when_set)
+    {
+        const OpCode &op = OPCODE_TABLE[instruction.code];
+        auto after_opcode = static_cast<uint16_t>(instruction.pc + 1);
+        auto next = static_cast<uint16_t>(instruction.pc + op.len);
+        auto target = static_cast<uint16_t>(next + static_cast<uint16_t>(static_cast<int8_t>(instruction.operand)));
+
+        Label not_taken = as.new_label();
+        as.test(REG_P, flag);
+        as.jcc(taken_when_set ? Cond::Equal : Cond::NotEqual, not_taken);
+
+        tick(1, after_opcode);
+        if ((next & 0xff00) != (target & 0xff00))
+        {
+            tick(1, after_opcode);
+        }
+        transfer(instruction, target);
+
+        as.bind(not_taken);
+        check_exit = false;
+        tick(op.cycles, after_opcode, next);
+        as.jmp(exit_to(next));
+    }
+
+    void instruction(const DecodedInstruction &instruction, bool last)
+    {
+        const OpCode &op = OPCODE_TABLE[instruction.code];
+        const AddressingMode mode = op.mode;
+        const uint16_t operand = instruction.operand;
+        auto after_opcode = static_cast<uint16_t>(instruction.pc + 1);
+        auto next = static_cast<uint16_t>(instruction.pc + op.len);
+        bool reads_operand = false;
+
+        check_exit = false;
+        fault.reset();
+
+        switch (instruction.code)
+        {
+        /* Loads and stores */
+        case 0xa9: case 0xa5: case 0xb5: case 0xad: case 0xbd: case 0xb9: case 0xa1: case 0xb1:
+            read(mode, operand);
+            load(REG_A);
+            reads_operand = true;
+            break;
+        case 0xa2: case 0xa6: case 0xb6: case 0xae: case 0xbe:
+            read(mode, operand);
+            load(REG_X);
+            reads_operand = true;
+            break;
+        case 0xa0: case 0xa4: case 0xb4: case 0xac: case 0xbc:
+            read(mode, operand);
+            load(REG_Y);
+            reads_operand = true;
+            break;
+        case 0x85: case 0x95: case 0x8d: case 0x9d: case 0x99: case 0x81: case 0x91: {
+            auto addr = address(mode, operand);
+            as.mov(Reg::RAX, REG_A);
+            write(addr);
+            break;
+        }
+        case 0x86: case 0x96: case 0x8e: {
+            auto addr = address(mode, operand);
+            as.mov(Reg::RAX, REG_X);
+            write(addr);
+            break;
+        }
+        case 0x84: case 0x94: case 0x8c: {
+            auto addr = address(mode, operand);
+            as.mov(Reg::RAX, REG_Y);
+            write(addr);
+            break;
+        }
+
+        /* Arithmetic and logic */
+        case 0x29: case 0x25: case 0x35: case 0x2d: case 0x3d: case 0x39: case 0x21: case 0x31:
+            read(mode, operand);
+            logic(Alu::And);
+            reads_operand = true;
+            break;
+        case 0x09: case 0x05: case 0x15: case 0x0d: case 0x1d: case 0x19: case 0x01: case 0x11:
+            read(mode, operand);
+            logic(Alu::Or);
+            reads_operand = true;
+            break;
+        case 0x49: case 0x45: case 0x55: case 0x4d: case 0x5d: case 0x59: case 0x41: case 0x51:
+            read(mode, operand);
+            logic(Alu::Xor);
+            reads_operand = true;
+            break;
+        case 0x69: case 0x65: case 0x75: case 0x6d: case 0x7d: case 0x79: case 0x61: case 0x71:
+            read(mode, operand);
+            add_to_register_a();
+            reads_operand = true;
+            break;
+        case 0xc9: case 0xc5: case 0xd5: case 0xcd: case 0xdd: case 0xd9: case 0xc1: case 0xd1:
+            read(mode, operand);
+            compare(REG_A);
+            reads_operand = true;
+            break;
+        case 0xe0: case 0xe4: case 0xec:
+            read(mode, operand);
+            compare(REG_X);
+            reads_operand = true;
+            break;
+        case 0xc0: case 0xc4: case 0xcc:
+            read(mode, operand);
+            compare(REG_Y);
+            reads_operand = true;
+            break;
+        case 0x24: case 0x2c:
+            read(mode, operand);
+            bit();
+            break;
+
+        /* Read-modify-write */
+        case 0xe6: case 0xf6: case 0xee: case 0xfe:
+        case 0xc6: case 0xd6: case 0xce: case 0xde: {
+            bool increment = (instruction.code & 0xe0) == 0xe0;
+            modify(mode, operand, [&] {
+                as.alu(increment ? Alu::Add : Alu::Sub, Reg::RAX, 1);
+                as.alu(Alu::And, Reg::RAX, 0xff);
+                update_zero_and_negative_flags();
+            });
+            break;
+        }
+        case 0x06: case 0x16: case 0x0e: case 0x1e:
+        case 0x46: case 0x56: case 0x4e: case 0x5e:
+        case 0x26: case 0x36: case 0x2e: case 0x3e:
+        case 0x66: case 0x76: case 0x6e: case 0x7e: {
+            auto kind = static_cast<Shift>(instruction.code >> 5);
+            modify(mode, operand, [&] {
+                shift(kind);
+                // ROL and ROR on memory only update N
+                if (kind == Shift::ROL || kind == Shift::ROR)
+                {
+                    update_negative_flag();
+                }
+                else
+                {
+                    update_zero_and_negative_flags();
+                }
+            });
+            break;
+        }
+        case 0x0a: case 0x4a: case 0x2a: case 0x6a:
+            shift_accumulator(static_cast<Shift>(instruction.code >> 5));
+            break;
+
+        /* Register transfers, increments and flags */
+        case 0xaa:
+            as.mov(Reg::RAX, REG_A);
+            load(REG_X);
+            break;
+        case 0xa8:
+            as.mov(Reg::RAX, REG_A);
+            load(REG_Y);
+            break;
+        case 0x8a:
+            as.mov(Reg::RAX, REG_X);
+            load(REG_A);
+            break;
+        case 0x98:
+            as.mov(Reg::RAX, REG_Y);
+            load(REG_A);
+            break;
+        case 0xba:
+            as.load64(Reg::RDX, {CONTEXT, CONTEXT_REGISTERS});
+            as.load8(Reg::RAX, {Reg::RDX, field(offsetof(Registers, sp))});
+            load(REG_X);
+            break;
+        case 0x9a:
+            as.load64(Reg::RDX, {CONTEXT, CONTEXT_REGISTERS});
+            as.store8({Reg::RDX, field(offsetof(Registers, sp))}, REG_X);
+            break;
+        case 0xe8:
+            increment(REG_X, Alu::Add);
+            break;
+        case 0xc8:
+            increment(REG_Y, Alu::Add);
+            break;
+        case 0xca:
+            increment(REG_X, Alu::Sub);
+            break;
+        case 0x88:
+            increment(REG_Y, Alu::Sub);
+            break;
+        case 0x18:
+            set_flag(C, false);
+            break;
+        case 0x38:
+            set_flag(C, true);
+            break;
+        case 0x78:
+            set_flag(I, true);
+            break;
+        case 0xb8:
+            set_flag(V, false);
+            break;
+        case 0xd8:
+            set_flag(D, false);
+            break;
+        case 0xf8:
+            set_flag(D, true);
+            break;
+        case 0xea:
+            break;
+        case 0x00:
+            // BRK behaves like CLD, see CPU::BRK
+            set_flag(D, false);
+            break;
+
+        /* Control transfers */
+        case 0x4c:
+            transfer(instruction, operand);
+            return;
+        case 0x10:
+            branch(instruction, N, false);
+            return;
+        case 0x30:
+            branch(instruction, N, true);
+            return;
+        case 0x50:
+            branch(instruction, V, false);
+            return;
+        case 0x70:
+            branch(instruction, V, true);
+            return;
+        case 0x90:
+            branch(instruction, C, false);
+            return;
+        case 0xb0:
+            branch(instruction, C, true);
+            return;
+        case 0xd0:
+            branch(instruction, Z, false);
+            return;
+        case 0xf0:
+            branch(instruction, Z, true);
+            return;
+
+        default:
+            fallback(instruction, last);
+            return;
+        }
+
+        if (reads_operand && page_cross(mode, operand))
+        {
+            Label same_page = as.new_label();
+            as.test(Reg::RSI, Reg::RSI);
+            as.jcc(Cond::Equal, same_page);
+            tick(1, after_opcode);
+            as.bind(same_page);
+        }
+
+        // A faulting access skips the rest of the handler but still ticks
+        if (fault)
+        {
+            Label finish = as.new_label();
+            as.bind(finish);
+            cold_paths.push_back([this, label = *fault, finish, instruction] {
+                as.bind(label);
+                as.mov(Reg::RSI, static_cast<uint32_t>(instruction.pc | instruction.code << 16));
+                call_helper(reinterpret_cast<const void *>(&JitX64::fault_helper));
+                as.jmp(finish);
+            });
+        }
+        tick(op.cycles, after_opcode, next);
+        end_instruction(next);
+        if (last)
+        {
+            as.jmp(exit_to(next));
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Code cache and run loop
+JitX64::JitX64(CPU &cpu) : cpu(cpu), bus(*cpu.bus), blocks(BlockCache::SLOT_COUNT)
+{
+    context.registers = &cpu.registers;
+    context.ram = bus.ram.data();
+    context.owner = this;
+    for (size_t i = 0; i < 256; ++i)
+    {
+        context.nz[i] = static_cast<uint8_t>((i == 0 ? Z : 0) | (i & N));
+    }
+
+    void *memory = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        throw std::runtime_error("JIT: unable to map the code arena");
+    }
+    arena = static_cast<uint8_t *>(memory);
+
+    cpu.block_cache.clear(bus);
+}
+
+JitX64::~JitX64()
+{
+    munmap(arena, ARENA_SIZE);
+}
+
+void JitX64::run()
+{
+    while (true)
+    {
+        if (bus.nmi_pending() || bus.irq_pending())
+        {
+            cpu.set_status(cpu.registers.p);
+            cpu.poll_interrupts();
+        }
+        if (bus.ram_code_dirty)
+        {
+            invalidate_dirty_pages();
+        }
+
+        BlockEntry entry = lookup(cpu.registers.pc);
+        if (entry == nullptr)
+        {
+            step();
+            continue;
+        }
+
+        context.exit = 0;
+        entry(&context);
+        if (error)
+        {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+}
+
+void JitX64::step()
+{
+    auto code = cpu.read(cpu.registers.pc);
+    ++cpu.registers.pc;
+    const OpCode &op = OPCODE_TABLE[code];
+    cpu.operand = cpu.fetch_operand(cpu.registers.pc, op.len);
+    execute(cpu, op);
+}
+
+JitX64::BlockEntry JitX64::lookup(uint16_t pc)
+{
+    auto index = BlockCache::slot(pc);
+    if (index < 0)
+    {
+        return nullptr;
+    }
+
+    // RAM code that keeps being rewritten has to get hotter each time before
+    // it is translated again
+    auto &compiled = blocks[static_cast<size_t>(index)];
+    if (compiled.entry != nullptr && !compiled.banks.current(bus))
+    {
+        // A bank switch mapped other code here. Banks switched in and out
+        // again and again back off like rewritten RAM code.
+        compiled.entry = nullptr;
+        compiled.hits = 0;
+        if (compiled.invalidations < MAX_BACKOFF)
+        {
+            ++compiled.invalidations;
+        }
+    }
+    if (compiled.entry == nullptr && ++compiled.hits >= HOT_THRESHOLD << compiled.invalidations)
+    {
+        const BasicBlock *block = cpu.block_cache.lookup(bus, pc);
+        compiled.entry = compile(*block);
+        compiled.ram_pages = block->ram_pages;
+        compiled.banks = block->banks;
+    }
+    return compiled.entry;
+}
+
+JitX64::BlockEntry JitX64::compile(const BasicBlock &block)
+{
+    auto code = JitTranslator(*this, block).translate();
+    if (code.size() > MAX_BLOCK_CODE)
+    {
+        throw std::runtime_error("JIT: translated block too large");
+    }
+    if (arena_used + code.size() > ARENA_SIZE)
+    {
+        flush();
+    }
+
+    // Only the pages receiving the new code are made writable, and never
+    // while they are executable
+    uint8_t *entry = arena + arena_used;
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto first = reinterpret_cast<uintptr_t>(entry) & ~(page_size - 1);
+    auto last = reinterpret_cast<uintptr_t>(entry + code.size() + page_size - 1) & ~(page_size - 1);
+    auto *pages = reinterpret_cast<void *>(first);
+
+    if (mprotect(pages, last - first, PROT_READ | PROT_WRITE) != 0)
+    {
+        throw std::runtime_error("JIT: unable to make the code arena writable");
+    }
+    std::memcpy(entry, code.data(), code.size());
+    if (mprotect(pages, last - first, PROT_READ | PROT_EXEC) != 0)
+    {
+        throw std::runtime_error("JIT: unable to make the code arena executable");
+    }
+
+    arena_used += (code.size() + 15) & ~static_cast<size_t>(15);
+    return reinterpret_cast<BlockEntry>(entry);
+}
+
+// Drops translations of RAM pages written since the last check, together
+// with the block cache entries they were built from
+void JitX64::invalidate_dirty_pages()
+{
+    auto dirty = bus.ram_code_dirty;
+    for (size_t i = 0; i < BlockCache::RAM_SIZE; ++i)
+    {
+        auto &compiled = blocks[i];
+        if (compiled.ram_pages & dirty)
+        {
+            compiled.entry = nullptr;
+            compiled.ram_pages = 0;
+            compiled.hits = 0;
+            if (compiled.invalidations < MAX_BACKOFF)
+            {
+                ++compiled.invalidations;
+            }
+        }
+    }
+    cpu.block_cache.invalidate_dirty_pages(bus);
+}
+
+void JitX64::flush()
+{
+    for (auto &compiled : blocks)
+    {
+        compiled = CompiledBlock{};
+    }
+    arena_used = 0;
+    cpu.block_cache.clear(bus);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Helpers called from translated code
+uint8_t JitX64::read_helper(JitContext *context, uint32_t addr)
+{
+    try
+    {
+        return context->owner->bus.read(static_cast<uint16_t>(addr));
+    }
+    catch (const std::runtime_error &e)
+    {
+        context->owner->fault_message = e.what();
+        context->fault = 1;
+        return 0;
+    }
+    catch (...)
+    {
+        context->owner->error = std::current_exception();
+        context->exit = 1;
+        return 0;
+    }
+}
+
+void JitX64::write_helper(JitContext *context, uint32_t addr, uint32_t data)
+{
+    Bus &bus = context->owner->bus;
+    auto map_generation = bus.map_generation;
+    try
+    {
+        bus.write(static_cast<uint16_t>(addr), static_cast<uint8_t>(data));
+    }
+    catch (const std::runtime_error &e)
+    {
+        context->owner->fault_message = e.what();
+        context->fault = 1;
+    }
+    catch (...)
+    {
+        context->owner->error = std::current_exception();
+        context->exit = 1;
+    }
+    // Writing PPUCTRL can raise the NMI, writing PPUMASK catches the board's
+    // IRQ counter up, RAM code may have changed, and a mapper register write
+    // may have switched out the bank the rest of the block came from
+    if (bus.nmi_pending() || bus.irq_pending() || bus.ram_code_dirty || bus.map_generation != map_generation)
+    {
+        context->exit = 1;
+    }
+}
+
+uint8_t JitX64::tick_helper(JitContext *context, uint32_t cycles)
+{
+    Bus &bus = context->owner->bus;
+    // Keeps CPU::status() right for the frame callback
+    context->owner->cpu.set_status(context->registers->p);
+    try
+    {
+        bus.tick(static_cast<uint8_t>(cycles));
+    }
+    catch (...)
+    {
+        context->owner->error = std::current_exception();
+        return 1;
+    }
+    return bus.nmi_pending() || bus.irq_pending() || bus.ram_code_dirty;
+}
+
+// Reports a Bus error the same way as run_with_callback()
+void JitX64::fault_helper(JitContext *context, uint32_t pc_and_code)
+{
+    const OpCode &op = OPCODE_TABLE[(pc_and_code >> 16) & 0xff];
+    auto pc = static_cast<uint16_t>(pc_and_code + 1);
+
+    std::cerr << "Runtime error: " << context->owner->fault_message;
+    std::cerr << " Opcode: " << op.mnemonic << " 0x" << std::hex << static_cast<int>(op.code);
+    std::cerr << " PC: " << pc;
+    std::cerr << std::endl;
+    context->fault = 0;
+}
+
+uint8_t JitX64::execute_helper(JitContext *context, uint32_t pc_and_code, uint32_t operand)
+{
+    JitX64 &jit = *context->owner;
+    const OpCode &op = OPCODE_TABLE[(pc_and_code >> 16) & 0xff];
+    auto pc = static_cast<uint16_t>(pc_and_code);
+
+    jit.cpu.registers.pc = static_cast<uint16_t>(pc + 1);
+    jit.cpu.operand = static_cast<uint16_t>(operand);
+    auto map_generation = jit.bus.map_generation;
+    try
+    {
+        execute(jit.cpu, op);
+    }
+    catch (...)
+    {
+        jit.error = std::current_exception();
+        return 1;
+    }
+    // CLI and PLP are translated as helper calls so an IRQ they let in is
+    // taken after them
+    return jit.cpu.registers.pc != static_cast<uint16_t>(pc + op.len) || jit.bus.nmi_pending() ||
+           jit.bus.irq_pending() || jit.bus.ram_code_dirty || jit.bus.map_generation != map_generation;
+}
+} // namespace EM
+
+#endif
+
+namespace EM
+{
+template <> void CPU::run_jit()
+{
+#ifdef EM_JIT_X64
+    JitX64 jit(*this);
+    jit.run();
+#else
+    run_threaded();
+#endif
+}
+} // namespace EM
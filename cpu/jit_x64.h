@@ -0,0 +1,114 @@
+#ifndef MYNESEMULATOR__JIT_X64_H_
+#define MYNESEMULATOR__JIT_X64_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "../bus/bus.h"
+#include "block_cache.h"
+
+// The recompiler emits System V x86-64 code; other targets use the threaded core
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(_WIN32)
+#define EM_JIT_X64 1
+#endif
+
+namespace EM
+{
+struct Registers;
+
+#ifdef EM_JIT_X64
+
+class JitX64;
+
+// State shared between the run loop and translated code. Translated code keeps
+// a pointer to it in rbx, so the layout must stay standard-layout.
+struct JitContext
+{
+    Registers *registers = nullptr;
+    uint8_t *ram = nullptr;
+    JitX64 *owner = nullptr;
+    // Set by helpers when the block has to return at the next instruction
+    // boundary: NMI or IRQ raised, RAM code modified, PRG banks switched, or
+    // an exception to rethrow
+    uint8_t exit = 0;
+    // Set by the read and write helpers when Bus threw a runtime_error; the
+    // instruction is abandoned the way run_with_callback() abandons it
+    uint8_t fault = 0;
+    // N and Z flags for every result byte
+    uint8_t nz[256] = {};
+};
+
+// Dynamic recompiler for the 6502 core. Hot basic blocks from the block cache
+// are translated to x86-64 with A/X/Y/P held in host registers. RAM and fixed
+// PRG-ROM are accessed directly, switchable banks through the bus page table;
+// everything else goes through Bus. Each block only leaves native code on a
+// control transfer it cannot follow, when the scheduler's next event raises
+// NMI or IRQ, when RAM code is rewritten, or when a write switches banks, so
+// it stays trace-equal to run_with_callback(). A block whose PRG bank was
+// switched out is translated again the next time it is entered.
+class JitX64
+{
+  public:
+    explicit JitX64(CPU &cpu);
+    ~JitX64();
+
+    JitX64(const JitX64 &) = delete;
+    JitX64 &operator=(const JitX64 &) = delete;
+
+    // Runs the CPU until an exception escapes, like CPU::run_with_callback()
+    void run();
+
+  private:
+    using BlockEntry = void (*)(JitContext *);
+
+    struct CompiledBlock
+    {
+        BlockEntry entry = nullptr;
+        uint8_t ram_pages = 0;
+        BankStamp banks;
+        uint32_t hits = 0;
+        uint8_t invalidations = 0;
+    };
+
+    // Executions before a block is translated, doubled each time its RAM
+    // code is rewritten, up to MAX_BACKOFF times
+    static constexpr uint32_t HOT_THRESHOLD = 8;
+    static constexpr uint8_t MAX_BACKOFF = 16;
+    static constexpr size_t ARENA_SIZE = 16 * 1024 * 1024;
+    // Upper bound on the code of one translated block
+    static constexpr size_t MAX_BLOCK_CODE = 64 * 1024;
+
+    CPU &cpu;
+    Bus &bus;
+    JitContext context;
+    std::exception_ptr error;
+    std::string fault_message;
+
+    uint8_t *arena = nullptr;
+    size_t arena_used = 0;
+
+    std::vector<CompiledBlock> blocks;
+
+    BlockEntry lookup(uint16_t pc);
+    BlockEntry compile(const BasicBlock &block);
+    void invalidate_dirty_pages();
+    void flush();
+    void step();
+
+    // Called from translated code; exceptions are stored in `error` and
+    // rethrown by run() once the block has returned
+    static uint8_t read_helper(JitContext *context, uint32_t addr);
+    static void write_helper(JitContext *context, uint32_t addr, uint32_t data);
+    static uint8_t tick_helper(JitContext *context, uint32_t cycles);
+    static uint8_t execute_helper(JitContext *context, uint32_t pc_and_code, uint32_t operand);
+    static void fault_helper(JitContext *context, uint32_t pc_and_code);
+
+    friend class JitTranslator;
+};
+
+#endif
+} // namespace EM
+#endif
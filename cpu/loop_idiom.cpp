@@ -0,0 +1,291 @@
+#include "loop_idiom.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu.h"
+#include "idle_loop.h"
+
+namespace EM
+{
+namespace
+{
+constexpr size_t MAX_INSTRUCTIONS = 16;
+
+bool is_load(uint8_t code)
+{
+    switch (code)
+    {
+    case 0xa5: case 0xb5: case 0xad: case 0xbd: case 0xb9:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_store(uint8_t code)
+{
+    switch (code)
+    {
+    case 0x85: case 0x95: case 0x8d: case 0x9d: case 0x99: case 0x91:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Flags are n = z = the last counter or compare result when the branch runs
+bool branch_taken(uint8_t code, uint8_t nz)
+{
+    switch (code)
+    {
+    case 0x10: // BPL
+        return (nz & 0x80) == 0;
+    case 0x30: // BMI
+        return (nz & 0x80) != 0;
+    case 0xd0: // BNE
+        return nz != 0;
+    default: // BEQ
+        return nz == 0;
+    }
+}
+} // namespace
+
+bool LoopIdiom::matches(const BasicBlock &block)
+{
+    const auto &instructions = block.instructions;
+    if (block.start < BlockCache::PRG_ROM_START || instructions.size() > MAX_INSTRUCTIONS ||
+        !IdleLoopSkipper::loops_to_start(block))
+    {
+        return false;
+    }
+
+    switch (instructions.back().code)
+    {
+    case 0x10: case 0x30: case 0xd0: case 0xf0:
+        break;
+    default:
+        return false;
+    }
+
+    bool stores = false;
+    bool counted = false;
+    for (size_t i = 0; i + 1 < instructions.size(); ++i)
+    {
+        const DecodedInstruction &instruction = instructions[i];
+        switch (instruction.code)
+        {
+        case 0xad: // LDA abs
+            if (instruction.operand >= 0x2000 && instruction.operand < 0x8000)
+            {
+                return false;
+            }
+            counted = false;
+            break;
+        case 0xa9: case 0xa5: case 0xb5: case 0xbd: case 0xb9: // LDA
+            counted = false;
+            break;
+        case 0x8d: // STA abs
+            if (instruction.operand >= 0x2000 && instruction.operand != 0x2007)
+            {
+                return false;
+            }
+            stores = true;
+            break;
+        case 0x85: case 0x95: case 0x9d: case 0x99: case 0x91: // STA
+            stores = true;
+            break;
+        case 0xe8: case 0xc8: case 0xca: case 0x88: // INX INY DEX DEY
+        case 0xe0: case 0xc0:                       // CPX # CPY #
+            counted = true;
+            break;
+        default:
+            return false;
+        }
+    }
+    return stores && counted;
+}
+
+void LoopIdiom::run(CPU &cpu, const BasicBlock &block)
+{
+    Bus &bus = *cpu.bus;
+    if (bus.nmi_pending())
+    {
+        // The interpreter takes it before the next instruction
+        return;
+    }
+
+    NesPPU &ppu = bus.ppu;
+    const auto &instructions = block.instructions;
+    const DecodedInstruction &branch = instructions.back();
+    const size_t body = instructions.size() - 1;
+
+    auto next = static_cast<uint16_t>(branch.pc + 2);
+    size_t branch_cycles = OPCODE_TABLE[branch.code].cycles + 1u + ((next & 0xff00) != (block.start & 0xff00));
+
+    bus.sync_ppu();
+    const size_t horizon = bus.ppu_cycles_to_next_event();
+    size_t cycles = 0;
+    uint8_t a = cpu.registers.a;
+    uint8_t x = cpu.registers.x;
+    uint8_t y = cpu.registers.y;
+    uint8_t nz = 0;
+    bool c = cpu.flags.c;
+    bool ran = false;
+
+    std::array<uint16_t, MAX_INSTRUCTIONS> addrs{};
+    while (true)
+    {
+        // Work out the addresses and cycles of the next iteration, and whether
+        // it branches back, before it changes anything
+        size_t iteration = branch_cycles;
+        uint8_t next_x = x;
+        uint8_t next_y = y;
+        uint8_t next_nz = nz;
+        bool next_c = c;
+        size_t ppu_writes = 0;
+        int pointer = -1;
+        bool batchable = true;
+
+        for (size_t i = 0; i < body && batchable; ++i)
+        {
+            const DecodedInstruction &instruction = instructions[i];
+            iteration += instruction.cycles;
+            auto operand = instruction.operand;
+            switch (instruction.code)
+            {
+            case 0xa5: case 0x85:
+                addrs[i] = static_cast<uint8_t>(operand);
+                break;
+            case 0xb5: case 0x95:
+                addrs[i] = static_cast<uint8_t>(operand + next_x);
+                break;
+            case 0xad: case 0x8d:
+                addrs[i] = operand;
+                ppu_writes += operand == 0x2007;
+                break;
+            case 0xbd: case 0xb9: case 0x9d: case 0x99: {
+                auto index = instruction.code == 0xbd || instruction.code == 0x9d ? next_x : next_y;
+                auto addr = static_cast<uint16_t>(operand + index);
+                if (is_load(instruction.code))
+                {
+                    batchable = addr < 0x2000 || addr >= 0x8000;
+                    iteration += (addr & 0xff00) != (operand & 0xff00);
+                }
+                else
+                {
+                    batchable = addr < 0x2000;
+                }
+                addrs[i] = addr;
+                break;
+            }
+            case 0x91: {
+                auto zero_page = static_cast<uint8_t>(operand);
+                auto lo = bus.ram[zero_page];
+                auto hi = bus.ram[static_cast<uint8_t>(zero_page + 1)];
+                auto addr = static_cast<uint16_t>((hi << 8 | lo) + next_y);
+                batchable = addr < 0x2000;
+                pointer = zero_page;
+                addrs[i] = addr;
+                break;
+            }
+            case 0xe8:
+                next_nz = ++next_x;
+                break;
+            case 0xc8:
+                next_nz = ++next_y;
+                break;
+            case 0xca:
+                next_nz = --next_x;
+                break;
+            case 0x88:
+                next_nz = --next_y;
+                break;
+            case 0xe0:
+                next_c = operand <= next_x;
+                next_nz = static_cast<uint8_t>(next_x - operand);
+                break;
+            case 0xc0:
+                next_c = operand <= next_y;
+                next_nz = static_cast<uint8_t>(next_y - operand);
+                break;
+            default: // LDA #
+                break;
+            }
+        }
+
+        // A store must not move the pointer of (zp),Y within the iteration
+        for (size_t i = 0; i < body && batchable && pointer >= 0; ++i)
+        {
+            if (is_store(instructions[i].code) && addrs[i] < 0x2000)
+            {
+                auto ram = addrs[i] & 0x07ff;
+                batchable = ram != pointer && ram != ((pointer + 1) & 0xff);
+            }
+        }
+
+        // Watchpoints see each access at its own PC and cycle, which only the
+        // interpreter has
+        for (size_t i = 0; i < body && batchable; ++i)
+        {
+            auto code = instructions[i].code;
+            auto traps = bus.watchpoints.page_traps(static_cast<uint8_t>(addrs[i] >> 8));
+            if (is_load(code))
+            {
+                batchable = !(traps & WatchRead);
+            }
+            else if (is_store(code))
+            {
+                batchable = !(traps & WatchWrite) && !(addrs[i] == 0x2007 && bus.watchpoints.watches(WatchSpace::Vram));
+            }
+        }
+
+        // PPUDATA writes must all land where NesPPU::write_to_data accepts them
+        if (batchable && ppu_writes > 0)
+        {
+            size_t first = ppu.address_register.get();
+            size_t last = first + (ppu_writes - 1) * ppu.ctrl.vram_addr_increment();
+            batchable = last <= 0x3fff && (last < 0x3000 || first > 0x3eff);
+        }
+
+        if (!batchable || !branch_taken(branch.code, next_nz) || (cycles + iteration) * 3 >= horizon)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < body; ++i)
+        {
+            auto code = instructions[i].code;
+            if (code == 0xa9)
+            {
+                a = static_cast<uint8_t>(instructions[i].operand);
+            }
+            else if (is_load(code))
+            {
+                a = bus.read(addrs[i]);
+            }
+            else if (is_store(code))
+            {
+                bus.write(addrs[i], a);
+            }
+        }
+        x = next_x;
+        y = next_y;
+        nz = next_nz;
+        c = next_c;
+        cycles += iteration;
+        ran = true;
+    }
+
+    if (ran)
+    {
+        cpu.registers.a = a;
+        cpu.registers.x = x;
+        cpu.registers.y = y;
+        cpu.flags.n = cpu.flags.z = nz;
+        cpu.flags.c = c;
+        bus.tick_many(cycles);
+    }
+}
+} // namespace EM
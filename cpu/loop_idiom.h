@@ -0,0 +1,33 @@
+#ifndef MYNESEMULATOR__LOOP_IDIOM_H_
+#define MYNESEMULATOR__LOOP_IDIOM_H_
+
+#include "block_cache.h"
+
+namespace EM
+{
+class Bus;
+template <typename Timing, typename BusT> class BasicCPU;
+struct InstructionStep;
+using CPU = BasicCPU<InstructionStep, Bus>;
+
+// Memory fill and copy loops such as `LDA #0 / STA $0200,X / INX / BNE` or
+// `LDA table,Y / STA $2007 / INY / BNE`, run in batches by the threaded core.
+// The batch does the loads and stores of each iteration in order through
+// Bus, so RAM, VRAM and the PPU address end up as if the loop had been
+// interpreted, and then ticks the bus once for all of them. Iterations that
+// touch a watched page are left to the interpreter.
+class LoopIdiom
+{
+  public:
+    // A PRG-ROM block that branches back to its start on a flag set by
+    // INX/INY/DEX/DEY or CPX/CPY #, and otherwise only loads and stores A
+    // through RAM, PRG-ROM or PPUDATA
+    static bool matches(const BasicBlock &block);
+
+    // Runs the iterations of block that branch back to its start and end
+    // before the PPU next changes PPUSTATUS or raises NMI, or the board raises
+    // IRQ. The rest, at least the last iteration, is left to the interpreter.
+    static void run(CPU &cpu, const BasicBlock &block);
+};
+} // namespace EM
+#endif
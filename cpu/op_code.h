@@ -1,16 +1,18 @@
 #ifndef MYNESEMULATOR__OP_CODE_H_
 #define MYNESEMULATOR__OP_CODE_H_
 
+#include <array>
 #include <cstdint>
-#include <memory>
-#include <mutex>
-#include <string>
-#include <unordered_map>
-#include <vector>
 
 namespace EM
 {
 
+class Bus;
+template <typename Timing, typename BusT = Bus> class BasicCPU;
+struct InstructionStep;
+// The instruction-stepped core every fast path (threaded, JIT, AOT) runs on
+using CPU = BasicCPU<InstructionStep>;
+
 // Addressing modes
 enum AddressingMode
 {
@@ -26,61 +28,22 @@ enum AddressingMode
     NoneAddressing,
 };
 
-struct OpCode
+template <typename Timing, typename BusT = Bus> struct BasicOpCode
 {
-    uint8_t code;
-    std::string mnemonic;
-    uint8_t len;
-    uint8_t cycles;
-    AddressingMode mode;
-    // constructor
-    OpCode(uint8_t i_code, const char *str, uint8_t i_len, uint8_t i_cycles, AddressingMode addressing_mode)
-        : code(i_code), mnemonic(str), len(i_len), cycles(i_cycles), mode(addressing_mode)
-    {
-    }
+    uint8_t code = 0;
+    const char *mnemonic = "";
+    uint8_t len = 1;
+    uint8_t cycles = 0;
+    AddressingMode mode = NoneAddressing;
+    // Instruction handler, specialised on its addressing mode at compile time
+    void (BasicCPU<Timing, BusT>::*handler)() = nullptr;
 };
 
-class OpCodeSingleton
-{
-  public:
-    static const OpCodeSingleton &get_instance()
-    {
-        std::call_once(initInstanceFlag, &OpCodeSingleton::initSingleton);
-        return *instance;
-    }
-
-    static const std::unordered_map<uint8_t, std::shared_ptr<OpCode>> &get_opcode_map()
-    {
-        return *opcode_map;
-    }
-
-    static const std::vector<std::shared_ptr<OpCode>> &get_opcodes()
-    {
-        return *opcodes;
-    }
-
-    OpCodeSingleton(const OpCodeSingleton &) = delete;
-    OpCodeSingleton &operator=(const OpCodeSingleton &) = delete;
+using OpCode = BasicOpCode<InstructionStep>;
+using OpHandler = void (CPU::*)();
 
-  private:
-    static void initSingleton()
-    {
-        instance.reset(new OpCodeSingleton());
-    }
-
-    static std::unique_ptr<OpCodeSingleton> instance;
-    static std::once_flag initInstanceFlag;
-
-    static std::shared_ptr<std::unordered_map<uint8_t, std::shared_ptr<OpCode>>> opcode_map;
-    static std::shared_ptr<std::vector<std::shared_ptr<OpCode>>> opcodes;
-    static void init_opcodes();
-    static void init_opcode_map();
-
-    OpCodeSingleton()
-    {
-        init_opcodes();
-        init_opcode_map();
-    }
-};
+// Indexed by opcode byte. Built at compile time in cpu/cpu.cpp, so decoding
+// an instruction is a single indexed load.
+extern const std::array<OpCode, 256> OPCODE_TABLE;
 } // namespace EM
 #endif
@@ -0,0 +1,41 @@
+#ifndef MYNESEMULATOR__SUPERINSTRUCTIONS_H_
+#define MYNESEMULATOR__SUPERINSTRUCTIONS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+namespace EM
+{
+// Opcode pairs the block cache fuses so the threaded core dispatches them
+// once, as X(first, second). Picked from bench/opcode_pairs over the bundled
+// ROMs. The first opcode must not end a basic block; the second may.
+#define EM_FOR_EACH_SUPERINSTRUCTION(X) \
+    X(e0, d0) X(bd, 8d) X(ca, d0) X(29, c9) X(4a, 26) X(ad, 4a) X(c9, d0) X(a9, 8d) \
+    X(18, 65) X(a9, 9d) X(8d, ad) X(65, aa) X(18, 69) X(e6, a5) X(69, 85) X(a5, 18)
+
+struct Superinstruction
+{
+    uint8_t first;
+    uint8_t second;
+};
+
+#define EM_SUPERINSTRUCTION_ENTRY(a, b) {0x##a, 0x##b},
+constexpr Superinstruction SUPERINSTRUCTIONS[] = {EM_FOR_EACH_SUPERINSTRUCTION(EM_SUPERINSTRUCTION_ENTRY)};
+#undef EM_SUPERINSTRUCTION_ENTRY
+
+// Number of the superinstruction running first then second, counting from 1,
+// or 0 when the pair is not fused
+constexpr uint8_t superinstruction(uint8_t first, uint8_t second)
+{
+    for (size_t i = 0; i < std::size(SUPERINSTRUCTIONS); ++i)
+    {
+        if (SUPERINSTRUCTIONS[i].first == first && SUPERINSTRUCTIONS[i].second == second)
+        {
+            return static_cast<uint8_t>(i + 1);
+        }
+    }
+    return 0;
+}
+} // namespace EM
+#endif
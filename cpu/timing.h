@@ -0,0 +1,25 @@
+#ifndef MYNESEMULATOR__TIMING_H_
+#define MYNESEMULATOR__TIMING_H_
+
+namespace EM
+{
+// Timing policies of BasicCPU, chosen at compile time so the fast core pays
+// nothing for the accurate one.
+
+// Ticks the bus once per instruction with its cycle count, plus one cycle on
+// a page cross or taken branch. Every other core (threaded, JIT, AOT) uses it.
+struct InstructionStep
+{
+    static constexpr bool PER_CYCLE = false;
+};
+
+// Ticks the bus by one cycle on every CPU bus access, including the dummy
+// reads and writes the 6502 makes, so PPU and APU registers see accesses in
+// the cycle they happen. Cycles without an access are ticked at the end of
+// the instruction.
+struct CycleStep
+{
+    static constexpr bool PER_CYCLE = true;
+};
+} // namespace EM
+#endif
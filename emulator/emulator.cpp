@@ -1,4 +1,6 @@
 #include "../bus/bus.h"
+#include "../cheats/cheats.h"
+#include "../console/console.h"
 #include "../cpu/cpu.h"
 #include "../joypad/joypad.h"
 #include "../render/frame.h"
@@ -13,31 +15,13 @@
 #include <arm_neon.h>
 #include <cassert>
 #include <cstdint>
-#include <fstream>
 #include <iostream>
+#include <memory>
 #include <ostream>
 #include <random>
+#include <unordered_map>
 #include <vector>
 
-std::vector<uint8_t> readFile(const std::string &filePath)
-{
-    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
-    if (!file.is_open())
-    {
-        throw std::runtime_error("Unable to open file");
-    }
-
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<uint8_t> buffer(static_cast<size_t>(size));
-    if (!file.read(reinterpret_cast<char *>(buffer.data()), size))
-    {
-        throw std::runtime_error("Error reading file");
-    }
-
-    return buffer;
-}
 int main(int argc, char **argv)
 {
     // init sdl window
@@ -91,8 +75,11 @@ int main(int argc, char **argv)
     }
 
     // read Nes file
-    std::vector<uint8_t> bytes = readFile(argv[1]);
-    EM::Rom rom(bytes);
+    EM::Rom rom = EM::Rom::load(argv[1]);
+    if (rom.region == EM::Region::PAL || rom.region == EM::Region::DENDY)
+    {
+        std::cerr << "PAL and Dendy timing is not emulated; running at NTSC speed" << std::endl;
+    }
 
     EM::Frame frame;
 
@@ -143,9 +130,16 @@ int main(int argc, char **argv)
         }
     };
 
-    auto bus = EM::Bus(&rom, gameloop_callback);
-    auto cpu = EM::CPU(&bus);
-    cpu.reset();
-    //    cpu.run();
-    cpu.run_with_callback([&](EM::CPU &cpu) {});
+#ifdef NES_CYCLE_STEP
+    auto console = std::make_unique<EM::CycleConsole>(rom, gameloop_callback);
+#else
+    auto console = std::make_unique<EM::Console>(rom, gameloop_callback);
+#endif
+    // Cheat codes follow the ROM path on the command line
+    for (int i = 2; i < argc; ++i)
+    {
+        EM::add_cheat(console->bus, argv[i]);
+    }
+    console->cpu.reset();
+    console->cpu.run();
 }
@@ -10,23 +10,8 @@ namespace EM
 {
 std::string trace(EM::CPU &cpu)
 {
-    const auto opcode_map = EM::OpCodeSingleton::get_instance().get_opcode_map();
     const auto code = cpu.read(cpu.registers.pc);
-
-    const auto it = opcode_map.find(code);
-    const EM::OpCode *op = nullptr;
-
-    if (it != opcode_map.end())
-    {
-        op = it->second.get();
-    }
-    else
-    {
-        std::ostringstream oss;
-        oss << "Opcode " << std::hex << static_cast<int>(code) << " is not recognized. ";
-        oss << "Program counter: " << std::hex << cpu.registers.pc;
-        throw std::runtime_error(oss.str());
-    }
+    const EM::OpCode *op = &EM::OPCODE_TABLE[code];
 
     const auto begin = cpu.registers.pc;
     auto hex_dump = std::vector<uint8_t>();
@@ -165,14 +150,17 @@ std::string trace(EM::CPU &cpu)
 
     std::string asm_str = asm_stream.str();
 
+    // The PPU position as of this instruction
+    cpu.bus->sync_ppu();
+
     std::stringstream final_stream;
     final_stream << std::uppercase << asm_str << "  A:" << std::hex << std::setw(2) << std::setfill('0')
                  << static_cast<int>(cpu.registers.a) << " X:" << std::hex << std::setw(2) << std::setfill('0')
                  << static_cast<int>(cpu.registers.x) << " Y:" << std::hex << std::setw(2) << std::setfill('0')
                  << static_cast<int>(cpu.registers.y) << " P:" << std::hex << std::setw(2) << std::setfill('0')
-                 << static_cast<int>(cpu.registers.p) << " SP:" << std::hex << std::setw(2) << std::setfill('0')
-                 << static_cast<int>(cpu.registers.sp) << " PPU:" << static_cast<int>(cpu.bus->ppu->cycles) << ","
-                 << static_cast<int>(cpu.bus->ppu->scanline) << " CYC:" << static_cast<int>(cpu.bus->cycles);
+                 << static_cast<int>(cpu.status()) << " SP:" << std::hex << std::setw(2) << std::setfill('0')
+                 << static_cast<int>(cpu.registers.sp) << " PPU:" << static_cast<int>(cpu.bus->ppu.cycles) << ","
+                 << static_cast<int>(cpu.bus->ppu.scanline) << " CYC:" << static_cast<int>(cpu.bus->cycles);
 
     return final_stream.str();
 }
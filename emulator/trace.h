@@ -1,4 +1,8 @@
+#ifndef MYNESEMULATOR__TRACE_H_
+#define MYNESEMULATOR__TRACE_H_
+
 #include "../cpu/cpu.h"
+#include <ostream>
 #include <string>
 
 namespace EM
@@ -6,4 +10,16 @@ namespace EM
 std::string trace(EM::CPU &cpu);
 std::string to_hex(uint16_t value);
 std::string to_hex(uint8_t value);
+
+// run_with_callback() hook writing one trace() line per instruction
+struct TraceHook
+{
+    std::ostream &out;
+
+    void operator()(CPU &cpu)
+    {
+        out << trace(cpu) << '\n';
+    }
+};
 } // namespace EM
+#endif // MYNESEMULATOR__TRACE_H_
@@ -0,0 +1,34 @@
+#include "discrete.h"
+
+#include "../bus/bus.h"
+
+namespace EM
+{
+void Uxrom::reset(Bus &bus)
+{
+    Mapper::reset(bus);
+    map_prg_16k(bus, 1, prg_banks_16k() - 1);
+}
+
+void Uxrom::write(Bus &bus, uint16_t, uint8_t data)
+{
+    map_prg_16k(bus, 0, data);
+}
+
+void Cnrom::write(Bus &bus, uint16_t, uint8_t data)
+{
+    map_chr_8k(bus, data);
+}
+
+void Axrom::reset(Bus &bus)
+{
+    Mapper::reset(bus);
+    set_mirroring(bus, Mirroring::ONE_SCREEN_LOWER);
+}
+
+void Axrom::write(Bus &bus, uint16_t, uint8_t data)
+{
+    map_prg_32k(bus, data & 0x07);
+    set_mirroring(bus, data & 0x10 ? Mirroring::ONE_SCREEN_UPPER : Mirroring::ONE_SCREEN_LOWER);
+}
+} // namespace EM
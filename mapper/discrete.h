@@ -0,0 +1,52 @@
+#ifndef MYNESEMULATOR__DISCRETE_H_
+#define MYNESEMULATOR__DISCRETE_H_
+
+#include "mapper.h"
+
+namespace EM
+{
+// Boards built from discrete logic: a single bank register written through
+// any address in $8000-$FFFF. Bus conflicts are not emulated.
+
+// Mapper 0: 16 or 32 KiB of PRG-ROM and 8 KiB of CHR, nothing to switch
+class Nrom : public Mapper
+{
+  public:
+    using Mapper::Mapper;
+    bool fixed_prg() const override
+    {
+        return true;
+    }
+};
+
+// Mapper 2: a 16 KiB PRG bank switched at $8000, the last one fixed at $C000
+class Uxrom : public Mapper
+{
+  public:
+    using Mapper::Mapper;
+    void reset(Bus &bus) override;
+    void write(Bus &bus, uint16_t addr, uint8_t data) override;
+};
+
+// Mapper 3: NROM with an 8 KiB CHR bank switch
+class Cnrom : public Mapper
+{
+  public:
+    using Mapper::Mapper;
+    void write(Bus &bus, uint16_t addr, uint8_t data) override;
+    bool fixed_prg() const override
+    {
+        return true;
+    }
+};
+
+// Mapper 7: a 32 KiB PRG bank switch, CHR-RAM and a one-screen nametable
+class Axrom : public Mapper
+{
+  public:
+    using Mapper::Mapper;
+    void reset(Bus &bus) override;
+    void write(Bus &bus, uint16_t addr, uint8_t data) override;
+};
+} // namespace EM
+#endif
@@ -0,0 +1,123 @@
+#include "mapper.h"
+
+#include "../bus/bus.h"
+#include "discrete.h"
+#include "mmc1.h"
+#include "mmc3.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace EM
+{
+Mapper::Mapper(const Rom &rom) : rom(rom)
+{
+    if (rom.chr_rom.empty())
+    {
+        chr_ram.resize(std::max<size_t>(rom.chr_ram_size, 0x2000));
+    }
+}
+
+void Mapper::reset(Bus &bus)
+{
+    bus.map_memory(0x60, prg_ram.size() / 0x100, prg_ram.data(), prg_ram.data());
+    map_prg_32k(bus, 0);
+    map_chr_8k(bus, 0);
+}
+
+void Mapper::write(Bus &, uint16_t, uint8_t)
+{
+}
+
+void Mapper::a12_changed(Bus &, uint16_t)
+{
+}
+
+void Mapper::run_irq_event(Bus &)
+{
+}
+
+void Mapper::map_prg_8k(Bus &bus, size_t slot, size_t bank)
+{
+    auto count = rom.prg_rom.size() / PRG_BANK_SIZE;
+    if (count == 0)
+    {
+        return;
+    }
+    const uint8_t *memory = rom.prg_rom.data() + (bank % count) * PRG_BANK_SIZE;
+    bus.map_memory(static_cast<uint8_t>(0x80 + slot * 0x20), PRG_BANK_SIZE / 0x100, memory, nullptr);
+}
+
+void Mapper::map_prg_16k(Bus &bus, size_t slot, size_t bank)
+{
+    map_prg_8k(bus, slot * 2, bank * 2);
+    map_prg_8k(bus, slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::map_prg_32k(Bus &bus, size_t bank)
+{
+    for (size_t slot = 0; slot < 4; ++slot)
+    {
+        map_prg_8k(bus, slot, bank * 4 + slot);
+    }
+}
+
+void Mapper::map_chr_1k(Bus &bus, size_t slot, size_t bank)
+{
+    if (chr_ram.empty())
+    {
+        bank %= rom.chr_rom.size() / CHR_BANK_SIZE;
+        bus.ppu.chr_banks[slot] = rom.chr_rom.data() + bank * CHR_BANK_SIZE;
+        bus.ppu.chr_write_banks[slot] = nullptr;
+    }
+    else
+    {
+        bank %= chr_ram.size() / CHR_BANK_SIZE;
+        bus.ppu.chr_banks[slot] = chr_ram.data() + bank * CHR_BANK_SIZE;
+        bus.ppu.chr_write_banks[slot] = chr_ram.data() + bank * CHR_BANK_SIZE;
+    }
+}
+
+void Mapper::map_chr_4k(Bus &bus, size_t slot, size_t bank)
+{
+    for (size_t i = 0; i < 4; ++i)
+    {
+        map_chr_1k(bus, slot * 4 + i, bank * 4 + i);
+    }
+}
+
+void Mapper::map_chr_8k(Bus &bus, size_t bank)
+{
+    for (size_t i = 0; i < 8; ++i)
+    {
+        map_chr_1k(bus, i, bank * 8 + i);
+    }
+}
+
+void Mapper::set_mirroring(Bus &bus, Mirroring mirroring)
+{
+    bus.ppu.mirroring = mirroring;
+}
+
+std::unique_ptr<Mapper> make_mapper(const Rom &rom)
+{
+    switch (rom.mapper)
+    {
+    case 0:
+        return std::make_unique<Nrom>(rom);
+    case 1:
+        return std::make_unique<Mmc1>(rom);
+    case 2:
+        return std::make_unique<Uxrom>(rom);
+    case 3:
+        return std::make_unique<Cnrom>(rom);
+    case 4:
+        return std::make_unique<Mmc3>(rom);
+    case 7:
+        return std::make_unique<Axrom>(rom);
+    default:
+        throw std::runtime_error("Mapper " + std::to_string(rom.mapper) + " is not supported");
+    }
+}
+} // namespace EM
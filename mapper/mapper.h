@@ -0,0 +1,75 @@
+#ifndef MYNESEMULATOR__MAPPER_H_
+#define MYNESEMULATOR__MAPPER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../cartridge/cartridge.h"
+
+namespace EM
+{
+class Bus;
+
+// The cartridge board: which PRG and CHR banks the CPU and PPU see. A board
+// only runs when the CPU writes to it. It then repoints the bus page tables
+// at 8 KiB PRG banks and the PPU's pattern tables at 1 KiB CHR banks, so
+// reads never reach it and a bank switch copies nothing.
+class Mapper
+{
+  public:
+    explicit Mapper(const Rom &rom);
+    virtual ~Mapper() = default;
+
+    // Maps the power-on banks: PRG-RAM at $6000-$7FFF, the first 32 KiB of
+    // PRG-ROM and the first 8 KiB of CHR
+    virtual void reset(Bus &bus);
+    // A CPU write to $8000-$FFFF; boards without registers ignore it
+    virtual void write(Bus &bus, uint16_t addr, uint8_t data);
+    // Whether the CPU sees the same PRG-ROM for the whole run. The JIT reads
+    // such PRG-ROM straight from the ROM image, and only such ROMs can be
+    // translated ahead of time.
+    virtual bool fixed_prg() const
+    {
+        return false;
+    }
+    // A PPUCTRL or PPUMASK write moved the PPU's A12 rises, which came at
+    // rise_cycle until now (see NesPPU::a12_rise_cycle). The PPU is synced.
+    virtual void a12_changed(Bus &bus, uint16_t rise_cycle);
+    // Event::MapperIrq is due; the board schedules it itself. The PPU is
+    // synced.
+    virtual void run_irq_event(Bus &bus);
+
+  protected:
+    const Rom &rom;
+    // Work RAM at $6000-$7FFF, and CHR-RAM for boards without CHR-ROM: the
+    // header's size, but no less than the 8 KiB of pattern tables
+    std::array<uint8_t, 0x2000> prg_ram{};
+    std::vector<uint8_t> chr_ram;
+
+    static constexpr size_t PRG_BANK_SIZE = 0x2000;
+    static constexpr size_t CHR_BANK_SIZE = 0x0400;
+
+    size_t prg_banks_16k() const
+    {
+        return rom.prg_rom.size() / 0x4000;
+    }
+
+    // Bank numbers wrap around the size of the ROM. PRG slots count from
+    // $8000, CHR slots from $0000.
+    void map_prg_8k(Bus &bus, size_t slot, size_t bank);
+    void map_prg_16k(Bus &bus, size_t slot, size_t bank);
+    void map_prg_32k(Bus &bus, size_t bank);
+    void map_chr_1k(Bus &bus, size_t slot, size_t bank);
+    void map_chr_4k(Bus &bus, size_t slot, size_t bank);
+    void map_chr_8k(Bus &bus, size_t bank);
+    void set_mirroring(Bus &bus, Mirroring mirroring);
+};
+
+// The board for rom.mapper. Throws std::runtime_error for boards that are not
+// emulated.
+std::unique_ptr<Mapper> make_mapper(const Rom &rom);
+} // namespace EM
+#endif
@@ -0,0 +1,92 @@
+#include "mmc1.h"
+
+#include "../bus/bus.h"
+
+namespace EM
+{
+void Mmc1::reset(Bus &bus)
+{
+    Mapper::reset(bus);
+    map_banks(bus);
+}
+
+void Mmc1::write(Bus &bus, uint16_t addr, uint8_t data)
+{
+    if (data & 0x80)
+    {
+        shift = 0x10;
+        control |= 0x0c;
+        map_banks(bus);
+        return;
+    }
+
+    bool fifth = shift & 1;
+    shift = static_cast<uint8_t>((shift >> 1) | ((data & 1) << 4));
+    if (!fifth)
+    {
+        return;
+    }
+
+    switch ((addr >> 13) & 0x03)
+    {
+    case 0:
+        control = shift;
+        switch (control & 0x03)
+        {
+        case 0:
+            set_mirroring(bus, Mirroring::ONE_SCREEN_LOWER);
+            break;
+        case 1:
+            set_mirroring(bus, Mirroring::ONE_SCREEN_UPPER);
+            break;
+        case 2:
+            set_mirroring(bus, Mirroring::VERTICAL);
+            break;
+        default:
+            set_mirroring(bus, Mirroring::HORIZONTAL);
+            break;
+        }
+        break;
+    case 1:
+        chr_bank0 = shift;
+        break;
+    case 2:
+        chr_bank1 = shift;
+        break;
+    default:
+        prg_bank = shift & 0x0f;
+        break;
+    }
+    shift = 0x10;
+    map_banks(bus);
+}
+
+void Mmc1::map_banks(Bus &bus)
+{
+    switch ((control >> 2) & 0x03)
+    {
+    case 0:
+    case 1:
+        map_prg_32k(bus, prg_bank >> 1);
+        break;
+    case 2:
+        map_prg_16k(bus, 0, 0);
+        map_prg_16k(bus, 1, prg_bank);
+        break;
+    default:
+        map_prg_16k(bus, 0, prg_bank);
+        map_prg_16k(bus, 1, prg_banks_16k() - 1);
+        break;
+    }
+
+    if (control & 0x10)
+    {
+        map_chr_4k(bus, 0, chr_bank0);
+        map_chr_4k(bus, 1, chr_bank1);
+    }
+    else
+    {
+        map_chr_8k(bus, chr_bank0 >> 1);
+    }
+}
+} // namespace EM
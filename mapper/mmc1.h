@@ -0,0 +1,38 @@
+#ifndef MYNESEMULATOR__MMC1_H_
+#define MYNESEMULATOR__MMC1_H_
+
+#include "mapper.h"
+
+namespace EM
+{
+// Mapper 1, Nintendo's MMC1 (SxROM). Its four 5-bit registers are loaded
+// one bit per write through a serial port; the fifth write selects the
+// register by address and switches banks:
+//
+//     $8000 control: mirroring, PRG mode (32 KiB, or 16 KiB with $8000 or
+//           $C000 fixed) and CHR mode (one 8 KiB or two 4 KiB banks)
+//     $A000 CHR bank 0    $C000 CHR bank 1    $E000 PRG bank
+//
+// The 256 KiB PRG outer bank of SUROM and PRG-RAM disabling are not
+// emulated, nor is the CPU ignoring writes on consecutive cycles.
+class Mmc1 : public Mapper
+{
+  public:
+    using Mapper::Mapper;
+    void reset(Bus &bus) override;
+    void write(Bus &bus, uint16_t addr, uint8_t data) override;
+
+  private:
+    // Bits shifted in so far, from bit 4 down; the marker bit reaching bit 0
+    // means the next write is the fifth
+    uint8_t shift = 0x10;
+    // Power-on: PRG mode 3, the last bank fixed at $C000
+    uint8_t control = 0x0c;
+    uint8_t chr_bank0 = 0;
+    uint8_t chr_bank1 = 0;
+    uint8_t prg_bank = 0;
+
+    void map_banks(Bus &bus);
+};
+} // namespace EM
+#endif
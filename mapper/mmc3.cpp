@@ -0,0 +1,160 @@
+#include "mmc3.h"
+
+#include "../bus/bus.h"
+
+namespace EM
+{
+void Mmc3::reset(Bus &bus)
+{
+    Mapper::reset(bus);
+    map_banks(bus);
+    counted_to = bus.cycles;
+}
+
+void Mmc3::write(Bus &bus, uint16_t addr, uint8_t data)
+{
+    if (addr >= 0xc000)
+    {
+        // The counter changes from here on, so count what came before
+        bus.sync_ppu();
+        count_rises(bus, bus.ppu.a12_rise_cycle());
+    }
+
+    switch (addr & 0xe001)
+    {
+    case 0x8000:
+        bank_select = data;
+        map_banks(bus);
+        break;
+    case 0x8001:
+        banks[bank_select & 0x07] = data;
+        map_banks(bus);
+        break;
+    case 0xa000:
+        if (rom.screen_mirroring != Mirroring::FOUR_SCREEN)
+        {
+            set_mirroring(bus, data & 1 ? Mirroring::HORIZONTAL : Mirroring::VERTICAL);
+        }
+        break;
+    case 0xa001:
+        break;
+    case 0xc000:
+        irq_latch = data;
+        break;
+    case 0xc001:
+        irq_counter = 0;
+        irq_reload = true;
+        break;
+    case 0xe000:
+        irq_enabled = false;
+        bus.set_irq(IrqMapper, false);
+        break;
+    default:
+        irq_enabled = true;
+        break;
+    }
+
+    if (addr >= 0xc000)
+    {
+        schedule_irq(bus);
+    }
+}
+
+void Mmc3::a12_changed(Bus &bus, uint16_t rise_cycle)
+{
+    count_rises(bus, rise_cycle);
+    schedule_irq(bus);
+}
+
+void Mmc3::run_irq_event(Bus &bus)
+{
+    count_rises(bus, bus.ppu.a12_rise_cycle());
+    schedule_irq(bus);
+}
+
+void Mmc3::map_banks(Bus &bus)
+{
+    auto last = prg_banks_16k() * 2 - 1;
+    if (bank_select & 0x40)
+    {
+        map_prg_8k(bus, 0, last - 1);
+        map_prg_8k(bus, 2, banks[6]);
+    }
+    else
+    {
+        map_prg_8k(bus, 0, banks[6]);
+        map_prg_8k(bus, 2, last - 1);
+    }
+    map_prg_8k(bus, 1, banks[7]);
+    map_prg_8k(bus, 3, last);
+
+    // The 2 KiB banks sit at $0000, or at $1000 with A12 inverted
+    size_t inverted = bank_select & 0x80 ? 4 : 0;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        map_chr_1k(bus, (i * 2) ^ inverted, banks[i] & 0xfe);
+        map_chr_1k(bus, (i * 2 + 1) ^ inverted, banks[i] | 1);
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        map_chr_1k(bus, (4 + i) ^ inverted, banks[2 + i]);
+    }
+}
+
+void Mmc3::count_rises(Bus &bus, uint16_t rise_cycle)
+{
+    auto rises = bus.ppu.a12_rises_before((bus.cycles - counted_to) * 3, rise_cycle);
+    counted_to = bus.cycles;
+    clock_counter(bus, rises);
+}
+
+void Mmc3::clock_counter(Bus &bus, size_t rises)
+{
+    bool zero = false;
+    auto clock = [&] {
+        if (irq_counter == 0 || irq_reload)
+        {
+            irq_counter = irq_latch;
+            irq_reload = false;
+        }
+        else
+        {
+            --irq_counter;
+        }
+        zero = zero || irq_counter == 0;
+        --rises;
+    };
+
+    // Once reloaded and within the latch, the counter runs from the latch
+    // down to 0 over and over, so whole rounds can be skipped
+    while (rises > 0 && (irq_reload || irq_counter > irq_latch))
+    {
+        clock();
+    }
+    if (rises > irq_latch)
+    {
+        zero = true;
+        rises %= irq_latch + 1u;
+    }
+    while (rises > 0)
+    {
+        clock();
+    }
+
+    if (zero && irq_enabled)
+    {
+        bus.set_irq(IrqMapper, true);
+    }
+}
+
+void Mmc3::schedule_irq(Bus &bus)
+{
+    if (!irq_enabled || bus.ppu.a12_rise_cycle() == 0)
+    {
+        bus.scheduler.cancel(Event::MapperIrq);
+        return;
+    }
+    size_t rises = irq_counter == 0 || irq_reload ? irq_latch + 1u : irq_counter;
+    bus.scheduler.schedule(Event::MapperIrq, bus.cycles + (bus.ppu.cycles_to_a12_rise(rises) + 2) / 3);
+}
+} // namespace EM
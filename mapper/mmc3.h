@@ -0,0 +1,52 @@
+#ifndef MYNESEMULATOR__MMC3_H_
+#define MYNESEMULATOR__MMC3_H_
+
+#include "mapper.h"
+
+namespace EM
+{
+// Mapper 4, Nintendo's MMC3 (TxROM). Registers are selected by address bit
+// 0 and the $2000 range:
+//
+//     $8000 bank select: register 0-7, PRG mode, CHR A12 inversion
+//     $8001 bank data    $A000 mirroring    $A001 PRG-RAM protect
+//     $C000 IRQ latch    $C001 IRQ reload   $E000 IRQ off   $E001 IRQ on
+//
+// The scanline counter is clocked by PPU A12 rises. It is not stepped with
+// the PPU: the board predicts the rises from PPU state (see
+// NesPPU::a12_rise_cycle), schedules Event::MapperIrq at the one that takes
+// the counter to 0, and catches the count up when the CPU writes an IRQ
+// register or the PPU's pattern fetches change. The IRQ follows the later
+// MMC3 revisions, which raise it whenever a clock leaves the counter at 0.
+// PRG-RAM protection and the MMC6 are not emulated.
+class Mmc3 : public Mapper
+{
+  public:
+    using Mapper::Mapper;
+    void reset(Bus &bus) override;
+    void write(Bus &bus, uint16_t addr, uint8_t data) override;
+    void a12_changed(Bus &bus, uint16_t rise_cycle) override;
+    void run_irq_event(Bus &bus) override;
+
+  private:
+    uint8_t bank_select = 0;
+    // R0-R7: two 2 KiB and four 1 KiB CHR banks, then two 8 KiB PRG banks
+    std::array<uint8_t, 8> banks{0, 2, 4, 5, 6, 7, 0, 1};
+
+    uint8_t irq_latch = 0;
+    uint8_t irq_counter = 0;
+    bool irq_reload = false;
+    bool irq_enabled = false;
+    // Bus cycle up to which A12 rises have been counted
+    size_t counted_to = 0;
+
+    void map_banks(Bus &bus);
+    // Clocks the counter for the rises at rise_cycle since counted_to
+    void count_rises(Bus &bus, uint16_t rise_cycle);
+    void clock_counter(Bus &bus, size_t rises);
+    // Schedules Event::MapperIrq at the rise that next leaves the counter at
+    // 0, if that raises the IRQ
+    void schedule_irq(Bus &bus);
+};
+} // namespace EM
+#endif
@@ -2,6 +2,7 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <optional>
 #include <ostream>
@@ -27,7 +28,14 @@ void EM::NesPPU::write_to_data(uint8_t data)
     auto addr = address_register.get();
     if (addr >= 0 && addr <= 0x1fff)
     {
-        std::cerr << "attempt to write to chr rom space" << std::endl;
+        if (uint8_t *bank = chr_write_banks[addr >> 10])
+        {
+            bank[addr & 0x3ff] = data;
+        }
+        else
+        {
+            std::cerr << "attempt to write to chr rom space" << std::endl;
+        }
     }
     else if (addr >= 0x2000 && addr <= 0x2fff)
     {
@@ -72,7 +80,7 @@ uint8_t EM::NesPPU::read_data()
     if (address >= 0 && address <= 0x1fff)
     {
         auto result = internal_data_buf;
-        internal_data_buf = chr_rom[address];
+        internal_data_buf = *chr_data(address);
         return result;
     }
     else if (address >= 0x2000 && address <= 0x2fff)
@@ -105,7 +113,15 @@ uint16_t EM::NesPPU::mirror_vram_addr(uint16_t addr) const
     uint16_t mirrored_vram = addr & 0b10111111111111; // mirror down 0x3000-0x3eff to 0x2000 - 0x2eff
     uint16_t vram_index = mirrored_vram - 0x2000;
     uint16_t name_table = vram_index / 0x400;
-    if ((mirroring == Mirroring::VERTICAL && (name_table == 2 || name_table == 3)) ||
+    if (mirroring == Mirroring::ONE_SCREEN_LOWER)
+    {
+        return vram_index & 0x3ff;
+    }
+    else if (mirroring == Mirroring::ONE_SCREEN_UPPER)
+    {
+        return 0x400 | (vram_index & 0x3ff);
+    }
+    else if ((mirroring == Mirroring::VERTICAL && (name_table == 2 || name_table == 3)) ||
         (mirroring == Mirroring::HORIZONTAL && name_table == 3))
     {
         return vram_index - 0x800;
@@ -122,44 +138,43 @@ uint16_t EM::NesPPU::mirror_vram_addr(uint16_t addr) const
 bool EM::NesPPU::tick(uint8_t cycle)
 {
     cycles += static_cast<size_t>(cycle);
-    // std::cout << "PPU cycles: " << std::dec << static_cast<int>(cycles) << std::endl;
-    // std::cout << "PPU scanlines: " << std::dec << static_cast<int>(scanline) << std::endl;
 
     // 每一行周期341时
     if (cycles >= 341)
     {
-        if (is_sprite_0_hit(cycles))
-        {
-            status.set_sprite_zero_hit(true);
-        }
-        cycles = cycles - 341;
-        scanline++;
+        return end_scanline();
+    }
+    return false; // 如果未结束一帧，返回 false
+}
 
-        if (scanline == 241)
-        {
-            status.set_vblank_status(true);
-            status.set_sprite_zero_hit(false);
-            if (ctrl.generate_vblank_nmi())
-            {
-                nmi_interrupt = 1;
-            }
-        }
+bool NesPPU::end_scanline()
+{
+    if (is_sprite_0_hit(cycles))
+    {
+        status.set_sprite_zero_hit(true);
+    }
+    cycles = cycles - 341;
+    scanline++;
 
-        if (scanline >= 262)
+    if (scanline == 241)
+    {
+        status.set_vblank_status(true);
+        status.set_sprite_zero_hit(false);
+        if (ctrl.generate_vblank_nmi())
         {
-            scanline = 0;
-            nmi_interrupt.reset();
-            status.set_sprite_zero_hit(false);
-            status.reset_vblank_status();
-            return true;
+            nmi_interrupt = 1;
         }
     }
 
-    // std::cout << "After PPU cycles: " << std::dec << static_cast<int>(cycles) << std::endl;
-    // std::cout << "After PPU scanlines: " << std::dec << static_cast<int>(scanline) << std::endl;
-    // std::cout << std::endl;
-
-    return false; // 如果未结束一帧，返回 false
+    if (scanline >= 262)
+    {
+        scanline = 0;
+        nmi_interrupt.reset();
+        status.set_sprite_zero_hit(false);
+        status.reset_vblank_status();
+        return true;
+    }
+    return false;
 }
 
 bool NesPPU::is_sprite_0_hit(size_t cycle)
@@ -169,6 +184,86 @@ bool NesPPU::is_sprite_0_hit(size_t cycle)
     return (y == static_cast<size_t>(scanline) && x <= cycle && mask.show_sprites());
 }
 
+size_t NesPPU::cycles_to_next_event() const
+{
+    size_t remaining = 341 - cycles;
+    for (size_t line = scanline;; ++line)
+    {
+        bool sprite_0_line = oam_data[0] == line && mask.show_sprites();
+        if (sprite_0_line || line + 1 == 241 || line + 1 >= 262)
+        {
+            return remaining;
+        }
+        remaining += 341;
+    }
+}
+
+size_t NesPPU::cycles_to_nmi_event() const
+{
+    // Vblank starts at the end of line 240 and the frame at the end of 261
+    size_t last_line = scanline <= 240 ? 240 : 261;
+    return 341 - cycles + (last_line - scanline) * 341;
+}
+
+namespace
+{
+constexpr size_t LINE_CYCLES = 341;
+constexpr size_t FRAME_CYCLES = 262 * LINE_CYCLES;
+// Lines 0-239 and the pre-render line 261 fetch patterns
+constexpr size_t RISES_PER_FRAME = 241;
+
+// A12 rises at rise_cycle up to and including PPU cycle `cycle`, counted
+// from the start of a frame
+size_t a12_rises_through(size_t cycle, uint16_t rise_cycle)
+{
+    auto line = cycle % FRAME_CYCLES / LINE_CYCLES;
+    bool risen = cycle % LINE_CYCLES >= rise_cycle;
+    size_t in_frame = line < 240 ? line + risen : 240 + (line == 261 && risen);
+    return cycle / FRAME_CYCLES * RISES_PER_FRAME + in_frame;
+}
+} // namespace
+
+uint16_t NesPPU::a12_rise_cycle() const
+{
+    if (!mask.show_background() && !mask.show_sprites())
+    {
+        return 0;
+    }
+    // 8x16 sprites are fetched from $1000 even when no sprite is in range
+    bool sprites_high = ctrl.sprite_size() == 16 || ctrl.sprt_pattern_addr() == 0x1000;
+    bool background_high = ctrl.bknd_pattern_addr() == 0x1000;
+    if (sprites_high && !background_high)
+    {
+        return 260;
+    }
+    if (background_high && !sprites_high)
+    {
+        return 324;
+    }
+    return 0;
+}
+
+size_t NesPPU::a12_rises_before(size_t ppu_cycles, uint16_t rise_cycle) const
+{
+    if (rise_cycle == 0)
+    {
+        return 0;
+    }
+    // Whole frames ahead of now, so the start of the span never goes negative
+    auto now = scanline * LINE_CYCLES + cycles + (ppu_cycles / FRAME_CYCLES + 1) * FRAME_CYCLES;
+    return a12_rises_through(now, rise_cycle) - a12_rises_through(now - ppu_cycles, rise_cycle);
+}
+
+size_t NesPPU::cycles_to_a12_rise(size_t n) const
+{
+    auto rise_cycle = a12_rise_cycle();
+    auto now = scanline * LINE_CYCLES + cycles;
+    // The rises are numbered from the start of this frame
+    auto rise = a12_rises_through(now, rise_cycle) + n - 1;
+    auto line = rise % RISES_PER_FRAME < 240 ? rise % RISES_PER_FRAME : 261;
+    return rise / RISES_PER_FRAME * FRAME_CYCLES + line * LINE_CYCLES + rise_cycle - now;
+}
+
 void NesPPU::write_to_oam_addr(uint8_t value)
 {
     oam_addr = value;
@@ -183,13 +278,12 @@ uint8_t NesPPU::read_oam_data()
     return oam_data[oam_addr];
 }
 
-void NesPPU::write_oam_dma(const std::array<uint8_t, 256> &data)
+void NesPPU::write_oam_dma(const uint8_t *page)
 {
-    for (const auto &x : data)
-    {
-        oam_data[oam_addr] = x;
-        ++oam_addr;
-    }
+    // 256 bytes from OAMADDR on, wrapping around the end of OAM
+    size_t first = oam_data.size() - oam_addr;
+    std::memcpy(oam_data.data() + oam_addr, page, first);
+    std::memcpy(oam_data.data(), page + first, oam_addr);
 }
 
 void NesPPU::write_to_mask(uint8_t value)
@@ -18,30 +18,34 @@ namespace EM
 class NesPPU
 {
   public:
-    std::vector<uint8_t> chr_rom;
-    std::array<uint8_t, 32> palette_table{};
-    std::array<uint8_t, 2048> vram{};
-
-    uint8_t oam_addr;
-    std::array<uint8_t, 256> oam_data{};
+    // Timing and register state, touched on every tick and register access.
+    // The bus runs the PPU lazily: cycles and scanline are as of the CPU
+    // cycle in timestamp, which trails Bus::cycles until Bus::sync_ppu().
+    size_t timestamp = 0;
+    size_t cycles;
+    uint16_t scanline;
+    std::optional<uint8_t> nmi_interrupt;
 
-    AddrRegister address_register;
     ControlRegister ctrl;
+    MaskRegister mask;
     StatusRegister status;
+    AddrRegister address_register;
     ScrollRegister scroll;
-    MaskRegister mask;
-
+    uint8_t oam_addr;
     uint8_t internal_data_buf;
+    Mirroring mirroring;
 
-    size_t cycles;
-    uint16_t scanline;
-
-    std::optional<uint8_t> nmi_interrupt;
+    std::array<uint8_t, 32> palette_table{};
+    std::array<uint8_t, 256> oam_data{};
+    std::array<uint8_t, 2048> vram{};
 
-    Mirroring mirroring;
+    // The pattern tables by 1 KiB bank, pointed into CHR-ROM or CHR-RAM by
+    // the cartridge's mapper. Write entries are null for CHR-ROM.
+    std::array<const uint8_t *, 8> chr_banks{};
+    std::array<uint8_t *, 8> chr_write_banks{};
 
   public:
-    NesPPU(const std::vector<uint8_t> &chr_rom, const Mirroring &mirroring) : chr_rom(chr_rom), mirroring(mirroring)
+    explicit NesPPU(const Mirroring &mirroring) : mirroring(mirroring)
     {
         std::fill(palette_table.begin(), palette_table.end(), 0);
         std::fill(vram.begin(), vram.end(), 0);
@@ -61,7 +65,8 @@ class NesPPU
     void write_to_oam_addr(uint8_t value);
     void write_to_oam_data(uint8_t value);
     uint8_t read_oam_data();
-    void write_oam_dma(const std::array<uint8_t, 256> &data);
+    // Copies a whole 256-byte CPU page into OAM
+    void write_oam_dma(const uint8_t *page);
 
     void write_to_mask(uint8_t value);
 
@@ -71,9 +76,36 @@ class NesPPU
     uint8_t read_data();
     uint8_t read_status();
     uint16_t mirror_vram_addr(uint16_t addr) const;
+    // Pattern table byte at addr ($0000-$1FFF) in the banks mapped now
+    const uint8_t *chr_data(uint16_t addr) const
+    {
+        return chr_banks[addr >> 10] + (addr & 0x3ff);
+    }
 
     bool tick(uint8_t cycle);
+    // Takes the scanline end that cycles has reached; true at the end of a frame
+    bool end_scanline();
     bool is_sprite_0_hit(size_t cycle);
+    // PPU cycles until the next scanline end that can change PPUSTATUS or
+    // raise NMI: vblank start, end of frame, or the sprite-0 line
+    size_t cycles_to_next_event() const;
+    // PPU cycles until the next scanline end that raises or clears NMI:
+    // vblank start or end of frame
+    size_t cycles_to_nmi_event() const;
+
+    // The cycle of each rendered line (0-239 and 261) at which pattern
+    // fetches raise A12, bit 12 of the PPU address, after holding it low:
+    // 260 when sprites come from $1000 and the background from $0000, 324
+    // the other way round. 0 when rendering is off or A12 never stays low
+    // long enough. Boards like the MMC3 count these rises, so predicting
+    // them spares the PPU emulating each fetch.
+    uint16_t a12_rise_cycle() const;
+    // Rises at rise_cycle during the last `ppu_cycles` PPU cycles, up to and
+    // including the current one
+    size_t a12_rises_before(size_t ppu_cycles, uint16_t rise_cycle) const;
+    // PPU cycles until the nth rise from now, n >= 1, while a12_rise_cycle()
+    // is not 0
+    size_t cycles_to_a12_rise(size_t n) const;
 };
 } // namespace EM
 #endif
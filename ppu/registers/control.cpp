@@ -34,7 +34,7 @@ uint16_t EM::ControlRegister::bknd_pattern_addr() const
     return (bits & BACKGROUND_PATTERN_ADDR) ? 0x1000 : 0;
 }
 
-uint8_t EM::ControlRegister::sprite_size()
+uint8_t EM::ControlRegister::sprite_size() const
 {
     return (bits & SPRITE_SIZE) ? 16 : 8;
 }
@@ -27,7 +27,7 @@ class ControlRegister
     uint8_t vram_addr_increment();
     uint16_t sprt_pattern_addr() const;
     uint16_t bknd_pattern_addr() const;
-    uint8_t sprite_size();
+    uint8_t sprite_size() const;
     uint8_t master_slave_select();
     bool generate_vblank_nmi();
     void update(uint8_t data);
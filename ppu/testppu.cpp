@@ -5,8 +5,7 @@
 /* tests */
 void test_ppu_vram_writes()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.write_to_ppu_addr(0x23);
     ppu.write_to_ppu_addr(0x05);
     ppu.write_to_data(0x66);
@@ -15,8 +14,7 @@ void test_ppu_vram_writes()
 }
 void test_ppu_vram_reads()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.write_to_ctrl(0);
     ppu.vram[0x0305] = 0x66;
     ppu.write_to_ppu_addr(0x23);
@@ -28,8 +26,7 @@ void test_ppu_vram_reads()
 }
 void test_ppu_vram_cross_page()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.write_to_ctrl(0);
     ppu.vram[0x01ff] = 0x66;
     ppu.vram[0x0200] = 0x77;
@@ -44,8 +41,7 @@ void test_ppu_vram_cross_page()
 }
 void test_ppu_vram_reads_step_32()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
 
     ppu.write_to_ctrl(0b100);
     ppu.vram[0x01ff] = 0x66;
@@ -65,8 +61,7 @@ void test_ppu_vram_reads_step_32()
 }
 void test_vram_horizontal_mirror()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
 
     ppu.write_to_ppu_addr(0x24);
     ppu.write_to_ppu_addr(0x05);
@@ -95,8 +90,7 @@ void test_vram_horizontal_mirror()
 }
 void test_vram_vertical_mirror()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::VERTICAL};
+    EM::NesPPU ppu{EM::Mirroring::VERTICAL};
 
     ppu.write_to_ppu_addr(0x20);
     ppu.write_to_ppu_addr(0x05);
@@ -124,8 +118,7 @@ void test_vram_vertical_mirror()
 }
 void test_read_status_resets_latch()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.vram[0x0305] = 0x66;
 
     ppu.write_to_ppu_addr(0x21);
@@ -147,8 +140,7 @@ void test_read_status_resets_latch()
 }
 void test_ppu_vram_mirroring()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.write_to_ctrl(0);
     ppu.vram[0x0305] = 0x66;
     ppu.write_to_ppu_addr(0x63);
@@ -159,8 +151,7 @@ void test_ppu_vram_mirroring()
 }
 void test_read_status_resets_vblank()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.status.set_vblank_status(true);
     auto s = ppu.read_status();
     assert(1 == (s >> 7));
@@ -169,8 +160,7 @@ void test_read_status_resets_vblank()
 }
 void test_oam_read_write()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
     ppu.write_to_oam_addr(0x10);
     ppu.write_to_oam_data(0x66);
     ppu.write_to_oam_data(0x77);
@@ -184,8 +174,7 @@ void test_oam_read_write()
 }
 void test_oam_dma()
 {
-    std::vector<uint8_t> test(2048, 0);
-    EM::NesPPU ppu{test, EM::Mirroring::HORIZONTAL};
+    EM::NesPPU ppu{EM::Mirroring::HORIZONTAL};
 
     std::array<uint8_t, 256> data;
     data.fill(0x66);
@@ -194,7 +183,7 @@ void test_oam_dma()
     data[255] = 0x88;
 
     ppu.write_to_oam_addr(0x10);
-    ppu.write_oam_dma(data);
+    ppu.write_oam_dma(data.data());
 
     ppu.write_to_oam_addr(0xf);
     assert(0x88 == ppu.read_oam_data());
@@ -70,7 +70,7 @@ void render_name_table(const NesPPU &ppu, Frame &frame, std::vector<uint8_t> &na
         auto tile_column = i % 32;
         auto tile_row = i / 32;
         auto tile_idx = static_cast<uint16_t>(name_table[i]);
-        auto tile = &(ppu.chr_rom[bank + tile_idx * 16]);
+        auto tile = ppu.chr_data(static_cast<uint16_t>(bank + tile_idx * 16));
         auto p = bg_palette(ppu, attribute_table, tile_column, tile_row);
 
         for (auto y = 0; y <= 7; ++y)
@@ -152,6 +152,14 @@ void render(const NesPPU &ppu, Frame &frame)
         second_nametable_start = ppu.vram.begin();
         second_nametable_end = ppu.vram.begin() + 0x400;
     }
+    else if (mirr == Mirroring::ONE_SCREEN_LOWER || mirr == Mirroring::ONE_SCREEN_UPPER)
+    {
+        auto offset = mirr == Mirroring::ONE_SCREEN_LOWER ? 0 : 0x400;
+        main_nametable_start = ppu.vram.begin() + offset;
+        main_nametable_end = ppu.vram.begin() + offset + 0x400;
+        second_nametable_start = main_nametable_start;
+        second_nametable_end = main_nametable_end;
+    }
     else
     {
         throw std::runtime_error("Not support type");
@@ -192,7 +200,7 @@ void render(const NesPPU &ppu, Frame &frame)
         auto sp = sprite_palette(ppu, palette_idx);
         auto bank = ppu.ctrl.sprt_pattern_addr();
 
-        const auto *tile_data = &ppu.chr_rom[bank + tile_idx * 16];
+        const auto *tile_data = ppu.chr_data(static_cast<uint16_t>(bank + tile_idx * 16));
 
         for (int y = 0; y <= 7; ++y)
         {